@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <istream>
+#include <ostream>
+#include <cstdint>
+
+// Helpers for the compact binary formats (metadata cache entries, study
+// manifests): values in host byte order, strings as uint32 length + bytes.
+namespace BinaryIO {
+
+// Upper bound on any length read back, so corrupt input can't trigger a huge allocation
+const uint32_t MAX_LENGTH = 64 * 1024 * 1024;
+
+template <typename T>
+inline void writeValue(std::ostream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+inline void writeString(std::ostream& out, const std::string& value) {
+    writeValue<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+template <typename T>
+inline bool readValue(std::istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+inline bool readString(std::istream& in, std::string& value) {
+    uint32_t length = 0;
+    if (!readValue(in, length) || length > MAX_LENGTH) {
+        return false;
+    }
+    value.resize(length);
+    return length == 0 || static_cast<bool>(in.read(&value[0], length));
+}
+
+} // namespace BinaryIO
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// FIFO connecting two pipeline stages. push blocks while the queue is full,
+// so a fast producer can run at most 'capacity' items ahead of its consumers.
+// Once closed, consumers drain what is left and then see the end of input.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : m_capacity(std::max<size_t>(capacity, 1)),
+          m_closed(false) {}
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Wait for space and append; false if the queue was closed
+    bool push(T item) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed) {
+                return false;
+            }
+            m_items.push_back(std::move(item));
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Wait for an item; false once the queue is closed and empty
+    bool pop(T& item) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty()) {
+                return false;
+            }
+            item = std::move(m_items.front());
+            m_items.pop_front();
+        }
+        m_notFull.notify_one();
+        return true;
+    }
+
+    // Wait for at least one item and take up to maxItems; false once closed and empty
+    bool popBatch(std::vector<T>& items, size_t maxItems) {
+        items.clear();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            while (!m_items.empty() && items.size() < std::max<size_t>(maxItems, 1)) {
+                items.push_back(std::move(m_items.front()));
+                m_items.pop_front();
+            }
+        }
+        m_notFull.notify_all();
+        return !items.empty();
+    }
+
+    // End of input: wake every waiter; later pushes fail
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+private:
+    size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+};
@@ -6,6 +6,15 @@ CliParser::CliParser(int argc, char* argv[])
     : m_mode(CommandMode::NONE),
       m_threadCount(std::thread::hardware_concurrency()),
       m_verbose(false),
+      m_directIoThreshold(0),
+      m_cacheTtl(3600),
+      m_onDemandBilling(false),
+      m_compressMetadata(false),
+      m_schedulePolicy(SchedulePolicy::LARGEST_FIRST),
+      m_idleTimeout(300),
+      m_prefetchBudget(256ULL * 1024 * 1024),
+      m_useLeases(false),
+      m_maxMemory(0),
       m_valid(false) {
     
     m_valid = parseArgs(argc, argv);
@@ -66,6 +75,64 @@ bool CliParser::parseArgs(int argc, char* argv[]) {
             return false;
         }
     }
+    else if (arg1 == "--watch") {
+        m_mode = CommandMode::WATCH;
+        
+        if (argc < 3) {
+            m_errorMessage = "Watch mode requires a landing folder path";
+            printUsage();
+            return false;
+        }
+        
+        m_sourcePath = argv[2];
+    }
+    else if (arg1 == "--copy") {
+        m_mode = CommandMode::COPY;
+        
+        if (argc < 3) {
+            m_errorMessage = "Copy mode requires study UID";
+            printUsage();
+            return false;
+        }
+        
+        m_studyUid = argv[2];
+    }
+    else if (arg1 == "--manifest") {
+        m_mode = CommandMode::FILE_LIST;
+        
+        if (argc < 3) {
+            m_errorMessage = "Manifest mode requires a file list, or - for stdin";
+            printUsage();
+            return false;
+        }
+        
+        m_sourcePath = argv[2];
+    }
+    else if (arg1 == "--sync") {
+        m_mode = CommandMode::SYNC;
+        
+        if (argc < 3) {
+            m_errorMessage = "Sync mode requires source folder path";
+            printUsage();
+            return false;
+        }
+        
+        m_sourcePath = argv[2];
+    }
+    else if (arg1 == "--download-list") {
+        m_mode = CommandMode::DOWNLOAD_LIST;
+        
+        if (argc < 3) {
+            m_errorMessage = "Download list mode requires a file of study UIDs, or - for stdin";
+            printUsage();
+            return false;
+        }
+        
+        m_studyListPath = argv[2];
+    }
+    else if (arg1 == "--query") {
+        m_mode = CommandMode::QUERY;
+    }
     else if (arg1 == "--help" || arg1 == "-h") {
         printUsage();
         return false;
@@ -76,8 +143,10 @@ bool CliParser::parseArgs(int argc, char* argv[]) {
         return false;
     }
     
-    // Parse additional options
-    for (int i = 3; i < argc; i++) {
+    // Parse additional options (query mode takes no positional argument)
+    int firstOption = m_mode == CommandMode::QUERY ? 2 : 3;
+    bool scheduleGiven = false;
+    for (int i = firstOption; i < argc; i++) {
         std::string arg = argv[i];
         
         if (arg == "--threads") {
@@ -100,10 +169,178 @@ bool CliParser::parseArgs(int argc, char* argv[]) {
         else if (arg == "--verbose" || arg == "-v") {
             m_verbose = true;
         }
+        else if (arg == "--direct-io") {
+            if (i + 1 < argc) {
+                try {
+                    m_directIoThreshold = std::stoull(argv[i + 1]);
+                } catch (...) {
+                    m_errorMessage = "Invalid direct I/O size threshold";
+                    return false;
+                }
+                i++; // Skip the next argument as it's the size threshold
+            } else {
+                m_errorMessage = "Direct I/O flag requires a size in bytes";
+                return false;
+            }
+        }
+        else if (arg == "--cache-ttl") {
+            if (i + 1 < argc) {
+                try {
+                    m_cacheTtl = std::stoi(argv[i + 1]);
+                    if (m_cacheTtl < 0) {
+                        m_errorMessage = "Cache TTL cannot be negative";
+                        return false;
+                    }
+                } catch (...) {
+                    m_errorMessage = "Invalid cache TTL";
+                    return false;
+                }
+                i++; // Skip the next argument as it's the TTL
+            } else {
+                m_errorMessage = "Cache TTL flag requires a number of seconds";
+                return false;
+            }
+        }
+        else if (arg == "--on-demand") {
+            m_onDemandBilling = true;
+        }
+        else if (arg == "--compress-metadata") {
+            m_compressMetadata = true;
+        }
+        else if (arg == "--idle-timeout") {
+            if (i + 1 < argc) {
+                try {
+                    m_idleTimeout = std::stoi(argv[i + 1]);
+                    if (m_idleTimeout <= 0) {
+                        m_errorMessage = "Idle timeout must be positive";
+                        return false;
+                    }
+                } catch (...) {
+                    m_errorMessage = "Invalid idle timeout";
+                    return false;
+                }
+                i++; // Skip the next argument as it's the timeout
+            } else {
+                m_errorMessage = "Idle timeout flag requires a number of seconds";
+                return false;
+            }
+        }
+        else if (arg == "--prefetch-mb") {
+            if (i + 1 < argc) {
+                try {
+                    m_prefetchBudget = std::stoull(argv[i + 1]) * 1024 * 1024;
+                } catch (...) {
+                    m_errorMessage = "Invalid prefetch budget";
+                    return false;
+                }
+                i++; // Skip the next argument as it's the budget
+            } else {
+                m_errorMessage = "Prefetch flag requires a size in MB";
+                return false;
+            }
+        }
+        else if (arg == "--schedule") {
+            if (i + 1 >= argc || !parseSchedulePolicy(argv[i + 1], m_schedulePolicy)) {
+                m_errorMessage = "Schedule flag requires largest, study or fifo";
+                return false;
+            }
+            scheduleGiven = true;
+            i++; // Skip the next argument as it's the policy
+        }
+        else if (arg == "--deadline") {
+            std::chrono::seconds fromNow(0);
+            if (i + 1 >= argc || !RunDeadline::parse(argv[i + 1], std::time(nullptr), fromNow)) {
+                m_errorMessage = "Deadline flag requires HH:MM or a duration such as 90m or 6h";
+                return false;
+            }
+            m_deadline = RunDeadline::after(fromNow);
+            i++; // Skip the next argument as it's the deadline
+        }
+        else if (arg == "--max-memory") {
+            if (i + 1 >= argc || !parseByteSize(argv[i + 1], m_maxMemory) || m_maxMemory == 0) {
+                m_errorMessage = "Max memory flag requires a size in bytes, e.g. 4096M or 2G";
+                return false;
+            }
+            i++; // Skip the next argument as it's the size
+        }
+        else if (arg == "--shard") {
+            if (i + 1 >= argc || !StudyShard::parse(argv[i + 1], m_shard)) {
+                m_errorMessage = "Shard flag requires <index>/<count> with 0 <= index < count";
+                return false;
+            }
+            i++; // Skip the next argument as it's the shard
+        }
+        else if (arg == "--lease") {
+            m_useLeases = true;
+        }
+        else if (arg == "--dynamodb-endpoint") {
+            if (i + 1 >= argc) {
+                m_errorMessage = "DynamoDB endpoint flag requires a URL";
+                return false;
+            }
+            m_dynamoDbEndpoint = argv[i + 1];
+            i++; // Skip the next argument as it's the URL
+        }
+        else if (arg == "--to") {
+            if (m_mode != CommandMode::COPY) {
+                m_errorMessage = "--to is only valid in copy mode";
+                return false;
+            }
+            if (i + 1 >= argc) {
+                m_errorMessage = "--to requires <bucket> or <bucket>/<region>";
+                return false;
+            }
+            // Bucket names cannot contain '/', so anything after one is the region
+            std::string destination = argv[i + 1];
+            size_t slash = destination.find('/');
+            m_destinationBucket = destination.substr(0, slash);
+            if (slash != std::string::npos) {
+                m_destinationRegion = destination.substr(slash + 1);
+            }
+            i++; // Skip the next argument as it's the destination
+        }
+        else if (arg == "--to-table") {
+            if (m_mode != CommandMode::COPY) {
+                m_errorMessage = "--to-table is only valid in copy mode";
+                return false;
+            }
+            if (i + 1 >= argc) {
+                m_errorMessage = "--to-table requires a table name";
+                return false;
+            }
+            m_destinationTable = argv[i + 1];
+            i++; // Skip the next argument as it's the table name
+        }
+        else if (arg == "--patient-id" || arg == "--accession" || arg == "--study-date") {
+            if (m_mode != CommandMode::QUERY) {
+                m_errorMessage = arg + " is only valid in query mode";
+                return false;
+            }
+            if (i + 1 >= argc) {
+                m_errorMessage = arg + " requires a value";
+                return false;
+            }
+            std::string value = argv[i + 1];
+            if (arg == "--patient-id") {
+                m_studyQuery.patientId = value;
+            } else if (arg == "--accession") {
+                m_studyQuery.accessionNumber = value;
+            } else if (!m_studyQuery.setDateRange(value)) {
+                m_errorMessage = "Study date must be YYYYMMDD or YYYYMMDD-YYYYMMDD";
+                return false;
+            }
+            i++; // Skip the next argument as it's the value
+        }
         else if (arg == "--output") {
-            // Already handled for download mode
-            if (m_mode != CommandMode::DOWNLOAD) {
-                m_errorMessage = "Output flag is only valid in download mode";
+            if (m_mode == CommandMode::QUERY || m_mode == CommandMode::DOWNLOAD_LIST) {
+                if (i + 1 >= argc) {
+                    m_errorMessage = "Output flag requires a path";
+                    return false;
+                }
+                m_outputPath = argv[i + 1];
+            } else if (m_mode != CommandMode::DOWNLOAD) {
+                // Already handled for download mode
+                m_errorMessage = "Output flag is only valid in download, download list and query modes";
                 return false;
             }
             i++; // Skip the next argument as it's the output path
@@ -114,6 +351,52 @@ bool CliParser::parseArgs(int argc, char* argv[]) {
         }
     }
     
+    if (m_mode == CommandMode::DOWNLOAD_LIST && m_outputPath.empty()) {
+        m_errorMessage = "Download list mode requires --output flag with path";
+        printUsage();
+        return false;
+    }
+    
+    if (m_shard.isSharded() && m_mode != CommandMode::UPLOAD && m_mode != CommandMode::WATCH &&
+        m_mode != CommandMode::FILE_LIST) {
+        m_errorMessage = "--shard is only valid in upload, manifest and watch modes";
+        return false;
+    }
+    
+    if (m_useLeases && m_mode != CommandMode::UPLOAD) {
+        m_errorMessage = "--lease is only valid in upload mode";
+        return false;
+    }
+    
+    if (m_useLeases && m_shard.isSharded()) {
+        m_errorMessage = "--lease and --shard cannot be combined";
+        return false;
+    }
+    
+    bool uploading = m_mode == CommandMode::UPLOAD || m_mode == CommandMode::WATCH ||
+                     m_mode == CommandMode::SYNC || m_mode == CommandMode::FILE_LIST;
+    if ((m_deadline.isSet() || m_maxMemory > 0) && !uploading) {
+        m_errorMessage = "--deadline and --max-memory are only valid in upload, manifest, sync and watch modes";
+        return false;
+    }
+    
+    // Racing a deadline, finishing whole studies matters more than overall throughput
+    if (m_deadline.isSet() && !scheduleGiven) {
+        m_schedulePolicy = SchedulePolicy::STUDY_COMPLETION;
+    }
+    
+    if (m_mode == CommandMode::COPY && m_destinationBucket.empty()) {
+        m_errorMessage = "Copy mode requires --to <bucket>[/<region>]";
+        printUsage();
+        return false;
+    }
+    
+    if (m_mode == CommandMode::QUERY && m_studyQuery.empty()) {
+        m_errorMessage = "Query mode requires --patient-id, --accession or --study-date";
+        printUsage();
+        return false;
+    }
+    
     return true;
 }
 
@@ -121,12 +404,35 @@ void CliParser::printUsage() const {
     std::cout << "DICOM Transfer Utility" << std::endl;
     std::cout << "Usage:" << std::endl;
     std::cout << "  dicom_transfer --upload <path-to-folder> [options]" << std::endl;
+    std::cout << "  dicom_transfer --manifest <file|-> [options]" << std::endl;
+    std::cout << "                 (one <path>[<TAB><study-uid>[<TAB><size>]] per line)" << std::endl;
+    std::cout << "  dicom_transfer --sync <path-to-folder> [options]" << std::endl;
+    std::cout << "  dicom_transfer --watch <landing-folder> [options]" << std::endl;
     std::cout << "  dicom_transfer --download <study-uid> --output <path-to-folder> [options]" << std::endl;
+    std::cout << "  dicom_transfer --download-list <file|-> --output <path-to-folder> [options]" << std::endl;
+    std::cout << "  dicom_transfer --copy <study-uid> --to <bucket>[/<region>] [options]" << std::endl;
+    std::cout << "  dicom_transfer --query [--patient-id <id>] [--accession <number>]" << std::endl;
+    std::cout << "                 [--study-date <YYYYMMDD[-YYYYMMDD]>] [--output <path-to-folder>] [options]" << std::endl;
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "  --threads <count>    Number of threads to use (default: " 
               << std::thread::hardware_concurrency() << ")" << std::endl;
     std::cout << "  --verbose, -v        Enable verbose logging" << std::endl;
+    std::cout << "  --direct-io <bytes>  Read source files at least this large with O_DIRECT" << std::endl;
+    std::cout << "  --cache-ttl <secs>   Reuse cached study listings this long; 0 disables (default: 3600)" << std::endl;
+    std::cout << "  --on-demand          Create DynamoDB tables with on-demand (PAY_PER_REQUEST) billing" << std::endl;
+    std::cout << "  --compress-metadata  Store every study attribute as one zstd-compressed blob" << std::endl;
+    std::cout << "  --schedule <policy>  Upload order across studies: largest, study or fifo (default: largest)" << std::endl;
+    std::cout << "  --prefetch-mb <MB>   Memory for files read ahead of their upload; 0 reads one at a time (default: 256)" << std::endl;
+    std::cout << "  --idle-timeout <secs> Watch mode: finalize a study after this long without new files (default: 300)" << std::endl;
+    std::cout << "  --shard <i>/<n>      Upload only studies in shard i (0-based) of n workers" << std::endl;
+    std::cout << "  --lease              Upload: share studies with other workers through DynamoDB leases" << std::endl;
+    std::cout << "  --dynamodb-endpoint <url> Use this DynamoDB endpoint (e.g. DynamoDB Local)" << std::endl;
+    std::cout << "  --deadline <HH:MM|90m> Upload: start no study that won't finish by then, and stop at it" << std::endl;
+    std::cout << "                       (implies --schedule study unless given)" << std::endl;
+    std::cout << "  --max-memory <bytes> Upload: hold file contents and study state within this (K/M/G suffixes)" << std::endl;
+    std::cout << "  --to-table <name>    Copy: DynamoDB table for the destination's records" << std::endl;
+    std::cout << "                       (default: dicom-studies-<bucket>)" << std::endl;
     std::cout << "  --help, -h           Display this help message" << std::endl;
 }
 
@@ -154,10 +460,78 @@ std::string CliParser::getStudyUid() const {
     return m_studyUid;
 }
 
+std::string CliParser::getStudyListPath() const {
+    return m_studyListPath;
+}
+
+const StudyQuery& CliParser::getStudyQuery() const {
+    return m_studyQuery;
+}
+
 int CliParser::getThreadCount() const {
     return m_threadCount;
 }
 
 bool CliParser::isVerbose() const {
     return m_verbose;
+}
+
+size_t CliParser::getDirectIoThreshold() const {
+    return m_directIoThreshold;
+}
+
+int CliParser::getCacheTtl() const {
+    return m_cacheTtl;
+}
+
+bool CliParser::isOnDemandBilling() const {
+    return m_onDemandBilling;
+}
+
+bool CliParser::isCompressedMetadata() const {
+    return m_compressMetadata;
+}
+
+SchedulePolicy CliParser::getSchedulePolicy() const {
+    return m_schedulePolicy;
+}
+
+int CliParser::getIdleTimeout() const {
+    return m_idleTimeout;
+}
+
+const StudyShard& CliParser::getShard() const {
+    return m_shard;
+}
+
+bool CliParser::isUsingLeases() const {
+    return m_useLeases;
+}
+
+std::string CliParser::getDynamoDbEndpoint() const {
+    return m_dynamoDbEndpoint;
+}
+
+std::string CliParser::getDestinationBucket() const {
+    return m_destinationBucket;
+}
+
+std::string CliParser::getDestinationRegion() const {
+    return m_destinationRegion;
+}
+
+std::string CliParser::getDestinationTable() const {
+    return m_destinationTable;
+}
+
+uint64_t CliParser::getPrefetchBudget() const {
+    return m_prefetchBudget;
+}
+
+const RunDeadline& CliParser::getDeadline() const {
+    return m_deadline;
+}
+
+uint64_t CliParser::getMaxMemory() const {
+    return m_maxMemory;
 } 
\ No newline at end of file
@@ -4,10 +4,21 @@
 #include <vector>
 #include <unordered_map>
 
+#include "study_record.h"
+#include "file_scheduler.h"
+#include "study_shard.h"
+#include "run_deadline.h"
+
 enum class CommandMode {
     NONE,
     UPLOAD,
-    DOWNLOAD
+    DOWNLOAD,
+    DOWNLOAD_LIST,
+    WATCH,
+    SYNC,
+    COPY,
+    FILE_LIST,
+    QUERY
 };
 
 class CliParser {
@@ -21,10 +32,27 @@ public:
     std::string getSourcePath() const;
     std::string getOutputPath() const;
     std::string getStudyUid() const;
+    std::string getStudyListPath() const;
+    std::string getDestinationBucket() const;
+    std::string getDestinationRegion() const;
+    std::string getDestinationTable() const;
+    const StudyQuery& getStudyQuery() const;
     
     // Additional options
     int getThreadCount() const;
     bool isVerbose() const;
+    size_t getDirectIoThreshold() const;
+    int getCacheTtl() const;
+    bool isOnDemandBilling() const;
+    bool isCompressedMetadata() const;
+    SchedulePolicy getSchedulePolicy() const;
+    int getIdleTimeout() const;
+    uint64_t getPrefetchBudget() const;
+    const StudyShard& getShard() const;
+    bool isUsingLeases() const;
+    std::string getDynamoDbEndpoint() const;
+    const RunDeadline& getDeadline() const;
+    uint64_t getMaxMemory() const;   // 0 when unlimited
     
 private:
     bool parseArgs(int argc, char* argv[]);
@@ -34,9 +62,26 @@ private:
     std::string m_sourcePath;
     std::string m_outputPath;
     std::string m_studyUid;
+    std::string m_studyListPath;
+    std::string m_destinationBucket;
+    std::string m_destinationRegion;
+    std::string m_destinationTable;
+    StudyQuery m_studyQuery;
     
     int m_threadCount;
     bool m_verbose;
+    size_t m_directIoThreshold;
+    int m_cacheTtl;
+    bool m_onDemandBilling;
+    bool m_compressMetadata;
+    SchedulePolicy m_schedulePolicy;
+    int m_idleTimeout;
+    uint64_t m_prefetchBudget;
+    StudyShard m_shard;
+    bool m_useLeases;
+    std::string m_dynamoDbEndpoint;
+    RunDeadline m_deadline;
+    uint64_t m_maxMemory;
     
     bool m_valid;
     std::string m_errorMessage;
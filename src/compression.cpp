@@ -0,0 +1,59 @@
+#include "compression.h"
+#include "logger.h"
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Largest decompressed blob accepted, well above DynamoDB's 400 KB item limit
+const unsigned long long MAX_DECOMPRESSED_SIZE = 16 * 1024 * 1024;
+
+bool Compression::isAvailable() {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Compression::compress(const std::string& input, std::string& output, int level) {
+#ifdef HAVE_ZSTD
+    output.resize(ZSTD_compressBound(input.size()));
+    size_t written = ZSTD_compress(&output[0], output.size(), input.data(), input.size(), level);
+    if (ZSTD_isError(written)) {
+        LOG_ERROR(std::string("zstd compression failed: ") + ZSTD_getErrorName(written));
+        return false;
+    }
+    output.resize(written);
+    return true;
+#else
+    (void)input;
+    (void)output;
+    (void)level;
+    LOG_ERROR("Built without zstd; cannot compress");
+    return false;
+#endif
+}
+
+bool Compression::decompress(const std::string& input, std::string& output) {
+#ifdef HAVE_ZSTD
+    unsigned long long size = ZSTD_getFrameContentSize(input.data(), input.size());
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN ||
+        size > MAX_DECOMPRESSED_SIZE) {
+        LOG_ERROR("Not a usable zstd frame");
+        return false;
+    }
+    output.resize(size);
+    size_t read = ZSTD_decompress(&output[0], output.size(), input.data(), input.size());
+    if (ZSTD_isError(read) || read != size) {
+        LOG_ERROR("zstd decompression failed");
+        return false;
+    }
+    return true;
+#else
+    (void)input;
+    (void)output;
+    LOG_ERROR("Built without zstd; cannot decompress");
+    return false;
+#endif
+}
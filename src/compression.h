@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+// zstd compression for metadata blobs. Available only when built with
+// HAVE_ZSTD; otherwise every call fails and callers store data uncompressed.
+class Compression {
+public:
+    // Whether this build can compress at all
+    static bool isAvailable();
+
+    // Compress input as a single zstd frame
+    static bool compress(const std::string& input, std::string& output, int level = 3);
+
+    // Decompress a single zstd frame, refusing frames that declare an implausible size
+    static bool decompress(const std::string& input, std::string& output);
+};
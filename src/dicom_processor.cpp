@@ -33,6 +33,41 @@ DcmTagKey parseTagKey(const std::string& tagStr) {
     }
 }
 
+// Values longer than this are bulk data rather than descriptive attributes
+const Uint32 MAX_EXTENDED_ATTRIBUTE_LENGTH = 1024;
+
+// Collect the non-bulk top-level attributes not already held in record fields
+void extractExtendedAttributes(DcmDataset* dataset, StudyRecord& record) {
+    for (unsigned long i = 0; i < dataset->card(); ++i) {
+        DcmElement* element = dataset->getElement(i);
+        if (element == nullptr || !element->isLeaf() ||
+            element->getLengthField() > MAX_EXTENDED_ATTRIBUTE_LENGTH) {
+            continue;
+        }
+        switch (element->ident()) {
+            case EVR_OB: case EVR_OW: case EVR_OF: case EVR_OD: case EVR_OL:
+            case EVR_UN: case EVR_PixelData:
+                continue;
+            default:
+                break;
+        }
+        
+        DcmTag tag = element->getTag();
+        if (tag.isPrivate()) {
+            continue;
+        }
+        
+        OFString value;
+        if (element->getOFStringArray(value).good() && !value.empty()) {
+            record.extendedAttributes[tag.getTagName()] = value.c_str();
+        }
+    }
+    
+    for (const auto& field : StudyRecord::fields()) {
+        record.extendedAttributes.erase(field.name);
+    }
+}
+
 DicomProcessor::DicomProcessor() {
     // Initialize DCMTK if needed
 }
@@ -44,11 +79,19 @@ bool DicomProcessor::isDicomFile(const std::string& filepath) {
 }
 
 bool DicomProcessor::extractMetadata(const std::string& filepath, Json::Value& metadata) {
-    if (!isDicomFile(filepath)) {
-        LOG_ERROR("File is not a valid DICOM file: " + filepath);
+    StudyRecord record;
+    if (!extractStudyRecord(filepath, record)) {
         return false;
     }
     
+    Json::Value fields = record.toJson();
+    for (const auto& name : fields.getMemberNames()) {
+        metadata[name] = fields[name];
+    }
+    return true;
+}
+
+bool DicomProcessor::extractStudyRecord(const std::string& filepath, StudyRecord& record) {
     try {
         DcmFileFormat fileformat;
         OFCondition status = fileformat.loadFile(filepath.c_str());
@@ -56,21 +99,19 @@ bool DicomProcessor::extractMetadata(const std::string& filepath, Json::Value& m
         if (status.good()) {
             DcmDataset* dataset = fileformat.getDataset();
             
-            for (const auto& tag : m_commonTags) {
-                const std::string& tagName = tag.first;
-                const std::string& tagID = tag.second;
-                
+            for (const auto& field : StudyRecord::fields()) {
                 OFString value;
-                DcmTagKey dcmTagKey = parseTagKey(tagID);
+                DcmTagKey dcmTagKey = parseTagKey(field.tag);
                 
                 if (dataset->findAndGetOFString(dcmTagKey, value).good()) {
-                    metadata[tagName] = std::string(value.c_str());
+                    record.*field.member = value.c_str();
                 }
             }
             
+            extractExtendedAttributes(dataset, record);
             return true;
         } else {
-            LOG_ERROR("Failed to load DICOM file: " + filepath);
+            LOG_ERROR("File is not a valid DICOM file: " + filepath);
             return false;
         }
     } catch (const std::exception& e) {
@@ -146,6 +187,54 @@ std::map<std::string, std::vector<std::string>> DicomProcessor::groupFilesByStud
     return studyGroups;
 }
 
+bool DicomProcessor::extractInstanceRecord(const std::string& filepath, InstanceRecord& instance) {
+    DcmFileFormat fileformat;
+    OFCondition status = fileformat.loadFile(filepath.c_str());
+    
+    if (!status.good()) {
+        LOG_ERROR("Failed to load DICOM file: " + filepath);
+        return false;
+    }
+    
+    DcmDataset* dataset = fileformat.getDataset();
+    OFString value;
+    
+    if (dataset->findAndGetOFString(DCM_StudyInstanceUID, value).good()) {
+        instance.studyUid = value.c_str();
+    }
+    if (dataset->findAndGetOFString(DCM_SeriesInstanceUID, value).good()) {
+        instance.seriesUid = value.c_str();
+    }
+    if (dataset->findAndGetOFString(DCM_SOPInstanceUID, value).good()) {
+        instance.sopInstanceUid = value.c_str();
+    }
+    
+    Sint32 instanceNumber = 0;
+    if (dataset->findAndGetSint32(DCM_InstanceNumber, instanceNumber).good()) {
+        instance.instanceNumber = instanceNumber;
+    }
+    
+    instance.sourcePath = filepath;
+    return !instance.studyUid.empty();
+}
+
+std::map<std::string, std::vector<InstanceRecord>> DicomProcessor::groupInstancesByStudy(
+    const std::vector<std::string>& dicomFiles) {
+    
+    std::map<std::string, std::vector<InstanceRecord>> studyGroups;
+    
+    for (const auto& filepath : dicomFiles) {
+        InstanceRecord instance;
+        if (extractInstanceRecord(filepath, instance)) {
+            studyGroups[instance.studyUid].push_back(instance);
+        } else {
+            LOG_WARNING("Could not determine study UID for file: " + filepath);
+        }
+    }
+    
+    return studyGroups;
+}
+
 std::string DicomProcessor::extractTag(const std::string& filepath, const std::string& tag) {
     DcmFileFormat fileformat;
     OFCondition status = fileformat.loadFile(filepath.c_str());
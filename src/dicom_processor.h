@@ -5,6 +5,8 @@
 #include <map>
 #include <json/json.h>
 
+#include "study_record.h"
+
 // Forward declaration
 class Logger;
 
@@ -18,6 +20,10 @@ public:
     // Extract metadata from a DICOM file
     bool extractMetadata(const std::string& filepath, Json::Value& metadata);
     
+    // Extract study-level attributes from a DICOM file into a typed record,
+    // keeping the dataset's other non-bulk attributes as extended attributes
+    bool extractStudyRecord(const std::string& filepath, StudyRecord& record);
+    
     // Get study UID from a DICOM file
     std::string getStudyUid(const std::string& filepath);
     
@@ -29,25 +35,15 @@ public:
     std::map<std::string, std::vector<std::string>> groupFilesByStudy(
         const std::vector<std::string>& dicomFiles);
     
+    // Read the study, series and instance identifiers of a DICOM file
+    bool extractInstanceRecord(const std::string& filepath, InstanceRecord& instance);
+    
+    // Group DICOM files by study UID, keeping each file's instance identifiers
+    std::map<std::string, std::vector<InstanceRecord>> groupInstancesByStudy(
+        const std::vector<std::string>& dicomFiles);
+    
 private:
     // Helper methods
     std::string extractTag(const std::string& filepath, const std::string& tag);
     bool isValidDicomFile(const std::string& filepath);
-    
-    // Common DICOM tags to extract
-    const std::vector<std::pair<std::string, std::string>> m_commonTags = {
-        {"PatientID", "0010,0020"},
-        {"PatientName", "0010,0010"},
-        {"StudyDate", "0008,0020"},
-        {"StudyTime", "0008,0030"},
-        {"AccessionNumber", "0008,0050"},
-        {"StudyID", "0020,0010"},
-        {"StudyInstanceUID", "0020,000D"},
-        {"StudyDescription", "0008,1030"},
-        {"Modality", "0008,0060"},
-        {"SeriesInstanceUID", "0020,000E"},
-        {"SeriesNumber", "0020,0011"},
-        {"SeriesDescription", "0008,103E"},
-        {"SOPInstanceUID", "0008,0018"}
-    };
 }; 
\ No newline at end of file
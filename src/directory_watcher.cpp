@@ -0,0 +1,165 @@
+#include "directory_watcher.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const uint32_t WATCH_MASK = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO |
+                            IN_MOVED_FROM | IN_DELETE | IN_MOVE_SELF | IN_ONLYDIR;
+
+// Room for a burst of events per read
+const size_t EVENT_BUFFER_SIZE = 64 * 1024;
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(const std::string& rootPath, std::chrono::seconds quietPeriod)
+    : m_rootPath(rootPath),
+      m_quietPeriod(quietPeriod),
+      m_fd(-1) {
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        LOG_ERROR("Failed to initialize inotify: " + std::string(strerror(errno)));
+        return;
+    }
+
+    // Files already in the tree are left to the caller's initial scan
+    addTree(m_rootPath, nullptr);
+    if (m_watches.empty()) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool DirectoryWatcher::isOpen() const {
+    return m_fd >= 0;
+}
+
+size_t DirectoryWatcher::getWatchCount() const {
+    return m_watches.size();
+}
+
+size_t DirectoryWatcher::getPendingCount() const {
+    return m_pending.size();
+}
+
+void DirectoryWatcher::addTree(const std::string& path, const FileCallback* onExisting) {
+    int wd = inotify_add_watch(m_fd, path.c_str(), WATCH_MASK);
+    if (wd < 0) {
+        LOG_ERROR("Failed to watch directory: " + path + " - " + strerror(errno));
+        return;
+    }
+    m_watches[wd] = path;
+
+    try {
+        fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied);
+        for (const auto& entry : it) {
+            std::string entryPath = entry.path().string();
+            if (entry.is_directory()) {
+                wd = inotify_add_watch(m_fd, entryPath.c_str(), WATCH_MASK);
+                if (wd < 0) {
+                    LOG_ERROR("Failed to watch directory: " + entryPath + " - " + strerror(errno));
+                    continue;
+                }
+                m_watches[wd] = entryPath;
+            } else if (onExisting && entry.is_regular_file()) {
+                (*onExisting)(entryPath);
+            }
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_WARNING("Error listing files in directory: " + path + " - " + e.what());
+    }
+}
+
+void DirectoryWatcher::poll(std::chrono::milliseconds timeout, const FileCallback& onFileReady) {
+    if (m_fd < 0) {
+        return;
+    }
+
+    pollfd pfd{m_fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ready < 0 && errno != EINTR) {
+        LOG_ERROR("Failed to poll inotify: " + std::string(strerror(errno)));
+    }
+
+    if (ready > 0) {
+        std::vector<char> buffer(EVENT_BUFFER_SIZE);
+        while (true) {
+            ssize_t length = read(m_fd, buffer.data(), buffer.size());
+            if (length <= 0) {
+                break;
+            }
+            for (ssize_t offset = 0; offset < length; ) {
+                auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+                std::string name = event->len > 0 ? std::string(event->name) : std::string();
+                handleEvent(event->wd, event->mask, name, onFileReady);
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+
+    // Files nobody closed are taken once they stop changing
+    auto now = Clock::now();
+    for (auto it = m_pending.begin(); it != m_pending.end(); ) {
+        if (now - it->second >= m_quietPeriod) {
+            std::string path = it->first;
+            it = m_pending.erase(it);
+            onFileReady(path);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DirectoryWatcher::handleEvent(int wd, uint32_t mask, const std::string& name,
+                                   const FileCallback& onFileReady) {
+    if (mask & IN_Q_OVERFLOW) {
+        // Events were lost; rescan so no completed file is missed
+        LOG_WARNING("inotify queue overflowed; rescanning: " + m_rootPath);
+        addTree(m_rootPath, &onFileReady);
+        return;
+    }
+
+    auto watch = m_watches.find(wd);
+    if (watch == m_watches.end()) {
+        return;
+    }
+    if (mask & IN_IGNORED) {
+        m_watches.erase(watch);
+        return;
+    }
+    if (mask & IN_MOVE_SELF) {
+        // Its recorded path is stale; a move back in is seen as a new directory
+        inotify_rm_watch(m_fd, wd);
+        return;
+    }
+
+    std::string path = Utils::joinPath(watch->second, name);
+    if (mask & IN_ISDIR) {
+        if (mask & (IN_CREATE | IN_MOVED_TO)) {
+            addTree(path, &onFileReady);
+        }
+        return;
+    }
+
+    if (mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        m_pending.erase(path);
+        onFileReady(path);
+    } else if (mask & (IN_CREATE | IN_MODIFY)) {
+        m_pending[path] = Clock::now();
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        m_pending.erase(path);
+    }
+}
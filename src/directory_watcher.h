@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+// Recursive inotify watch over a landing directory, reporting each file once
+// it is complete: on close-after-write, when it is moved in, or once it has
+// been quiet for the quiet period (for writers that never close it).
+// New subdirectories are watched as they appear.
+class DirectoryWatcher {
+public:
+    using FileCallback = std::function<void(const std::string& path)>;
+
+    DirectoryWatcher(const std::string& rootPath, std::chrono::seconds quietPeriod);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // False if inotify could not be set up on the root directory
+    bool isOpen() const;
+
+    // Wait up to timeout for events and report every file that became complete
+    void poll(std::chrono::milliseconds timeout, const FileCallback& onFileReady);
+
+    // Directories being watched
+    size_t getWatchCount() const;
+
+    // Files written to but not yet complete
+    size_t getPendingCount() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Watch a directory and everything below it, reporting files already
+    // inside when onExisting is set (they may predate the watch)
+    void addTree(const std::string& path, const FileCallback* onExisting);
+
+    void handleEvent(int wd, uint32_t mask, const std::string& name,
+                     const FileCallback& onFileReady);
+
+    std::string m_rootPath;
+    std::chrono::seconds m_quietPeriod;
+    int m_fd;
+
+    // Watch descriptor to directory path
+    std::unordered_map<int, std::string> m_watches;
+
+    // Files still being written, with the time of their last write
+    std::unordered_map<std::string, Clock::time_point> m_pending;
+};
@@ -0,0 +1,104 @@
+#include "download_progress.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+DownloadProgress::DownloadProgress(const std::string& path)
+    : m_path(path),
+      m_fd(-1) {
+    load();
+
+    m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        LOG_ERROR("Failed to open download progress file: " + m_path + " - " + strerror(errno));
+    }
+}
+
+DownloadProgress::~DownloadProgress() {
+    if (m_fd >= 0) {
+        fdatasync(m_fd);
+        close(m_fd);
+    }
+}
+
+bool DownloadProgress::isOpen() const {
+    return m_fd >= 0;
+}
+
+bool DownloadProgress::load() {
+    std::ifstream input(m_path);
+    if (!input.is_open()) {
+        // Fresh download
+        return true;
+    }
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (input.eof()) {
+            // Torn final write, cut off before its newline
+            break;
+        }
+        std::string studyUid = Utils::trim(line);
+        if (!studyUid.empty()) {
+            m_completed.insert(studyUid);
+        }
+    }
+
+    if (!m_completed.empty()) {
+        LOG_INFO("Resuming download; " + std::to_string(m_completed.size()) +
+                 " studies already complete");
+    }
+    return true;
+}
+
+bool DownloadProgress::isComplete(const std::string& studyUid) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completed.count(studyUid) > 0;
+}
+
+bool DownloadProgress::markComplete(const std::string& studyUid) {
+    std::string line = studyUid + "\n";
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_completed.insert(studyUid);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    ssize_t written;
+    do {
+        written = write(m_fd, line.data(), line.size());
+    } while (written < 0 && errno == EINTR);
+
+    if (written != static_cast<ssize_t>(line.size())) {
+        LOG_ERROR("Failed to write download progress: " + m_path);
+        return false;
+    }
+    return true;
+}
+
+size_t DownloadProgress::completedCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completed.size();
+}
+
+std::vector<std::string> readStudyList(std::istream& input) {
+    std::vector<std::string> studyUids;
+    std::set<std::string> seen;
+    std::string line;
+    while (std::getline(input, line)) {
+        std::string studyUid = Utils::trim(line);
+        if (studyUid.empty() || studyUid[0] == '#') {
+            continue;
+        }
+        if (seen.insert(studyUid).second) {
+            studyUids.push_back(studyUid);
+        }
+    }
+    return studyUids;
+}
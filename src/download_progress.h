@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <istream>
+
+// Append-only record of the studies a multi-study download has finished,
+// kept in the output directory so an interrupted run resumes where it stopped.
+class DownloadProgress {
+public:
+    explicit DownloadProgress(const std::string& path);
+    ~DownloadProgress();
+
+    DownloadProgress(const DownloadProgress&) = delete;
+    DownloadProgress& operator=(const DownloadProgress&) = delete;
+
+    bool isOpen() const;
+
+    // Whether an earlier run (or this one) finished the study
+    bool isComplete(const std::string& studyUid) const;
+
+    // Record a study whose files and metadata are all on disk
+    bool markComplete(const std::string& studyUid);
+
+    size_t completedCount() const;
+
+private:
+    bool load();
+
+    std::string m_path;
+    int m_fd;
+    std::set<std::string> m_completed;
+    mutable std::mutex m_mutex;
+};
+
+// Study UIDs from a list, one per line; blank lines, '#' comments and repeats are skipped
+std::vector<std::string> readStudyList(std::istream& input);
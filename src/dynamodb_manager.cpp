@@ -1,16 +1,237 @@
 #include "dynamodb_manager.h"
 #include "logger.h"
+#include "upload_journal.h"
+#include "profiler.h"
+#include "compression.h"
 
 #include <aws/dynamodb/model/PutItemRequest.h>
 #include <aws/dynamodb/model/GetItemRequest.h>
 #include <aws/dynamodb/model/QueryRequest.h>
 #include <aws/dynamodb/model/DescribeTableRequest.h>
 #include <aws/dynamodb/model/CreateTableRequest.h>
+#include <aws/dynamodb/model/BatchWriteItemRequest.h>
+#include <aws/dynamodb/model/UpdateTableRequest.h>
 #include <aws/dynamodb/model/UpdateItemRequest.h>
 
-DynamoDBManager::DynamoDBManager(const std::string& region) {
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <set>
+#include <thread>
+
+// Default thresholds for coalescing file-location writes
+const size_t DEFAULT_LOCATION_BATCH_SIZE = 100;
+const std::chrono::milliseconds DEFAULT_LOCATION_BATCH_AGE(2000);
+
+// Backoff used while waiting for a new table to become active
+const std::chrono::milliseconds TABLE_WAIT_INITIAL_DELAY(200);
+const std::chrono::milliseconds TABLE_WAIT_MAX_DELAY(5000);
+const std::chrono::seconds TABLE_WAIT_TIMEOUT(120);
+
+// Sort key of the per-instance table
+const char* const INSTANCE_SORT_KEY = "InstanceKey";
+
+// BatchWriteItem accepts at most 25 puts per call
+const size_t MAX_BATCH_WRITE_ITEMS = 25;
+const int MAX_BATCH_WRITE_ATTEMPTS = 8;
+const std::chrono::milliseconds BATCH_RETRY_INITIAL_DELAY(50);
+
+// Study items carry the generation of the upload that wrote them
+const char* const UPLOAD_GENERATION_ATTRIBUTE = "UploadGeneration";
+
+// Study lifecycle: items are written PENDING and flipped to COMMITTED, with
+// the instance count and checksum, once every instance item is confirmed.
+// Items from before the lifecycle have no status and count as committed.
+const char* const STUDY_STATUS_ATTRIBUTE = "StudyStatus";
+const char* const STUDY_STATUS_PENDING = "PENDING";
+const char* const STUDY_STATUS_COMMITTED = "COMMITTED";
+const char* const INSTANCE_COUNT_ATTRIBUTE = "InstanceCount";
+const char* const STUDY_CHECKSUM_ATTRIBUTE = "StudyChecksum";
+
+// A re-upload of a committed study parks its item here, with its generation,
+// so the committed item stays visible until markStudyCommitted promotes it
+const char* const PENDING_STUDY_ATTRIBUTE = "PendingStudy";
+const char* const PENDING_GENERATION_ATTRIBUTE = "PendingGeneration";
+
+// Lease items: current owner, expiry in epoch seconds, and completion flag
+const char* const LEASE_OWNER_ATTRIBUTE = "LeaseOwner";
+const char* const LEASE_EXPIRES_ATTRIBUTE = "LeaseExpires";
+const char* const LEASE_DONE_ATTRIBUTE = "Done";
+
+// zstd-compressed study attributes, and the attributes kept beside the blob
+// for the table key and the secondary indexes
+const char* const METADATA_BLOB_ATTRIBUTE = "MetadataBlob";
+const char* const PROJECTED_STUDY_ATTRIBUTES[] = {
+    "StudyInstanceUID", "PatientID", "AccessionNumber", "StudyDate"
+};
+
+// DynamoDB bills writes per started 1 KB and strongly consistent reads per started 4 KB
+const size_t WRITE_UNIT_BYTES = 1024;
+const size_t READ_UNIT_BYTES = 4096;
+
+// Capacity of provisioned tables and indexes created here
+const long long TABLE_READ_CAPACITY = 5;
+const long long TABLE_WRITE_CAPACITY = 5;
+
+// Throttled requests are retried on top of the SDK's own retries
+const int MAX_THROTTLE_ATTEMPTS = 6;
+const std::chrono::milliseconds THROTTLE_RETRY_INITIAL_DELAY(100);
+
+// Units taken from a bucket before a request reports what it consumed
+const double ITEM_READ_ESTIMATE = 0.5;
+const double ITEM_WRITE_ESTIMATE = 1.0;
+const double QUERY_PAGE_READ_ESTIMATE = 1.0;
+
+// Items requested in the first page of an instance listing
+const int FIRST_PAGE_LIMIT = 100;
+
+// Secondary indexes on the study table; StudyDate as a sort key lets a
+// patient's studies be narrowed to a date range
+struct StudyIndexSpec {
+    const char* name;
+    const char* hashKey;
+    const char* rangeKey;
+};
+
+const StudyIndexSpec STUDY_INDEXES[] = {
+    {"PatientID-index", "PatientID", "StudyDate"},
+    {"AccessionNumber-index", "AccessionNumber", ""},
+    {"StudyDate-index", "StudyDate", ""}
+};
+
+// Longest date range resolved through the StudyDate index, one Query per day
+const size_t MAX_QUERY_DAYS = 366;
+
+namespace {
+
+Aws::Vector<Aws::DynamoDB::Model::KeySchemaElement> studyIndexKeySchema(const StudyIndexSpec& spec) {
+    Aws::Vector<Aws::DynamoDB::Model::KeySchemaElement> keySchema;
+    
+    Aws::DynamoDB::Model::KeySchemaElement hashKey;
+    hashKey.SetAttributeName(spec.hashKey);
+    hashKey.SetKeyType(Aws::DynamoDB::Model::KeyType::HASH);
+    keySchema.push_back(hashKey);
+    
+    if (spec.rangeKey[0] != '\0') {
+        Aws::DynamoDB::Model::KeySchemaElement rangeKey;
+        rangeKey.SetAttributeName(spec.rangeKey);
+        rangeKey.SetKeyType(Aws::DynamoDB::Model::KeyType::RANGE);
+        keySchema.push_back(rangeKey);
+    }
+    return keySchema;
+}
+
+// Whether readers may see a study item
+bool isCommittedItem(const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item) {
+    auto it = item.find(STUDY_STATUS_ATTRIBUTE);
+    return it == item.end() || it->second.GetS() == STUDY_STATUS_COMMITTED;
+}
+
+// Study items are small, so indexes project every attribute and queries need no follow-up reads
+Aws::DynamoDB::Model::Projection studyIndexProjection() {
+    Aws::DynamoDB::Model::Projection projection;
+    projection.SetProjectionType(Aws::DynamoDB::Model::ProjectionType::ALL);
+    return projection;
+}
+
+Aws::DynamoDB::Model::ProvisionedThroughput tableThroughput() {
+    Aws::DynamoDB::Model::ProvisionedThroughput throughput;
+    throughput.SetReadCapacityUnits(TABLE_READ_CAPACITY);
+    throughput.SetWriteCapacityUnits(TABLE_WRITE_CAPACITY);
+    return throughput;
+}
+
+// Indexes on an on-demand table must not carry provisioned throughput
+Aws::DynamoDB::Model::GlobalSecondaryIndex buildStudyIndex(const StudyIndexSpec& spec, bool provisioned) {
+    Aws::DynamoDB::Model::GlobalSecondaryIndex index;
+    index.SetIndexName(spec.name);
+    index.SetKeySchema(studyIndexKeySchema(spec));
+    index.SetProjection(studyIndexProjection());
+    if (provisioned) {
+        index.SetProvisionedThroughput(tableThroughput());
+    }
+    return index;
+}
+
+Aws::Vector<Aws::DynamoDB::Model::AttributeDefinition> studyIndexAttributes() {
+    Aws::Vector<Aws::DynamoDB::Model::AttributeDefinition> attributes;
+    for (const char* name : {"PatientID", "AccessionNumber", "StudyDate"}) {
+        Aws::DynamoDB::Model::AttributeDefinition attribute;
+        attribute.SetAttributeName(name);
+        attribute.SetAttributeType(Aws::DynamoDB::Model::ScalarAttributeType::S);
+        attributes.push_back(attribute);
+    }
+    return attributes;
+}
+
+double consumedUnits(const Aws::DynamoDB::Model::ConsumedCapacity& consumed) {
+    return consumed.GetCapacityUnits();
+}
+
+double consumedUnits(const Aws::Vector<Aws::DynamoDB::Model::ConsumedCapacity>& consumed) {
+    double units = 0;
+    for (const auto& entry : consumed) {
+        units += entry.GetCapacityUnits();
+    }
+    return units;
+}
+
+bool isThrottleError(Aws::DynamoDB::DynamoDBErrors errorType) {
+    return errorType == Aws::DynamoDB::DynamoDBErrors::PROVISIONED_THROUGHPUT_EXCEEDED ||
+           errorType == Aws::DynamoDB::DynamoDBErrors::THROTTLING ||
+           errorType == Aws::DynamoDB::DynamoDBErrors::REQUEST_LIMIT_EXCEEDED;
+}
+
+// Billed size of an item: attribute names plus their values
+size_t itemSize(const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item) {
+    size_t size = 0;
+    for (const auto& [name, value] : item) {
+        size += name.size();
+        switch (value.GetType()) {
+            case Aws::DynamoDB::Model::ValueType::STRING:
+                size += value.GetS().size();
+                break;
+            case Aws::DynamoDB::Model::ValueType::NUMBER:
+                size += value.GetN().size();
+                break;
+            case Aws::DynamoDB::Model::ValueType::BYTEBUFFER:
+                size += value.GetB().GetLength();
+                break;
+            default:
+                break;
+        }
+    }
+    return size;
+}
+
+size_t capacityUnits(size_t bytes, size_t unitBytes) {
+    return std::max<size_t>(1, (bytes + unitBytes - 1) / unitBytes);
+}
+
+void reportThrottle(const std::string& tableName, const std::string& detail) {
+    Profiler::getInstance().incrementCounter("DynamoDB Throttles");
+    LOG_WARNING("DynamoDB throttled on table " + tableName + ": " + detail);
+}
+
+} // namespace
+
+DynamoDBManager::DynamoDBManager(const std::string& region, const std::string& endpoint)
+    : m_locationBatchSize(DEFAULT_LOCATION_BATCH_SIZE),
+      m_locationBatchAge(DEFAULT_LOCATION_BATCH_AGE),
+      m_journal(nullptr),
+      m_tableCacheTtl(0),
+      m_onDemandBilling(false),
+      m_readLimit(0),
+      m_writeLimit(0),
+      m_compressMetadata(false),
+      m_uploadGeneration(std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()) {
     Aws::Client::ClientConfiguration clientConfig;
     clientConfig.region = region;
+    if (!endpoint.empty()) {
+        clientConfig.endpointOverride = endpoint;
+        LOG_INFO("DynamoDB endpoint overridden: " + endpoint);
+    }
     
     // Use placement new to initialize the member directly
     new (&m_dynamoClient) Aws::DynamoDB::DynamoDBClient(clientConfig);
@@ -22,15 +243,99 @@ DynamoDBManager::~DynamoDBManager() {
     // No need to free resources as the AWS SDK handles it
 }
 
+void DynamoDBManager::setUploadGeneration(long long generation) {
+    m_uploadGeneration = generation;
+}
+
+long long DynamoDBManager::getUploadGeneration() const {
+    return m_uploadGeneration;
+}
+
+void DynamoDBManager::setCompressedMetadata(bool compress) {
+    if (compress && !Compression::isAvailable()) {
+        LOG_WARNING("Built without zstd; study metadata is stored uncompressed");
+        compress = false;
+    }
+    m_compressMetadata = compress;
+}
+
+void DynamoDBManager::setOnDemandBilling(bool onDemand) {
+    m_onDemandBilling = onDemand;
+}
+
+void DynamoDBManager::setCapacityLimits(double readUnitsPerSecond, double writeUnitsPerSecond) {
+    std::lock_guard<std::mutex> lock(m_limiterMutex);
+    m_readLimit = readUnitsPerSecond;
+    m_writeLimit = writeUnitsPerSecond;
+    for (auto& entry : m_limiters) {
+        if (m_readLimit > 0) {
+            entry.second->read.setRate(m_readLimit);
+        }
+        if (m_writeLimit > 0) {
+            entry.second->write.setRate(m_writeLimit);
+        }
+    }
+}
+
+void DynamoDBManager::applyTableCapacity(const std::string& tableName,
+                                         double readUnits, double writeUnits) {
+    std::lock_guard<std::mutex> lock(m_limiterMutex);
+    auto& limiters = m_limiters[tableName];
+    if (!limiters) {
+        limiters.reset(new TableLimiters());
+    }
+    limiters->read.setRate(m_readLimit > 0 ? m_readLimit : readUnits);
+    limiters->write.setRate(m_writeLimit > 0 ? m_writeLimit : writeUnits);
+}
+
+TokenBucket& DynamoDBManager::limiterFor(const std::string& tableName, CapacityKind kind) {
+    std::lock_guard<std::mutex> lock(m_limiterMutex);
+    auto& limiters = m_limiters[tableName];
+    if (!limiters) {
+        // Unpaced until DescribeTable reports the table's throughput
+        limiters.reset(new TableLimiters());
+        limiters->read.setRate(m_readLimit);
+        limiters->write.setRate(m_writeLimit);
+    }
+    return kind == CapacityKind::READ ? limiters->read : limiters->write;
+}
+
+template <typename Outcome>
+Outcome DynamoDBManager::callWithCapacity(const std::string& tableName, CapacityKind kind,
+                                          double estimatedUnits,
+                                          const std::function<Outcome()>& call) {
+    // Buckets are never erased, so the reference outlives the lock
+    TokenBucket& bucket = limiterFor(tableName, kind);
+    auto delay = THROTTLE_RETRY_INITIAL_DELAY;
+    
+    for (int attempt = 1; ; ++attempt) {
+        bucket.acquire(estimatedUnits);
+        Outcome outcome = call();
+        
+        if (outcome.IsSuccess()) {
+            bucket.settle(consumedUnits(outcome.GetResult().GetConsumedCapacity()) - estimatedUnits);
+            return outcome;
+        }
+        
+        const auto& error = outcome.GetError();
+        if (!isThrottleError(error.GetErrorType()) || attempt == MAX_THROTTLE_ATTEMPTS) {
+            return outcome;
+        }
+        
+        reportThrottle(tableName, error.GetExceptionName() + ", retrying in " +
+                       std::to_string(delay.count()) + "ms");
+        std::this_thread::sleep_for(delay);
+        delay *= 2;
+    }
+}
+
 bool DynamoDBManager::storeStudyMetadata(const std::string& tableName,
                                         const std::string& studyUid,
                                         const Json::Value& metadata) {
-    if (!tableExists(tableName)) {
-        LOG_WARNING("Table does not exist: " + tableName);
-        if (!createTableIfNotExists(tableName)) {
-            LOG_ERROR("Failed to create table: " + tableName);
-            return false;
-        }
+    // Resolved once per process (or per TTL) rather than per study
+    if (!createTableIfNotExists(tableName)) {
+        LOG_ERROR("Failed to create table: " + tableName);
+        return false;
     }
     
     // Ensure the studyUid is part of the metadata
@@ -39,24 +344,19 @@ bool DynamoDBManager::storeStudyMetadata(const std::string& tableName,
     
     auto attributeMap = jsonToAttributeMap(metadataWithId);
     
-    Aws::DynamoDB::Model::PutItemRequest putItemRequest;
-    putItemRequest.SetTableName(tableName);
-    putItemRequest.SetItem(attributeMap);
-    
-    LOG_INFO("Storing metadata in DynamoDB for study: " + studyUid);
-    
-    auto putItemOutcome = m_dynamoClient.PutItem(putItemRequest);
-    
-    if (putItemOutcome.IsSuccess()) {
-        LOG_INFO("Successfully stored metadata for study: " + studyUid);
-        return true;
-    } else {
-        auto error = putItemOutcome.GetError();
-        LOG_ERROR("Failed to store metadata in DynamoDB: " + 
-                 error.GetExceptionName() + " - " + 
-                 error.GetMessage());
-        return false;
+    // Index key attributes must be omitted rather than stored empty
+    for (const auto& index : STUDY_INDEXES) {
+        auto it = attributeMap.find(index.hashKey);
+        if (it != attributeMap.end() &&
+            it->second.GetType() == Aws::DynamoDB::Model::ValueType::STRING &&
+            it->second.GetS().empty()) {
+            attributeMap.erase(it);
+        }
     }
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item(attributeMap.begin(),
+                                                                      attributeMap.end());
+    return putStudyItem(tableName, studyUid, item);
 }
 
 bool DynamoDBManager::getStudyMetadata(const std::string& tableName,
@@ -73,13 +373,31 @@ bool DynamoDBManager::getStudyMetadata(const std::string& tableName,
     
     LOG_INFO("Retrieving metadata from DynamoDB for study: " + studyUid);
     
-    auto getItemOutcome = m_dynamoClient.GetItem(getItemRequest);
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        tableName, CapacityKind::READ, ITEM_READ_ESTIMATE,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
     
     if (getItemOutcome.IsSuccess()) {
         const auto& item = getItemOutcome.GetResult().GetItem();
         
-        if (!item.empty()) {
+        if (!item.empty() && !isCommittedItem(item)) {
+            LOG_WARNING("Study is still being uploaded and not yet committed: " + studyUid);
+            return false;
+        } else if (!item.empty()) {
             metadata = attributeMapToJson(item);
+            metadata.removeMember(UPLOAD_GENERATION_ATTRIBUTE);
+            metadata.removeMember(STUDY_STATUS_ATTRIBUTE);
+            metadata.removeMember(INSTANCE_COUNT_ATTRIBUTE);
+            metadata.removeMember(STUDY_CHECKSUM_ATTRIBUTE);
+            metadata.removeMember(PENDING_GENERATION_ATTRIBUTE);
+            metadata.removeMember(PENDING_STUDY_ATTRIBUTE);
+            if (item.count(METADATA_BLOB_ATTRIBUTE) > 0) {
+                Json::Value attributes = itemToStudy(item).toJson();
+                for (const auto& name : attributes.getMemberNames()) {
+                    metadata[name] = attributes[name];
+                }
+            }
             LOG_INFO("Successfully retrieved metadata for study: " + studyUid);
             return true;
         } else {
@@ -95,176 +413,1501 @@ bool DynamoDBManager::getStudyMetadata(const std::string& tableName,
     }
 }
 
-bool DynamoDBManager::storeFileLocation(const std::string& tableName,
-                                      const std::string& studyUid,
-                                      const std::string& s3Key) {
-    Aws::DynamoDB::Model::UpdateItemRequest updateItemRequest;
+bool DynamoDBManager::storeStudyRecord(const std::string& tableName,
+                                     const StudyRecord& record) {
+    if (!createTableIfNotExists(tableName)) {
+        LOG_ERROR("Failed to create table: " + tableName);
+        return false;
+    }
+    
+    if (!m_compressMetadata) {
+        return putStudyItem(tableName, record.studyInstanceUid, studyToItem(record));
+    }
+    
+    std::string blob;
+    if (!Compression::compress(record.packAttributes(), blob)) {
+        LOG_WARNING("Storing uncompressed metadata for study: " + record.studyInstanceUid);
+        return putStudyItem(tableName, record.studyInstanceUid, studyToItem(record));
+    }
+    
+    auto item = compressedStudyItem(record, blob);
+    
+    // Compare against storing every attribute as its own string attribute
+    auto expanded = studyToItem(record);
+    for (const auto& [name, value] : record.extendedAttributes) {
+        expanded[name].SetS(value);
+    }
+    size_t expandedSize = itemSize(expanded);
+    size_t compressedSize = itemSize(item);
+    
+    auto& profiler = Profiler::getInstance();
+    profiler.incrementCounter("Metadata WCU (attributes)", capacityUnits(expandedSize, WRITE_UNIT_BYTES));
+    profiler.incrementCounter("Metadata WCU (compressed)", capacityUnits(compressedSize, WRITE_UNIT_BYTES));
+    profiler.incrementCounter("Metadata RCU (attributes)", capacityUnits(expandedSize, READ_UNIT_BYTES));
+    profiler.incrementCounter("Metadata RCU (compressed)", capacityUnits(compressedSize, READ_UNIT_BYTES));
+    LOG_DEBUG("Study " + record.studyInstanceUid + " item: " + std::to_string(expandedSize) +
+              " bytes as attributes, " + std::to_string(compressedSize) + " bytes compressed");
+    
+    return putStudyItem(tableName, record.studyInstanceUid, item);
+}
+
+bool DynamoDBManager::putStudyItem(const std::string& tableName,
+                                 const std::string& studyUid,
+                                 Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item) {
+    item[UPLOAD_GENERATION_ATTRIBUTE].SetN(std::to_string(m_uploadGeneration));
+    
+    // Hidden from readers until markStudyCommitted
+    item[STUDY_STATUS_ATTRIBUTE].SetS(STUDY_STATUS_PENDING);
+    
+    // Only a new study, or a pending item of this or an older generation, is
+    // replaced outright; a committed one keeps serving readers and the new item
+    // is staged beside it. The item is built from the source files alone, so a
+    // retried put rewrites identical content.
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":gen"].SetN(std::to_string(m_uploadGeneration));
+    values[":pending"].SetS(STUDY_STATUS_PENDING);
+    
+    Aws::DynamoDB::Model::PutItemRequest putItemRequest;
+    putItemRequest.SetTableName(tableName);
+    putItemRequest.SetItem(item);
+    putItemRequest.SetConditionExpression(
+        "attribute_not_exists(#uid) OR (#status = :pending AND #gen <= :gen)");
+    putItemRequest.SetExpressionAttributeNames({
+        {"#uid", "StudyInstanceUID"},
+        {"#status", STUDY_STATUS_ATTRIBUTE},
+        {"#gen", UPLOAD_GENERATION_ATTRIBUTE}
+    });
+    putItemRequest.SetExpressionAttributeValues(values);
+    
+    LOG_INFO("Storing metadata in DynamoDB for study: " + studyUid);
+    
+    putItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    auto putItemOutcome = callWithCapacity<Aws::DynamoDB::Model::PutItemOutcome>(
+        tableName, CapacityKind::WRITE, ITEM_WRITE_ESTIMATE,
+        [&]() { return m_dynamoClient.PutItem(putItemRequest); });
+    
+    if (putItemOutcome.IsSuccess()) {
+        LOG_INFO("Successfully stored metadata for study: " + studyUid);
+        return true;
+    } else if (putItemOutcome.GetError().GetErrorType() ==
+               Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED) {
+        // Committed, or pending from a newer upload
+        return stagePendingStudy(tableName, studyUid, item);
+    } else {
+        auto error = putItemOutcome.GetError();
+        if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND) {
+            invalidateTableCache(tableName);
+        }
+        LOG_ERROR("Failed to store metadata in DynamoDB: " + 
+                 error.GetExceptionName() + " - " + 
+                 error.GetMessage());
+        return false;
+    }
+}
+
+bool DynamoDBManager::stagePendingStudy(const std::string& tableName,
+                                       const std::string& studyUid,
+                                       const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item) {
+    Aws::DynamoDB::Model::AttributeValue pending;
+    for (const auto& [name, value] : item) {
+        pending.AddMEntry(name, Aws::MakeShared<Aws::DynamoDB::Model::AttributeValue>("DynamoDB", value));
+    }
     
-    // Set up key with the study UID
     Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
     key["StudyInstanceUID"].SetS(studyUid);
     
-    // Create expression to add to the file locations list
-    Aws::String updateExpression = "ADD FileLocations :s3key";
-    
-    // Set up expression attribute values
-    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> expressionAttributeValues;
-    Aws::DynamoDB::Model::AttributeValue s3KeyValue;
-    Aws::Vector<Aws::String> stringSet;
-    stringSet.push_back(s3Key.c_str());
-    s3KeyValue.SetSS(stringSet);
-    expressionAttributeValues[":s3key"] = s3KeyValue;
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":item"] = pending;
+    values[":gen"].SetN(std::to_string(m_uploadGeneration));
+    values[":committed"].SetS(STUDY_STATUS_COMMITTED);
     
+    // Staged only over a committed item no newer than this generation, and
+    // replacing only an older staged item (e.g. from an upload that died)
+    Aws::DynamoDB::Model::UpdateItemRequest updateItemRequest;
     updateItemRequest.SetTableName(tableName);
     updateItemRequest.SetKey(key);
-    updateItemRequest.SetUpdateExpression(updateExpression);
-    updateItemRequest.SetExpressionAttributeValues(expressionAttributeValues);
-    
-    LOG_INFO("Storing file location in DynamoDB for study: " + studyUid + ", S3 key: " + s3Key);
+    updateItemRequest.SetUpdateExpression("SET #pendingItem = :item, #pendingGen = :gen");
+    updateItemRequest.SetConditionExpression(
+        "attribute_exists(#uid) AND "
+        "(attribute_not_exists(#status) OR #status = :committed) AND "
+        "(attribute_not_exists(#gen) OR #gen <= :gen) AND "
+        "(attribute_not_exists(#pendingGen) OR #pendingGen <= :gen)");
+    updateItemRequest.SetExpressionAttributeNames({
+        {"#uid", "StudyInstanceUID"},
+        {"#status", STUDY_STATUS_ATTRIBUTE},
+        {"#gen", UPLOAD_GENERATION_ATTRIBUTE},
+        {"#pendingItem", PENDING_STUDY_ATTRIBUTE},
+        {"#pendingGen", PENDING_GENERATION_ATTRIBUTE}
+    });
+    updateItemRequest.SetExpressionAttributeValues(values);
+    updateItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
     
-    auto updateItemOutcome = m_dynamoClient.UpdateItem(updateItemRequest);
+    auto updateItemOutcome = callWithCapacity<Aws::DynamoDB::Model::UpdateItemOutcome>(
+        tableName, CapacityKind::WRITE, ITEM_WRITE_ESTIMATE,
+        [&]() { return m_dynamoClient.UpdateItem(updateItemRequest); });
     
     if (updateItemOutcome.IsSuccess()) {
-        LOG_INFO("Successfully stored file location for study: " + studyUid);
+        LOG_INFO("Staged metadata for committed study " + studyUid + " until this upload commits");
+        return true;
+    } else if (updateItemOutcome.GetError().GetErrorType() ==
+               Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED) {
+        // A newer upload already stored this study; its metadata stands
+        Profiler::getInstance().incrementCounter("DynamoDB Superseded Writes");
+        LOG_INFO("Skipped metadata for study " + studyUid + ": a newer upload generation is stored");
         return true;
     } else {
         auto error = updateItemOutcome.GetError();
-        LOG_ERROR("Failed to store file location in DynamoDB: " + 
+        LOG_ERROR("Failed to stage metadata in DynamoDB: " + 
                  error.GetExceptionName() + " - " + 
                  error.GetMessage());
         return false;
     }
 }
 
-std::vector<std::string> DynamoDBManager::getFileLocations(const std::string& tableName,
-                                                         const std::string& studyUid) {
-    std::vector<std::string> fileLocations;
-    
-    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+bool DynamoDBManager::markStudyCommitted(const std::string& tableName,
+                                       const std::string& studyUid) {
+    // Counted from the table itself, so earlier rounds of the study are included
+    std::vector<InstanceRecord> instances;
+    if (!getInstances(tableName, studyUid, instances)) {
+        LOG_ERROR("Refusing to commit study from an incomplete listing: " + studyUid);
+        return false;
+    }
+    if (instances.empty()) {
+        LOG_ERROR("Refusing to commit study without instances: " + studyUid);
+        return false;
+    }
     
-    // Set up key with the study UID
     Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
     key["StudyInstanceUID"].SetS(studyUid);
     
-    getItemRequest.SetTableName(tableName);
-    getItemRequest.SetKey(key);
-    getItemRequest.AddAttributesToGet("FileLocations");
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":committed"].SetS(STUDY_STATUS_COMMITTED);
+    values[":count"].SetN(std::to_string(instances.size()));
+    values[":checksum"].SetS(instancesChecksum(instances));
+    values[":gen"].SetN(std::to_string(m_uploadGeneration));
     
-    LOG_INFO("Retrieving file locations from DynamoDB for study: " + studyUid);
+    // Only this generation's item is committed; a newer upload commits its own.
+    // An item with a staged copy is committed by promoting the copy instead.
+    Aws::DynamoDB::Model::UpdateItemRequest updateItemRequest;
+    updateItemRequest.SetTableName(tableName);
+    updateItemRequest.SetKey(key);
+    updateItemRequest.SetUpdateExpression("SET #status = :committed, #count = :count, #checksum = :checksum");
+    updateItemRequest.SetConditionExpression("#gen = :gen AND attribute_not_exists(#pendingGen)");
+    updateItemRequest.SetExpressionAttributeNames({
+        {"#status", STUDY_STATUS_ATTRIBUTE},
+        {"#count", INSTANCE_COUNT_ATTRIBUTE},
+        {"#checksum", STUDY_CHECKSUM_ATTRIBUTE},
+        {"#gen", UPLOAD_GENERATION_ATTRIBUTE},
+        {"#pendingGen", PENDING_GENERATION_ATTRIBUTE}
+    });
+    updateItemRequest.SetExpressionAttributeValues(values);
+    updateItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
     
-    auto getItemOutcome = m_dynamoClient.GetItem(getItemRequest);
+    auto updateItemOutcome = callWithCapacity<Aws::DynamoDB::Model::UpdateItemOutcome>(
+        tableName, CapacityKind::WRITE, ITEM_WRITE_ESTIMATE,
+        [&]() { return m_dynamoClient.UpdateItem(updateItemRequest); });
     
-    if (getItemOutcome.IsSuccess()) {
-        const auto& item = getItemOutcome.GetResult().GetItem();
-        
-        if (!item.empty() && item.count("FileLocations") > 0) {
-            const auto& locations = item.at("FileLocations").GetSS();
-            for (const auto& location : locations) {
-                fileLocations.push_back(location);
-            }
-            LOG_INFO("Retrieved " + std::to_string(fileLocations.size()) + 
-                    " file locations for study: " + studyUid);
-        } else {
-            LOG_WARNING("No file locations found for study: " + studyUid);
-        }
+    if (updateItemOutcome.IsSuccess()) {
+        LOG_INFO("Committed study " + studyUid + " with " + std::to_string(instances.size()) +
+                 " instances");
+        return true;
+    } else if (updateItemOutcome.GetError().GetErrorType() ==
+               Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED) {
+        return promoteStagedStudy(tableName, studyUid, instances.size(), instancesChecksum(instances));
     } else {
-        auto error = getItemOutcome.GetError();
-        LOG_ERROR("Failed to retrieve file locations from DynamoDB: " + 
+        auto error = updateItemOutcome.GetError();
+        LOG_ERROR("Failed to commit study in DynamoDB: " + 
                  error.GetExceptionName() + " - " + 
                  error.GetMessage());
+        return false;
     }
-    
-    return fileLocations;
 }
 
-bool DynamoDBManager::tableExists(const std::string& tableName) {
-    Aws::DynamoDB::Model::DescribeTableRequest describeTableRequest;
-    describeTableRequest.SetTableName(tableName);
+bool DynamoDBManager::promoteStagedStudy(const std::string& tableName,
+                                       const std::string& studyUid,
+                                       size_t instanceCount,
+                                       const std::string& checksum) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
     
-    auto describeTableOutcome = m_dynamoClient.DescribeTable(describeTableRequest);
+    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+    getItemRequest.SetTableName(tableName);
+    getItemRequest.SetKey(key);
+    getItemRequest.SetProjectionExpression("#pendingItem, #pendingGen");
+    getItemRequest.SetExpressionAttributeNames({
+        {"#pendingItem", PENDING_STUDY_ATTRIBUTE},
+        {"#pendingGen", PENDING_GENERATION_ATTRIBUTE}
+    });
+    getItemRequest.SetConsistentRead(true);
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
     
-    return describeTableOutcome.IsSuccess();
-}
-
-bool DynamoDBManager::createTableIfNotExists(const std::string& tableName) {
-    if (tableExists(tableName)) {
-        return true;
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        tableName, CapacityKind::READ, ITEM_READ_ESTIMATE,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
+    if (!getItemOutcome.IsSuccess()) {
+        auto error = getItemOutcome.GetError();
+        LOG_ERROR("Failed to read staged metadata from DynamoDB: " + 
+                 error.GetExceptionName() + " - " + 
+                 error.GetMessage());
+        return false;
     }
     
-    LOG_INFO("Creating DynamoDB table: " + tableName);
-    
-    Aws::DynamoDB::Model::CreateTableRequest createTableRequest;
-    createTableRequest.SetTableName(tableName);
-    
-    // Define attribute definitions
-    Aws::Vector<Aws::DynamoDB::Model::AttributeDefinition> attributeDefinitions;
-    Aws::DynamoDB::Model::AttributeDefinition studyUidAttribute;
-    studyUidAttribute.SetAttributeName("StudyInstanceUID");
-    studyUidAttribute.SetAttributeType(Aws::DynamoDB::Model::ScalarAttributeType::S);
-    attributeDefinitions.push_back(studyUidAttribute);
-    
-    createTableRequest.SetAttributeDefinitions(attributeDefinitions);
+    const std::string generation = std::to_string(m_uploadGeneration);
+    const auto& stored = getItemOutcome.GetResult().GetItem();
+    auto stagedGeneration = stored.find(PENDING_GENERATION_ATTRIBUTE);
+    auto staged = stored.find(PENDING_STUDY_ATTRIBUTE);
+    if (stagedGeneration == stored.end() || staged == stored.end() ||
+        stagedGeneration->second.GetN() != generation) {
+        Profiler::getInstance().incrementCounter("DynamoDB Superseded Writes");
+        LOG_INFO("Skipped commit of study " + studyUid + ": a newer upload generation is stored");
+        return true;
+    }
     
-    // Define key schema
-    Aws::Vector<Aws::DynamoDB::Model::KeySchemaElement> keySchema;
-    Aws::DynamoDB::Model::KeySchemaElement studyUidKeyElement;
-    studyUidKeyElement.SetAttributeName("StudyInstanceUID");
-    studyUidKeyElement.SetKeyType(Aws::DynamoDB::Model::KeyType::HASH);
-    keySchema.push_back(studyUidKeyElement);
+    // The staged item replaces the committed one whole, dropping the staged attributes
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item;
+    for (const auto& [name, value] : staged->second.GetM()) {
+        item[name] = *value;
+    }
+    item[STUDY_STATUS_ATTRIBUTE].SetS(STUDY_STATUS_COMMITTED);
+    item[INSTANCE_COUNT_ATTRIBUTE].SetN(std::to_string(instanceCount));
+    item[STUDY_CHECKSUM_ATTRIBUTE].SetS(checksum);
     
-    createTableRequest.SetKeySchema(keySchema);
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":gen"].SetN(generation);
     
-    // Set provisioned throughput
-    Aws::DynamoDB::Model::ProvisionedThroughput provisionedThroughput;
-    provisionedThroughput.SetReadCapacityUnits(5);
-    provisionedThroughput.SetWriteCapacityUnits(5);
-    createTableRequest.SetProvisionedThroughput(provisionedThroughput);
+    Aws::DynamoDB::Model::PutItemRequest putItemRequest;
+    putItemRequest.SetTableName(tableName);
+    putItemRequest.SetItem(item);
+    putItemRequest.SetConditionExpression("#pendingGen = :gen");
+    putItemRequest.SetExpressionAttributeNames({{"#pendingGen", PENDING_GENERATION_ATTRIBUTE}});
+    putItemRequest.SetExpressionAttributeValues(values);
+    putItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
     
-    auto createTableOutcome = m_dynamoClient.CreateTable(createTableRequest);
+    auto putItemOutcome = callWithCapacity<Aws::DynamoDB::Model::PutItemOutcome>(
+        tableName, CapacityKind::WRITE, ITEM_WRITE_ESTIMATE,
+        [&]() { return m_dynamoClient.PutItem(putItemRequest); });
     
-    if (createTableOutcome.IsSuccess()) {
-        LOG_INFO("Successfully created DynamoDB table: " + tableName);
-        
-        // Wait for the table to become active
-        bool tableActive = false;
-        int attempts = 0;
-        const int maxAttempts = 30; // Wait up to 30 seconds
-        
-        while (!tableActive && attempts < maxAttempts) {
-            Aws::DynamoDB::Model::DescribeTableRequest describeTableRequest;
-            describeTableRequest.SetTableName(tableName);
-            
-            auto describeTableOutcome = m_dynamoClient.DescribeTable(describeTableRequest);
-            
-            if (describeTableOutcome.IsSuccess()) {
-                auto status = describeTableOutcome.GetResult().GetTable().GetTableStatus();
-                if (status == Aws::DynamoDB::Model::TableStatus::ACTIVE) {
-                    tableActive = true;
-                }
-            }
-            
-            if (!tableActive) {
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                attempts++;
-            }
-        }
-        
-        if (tableActive) {
-            LOG_INFO("DynamoDB table is now active: " + tableName);
-            return true;
-        } else {
-            LOG_ERROR("Timed out waiting for DynamoDB table to become active: " + tableName);
-            return false;
-        }
+    if (putItemOutcome.IsSuccess()) {
+        LOG_INFO("Committed study " + studyUid + " with " + std::to_string(instanceCount) +
+                 " instances, replacing its previous upload");
+        return true;
+    } else if (putItemOutcome.GetError().GetErrorType() ==
+               Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED) {
+        Profiler::getInstance().incrementCounter("DynamoDB Superseded Writes");
+        LOG_INFO("Skipped commit of study " + studyUid + ": a newer upload generation is stored");
+        return true;
     } else {
-        auto error = createTableOutcome.GetError();
-        LOG_ERROR("Failed to create DynamoDB table: " + 
+        auto error = putItemOutcome.GetError();
+        LOG_ERROR("Failed to commit study in DynamoDB: " + 
                  error.GetExceptionName() + " - " + 
                  error.GetMessage());
         return false;
     }
 }
 
+bool DynamoDBManager::getCommittedChecksum(const std::string& tableName,
+                                         const std::string& studyUid,
+                                         std::string& checksum) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
+    
+    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+    getItemRequest.SetTableName(tableName);
+    getItemRequest.SetKey(key);
+    getItemRequest.SetProjectionExpression("#uid, #status, #checksum");
+    getItemRequest.SetExpressionAttributeNames({
+        {"#uid", "StudyInstanceUID"},
+        {"#status", STUDY_STATUS_ATTRIBUTE},
+        {"#checksum", STUDY_CHECKSUM_ATTRIBUTE}
+    });
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        tableName, CapacityKind::READ, ITEM_READ_ESTIMATE,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
+    if (!getItemOutcome.IsSuccess()) {
+        auto error = getItemOutcome.GetError();
+        LOG_ERROR("Failed to read study status from DynamoDB: " + 
+                 error.GetExceptionName() + " - " + 
+                 error.GetMessage());
+        return false;
+    }
+    
+    const auto& item = getItemOutcome.GetResult().GetItem();
+    if (item.empty() || !isCommittedItem(item)) {
+        return false;
+    }
+    auto it = item.find(STUDY_CHECKSUM_ATTRIBUTE);
+    checksum = it == item.end() ? "" : it->second.GetS();
+    return true;
+}
+
+bool DynamoDBManager::getStudyRecord(const std::string& tableName,
+                                   const std::string& studyUid,
+                                   StudyRecord& record) {
+    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
+    
+    getItemRequest.SetTableName(tableName);
+    getItemRequest.SetKey(key);
+    
+    // Project just the record's fields (and any compressed blob) so a legacy
+    // FileLocations set isn't transferred
+    std::string projection;
+    Aws::Map<Aws::String, Aws::String> attributeNames;
+    for (size_t i = 0; i < StudyRecord::fields().size(); ++i) {
+        std::string placeholder = "#f" + std::to_string(i);
+        attributeNames[placeholder] = StudyRecord::fields()[i].name;
+        projection += (projection.empty() ? "" : ",") + placeholder;
+    }
+    attributeNames["#blob"] = METADATA_BLOB_ATTRIBUTE;
+    attributeNames["#status"] = STUDY_STATUS_ATTRIBUTE;
+    projection += ",#blob,#status";
+    getItemRequest.SetProjectionExpression(projection);
+    getItemRequest.SetExpressionAttributeNames(attributeNames);
+    
+    LOG_INFO("Retrieving metadata from DynamoDB for study: " + studyUid);
+    
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        tableName, CapacityKind::READ, ITEM_READ_ESTIMATE,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
+    
+    if (!getItemOutcome.IsSuccess()) {
+        auto error = getItemOutcome.GetError();
+        LOG_ERROR("Failed to retrieve metadata from DynamoDB: " + 
+                 error.GetExceptionName() + " - " + 
+                 error.GetMessage());
+        return false;
+    }
+    
+    const auto& item = getItemOutcome.GetResult().GetItem();
+    if (item.empty()) {
+        LOG_WARNING("No metadata found for study: " + studyUid);
+        return false;
+    }
+    if (!isCommittedItem(item)) {
+        LOG_WARNING("Study is still being uploaded and not yet committed: " + studyUid);
+        return false;
+    }
+    
+    record = itemToStudy(item);
+    LOG_INFO("Successfully retrieved metadata for study: " + studyUid);
+    return true;
+}
+
+bool DynamoDBManager::storeFileLocation(const std::string& tableName,
+                                      const std::string& studyUid,
+                                      const std::string& s3Key) {
+    InstanceRecord instance;
+    instance.studyUid = studyUid;
+    instance.s3Key = s3Key;
+    
+    LOG_INFO("Storing file location in DynamoDB for study: " + studyUid + ", S3 key: " + s3Key);
+    return storeInstance(tableName, instance);
+}
+
+bool DynamoDBManager::storeInstance(const std::string& tableName,
+                                  const InstanceRecord& instance) {
+    return writeInstances(tableName, {instance});
+}
+
+std::string DynamoDBManager::instanceTableName(const std::string& tableName) {
+    return tableName + "-instances";
+}
+
+bool DynamoDBManager::writeInstances(const std::string& tableName,
+                                   const std::vector<InstanceRecord>& instances) {
+    const std::string instanceTable = instanceTableName(tableName);
+    if (!ensureTable(instanceTable, INSTANCE_SORT_KEY, false)) {
+        LOG_ERROR("Failed to create table: " + instanceTable);
+        return false;
+    }
+    
+    for (size_t begin = 0; begin < instances.size(); begin += MAX_BATCH_WRITE_ITEMS) {
+        size_t end = std::min(begin + MAX_BATCH_WRITE_ITEMS, instances.size());
+        
+        Aws::Vector<Aws::DynamoDB::Model::WriteRequest> writeRequests;
+        for (size_t i = begin; i < end; ++i) {
+            Aws::DynamoDB::Model::PutRequest putRequest;
+            putRequest.SetItem(instanceToItem(instances[i]));
+            Aws::DynamoDB::Model::WriteRequest writeRequest;
+            writeRequest.SetPutRequest(putRequest);
+            writeRequests.push_back(writeRequest);
+        }
+        
+        Aws::Map<Aws::String, Aws::Vector<Aws::DynamoDB::Model::WriteRequest>> requestItems;
+        requestItems[instanceTable] = writeRequests;
+        
+        // Retry whatever DynamoDB leaves unprocessed, backing off between attempts
+        auto delay = BATCH_RETRY_INITIAL_DELAY;
+        for (int attempt = 0; !requestItems.empty(); ++attempt) {
+            if (attempt == MAX_BATCH_WRITE_ATTEMPTS) {
+                LOG_ERROR("Gave up on unprocessed instance writes for study: " + instances[begin].studyUid);
+                return false;
+            }
+            if (attempt > 0) {
+                std::this_thread::sleep_for(delay);
+                delay *= 2;
+            }
+            
+            Aws::DynamoDB::Model::BatchWriteItemRequest batchWriteRequest;
+            batchWriteRequest.SetRequestItems(requestItems);
+            batchWriteRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+            
+            // Each small put costs one write unit
+            double estimatedUnits = static_cast<double>(requestItems[instanceTable].size());
+            auto batchWriteOutcome = callWithCapacity<Aws::DynamoDB::Model::BatchWriteItemOutcome>(
+                instanceTable, CapacityKind::WRITE, estimatedUnits,
+                [&]() { return m_dynamoClient.BatchWriteItem(batchWriteRequest); });
+            
+            if (!batchWriteOutcome.IsSuccess()) {
+                auto error = batchWriteOutcome.GetError();
+                if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND) {
+                    invalidateTableCache(instanceTable);
+                }
+                LOG_ERROR("Failed to store instances in DynamoDB: " + 
+                         error.GetExceptionName() + " - " + 
+                         error.GetMessage());
+                return false;
+            }
+            
+            requestItems = batchWriteOutcome.GetResult().GetUnprocessedItems();
+            if (!requestItems.empty()) {
+                // Unprocessed items are how BatchWriteItem reports throttling
+                reportThrottle(instanceTable, std::to_string(requestItems[instanceTable].size()) +
+                               " unprocessed item(s)");
+            }
+        }
+    }
+    
+    LOG_INFO("Successfully stored " + std::to_string(instances.size()) + 
+             " instance(s) in table: " + instanceTable);
+    return true;
+}
+
+bool DynamoDBManager::queueFileLocation(const std::string& tableName,
+                                      const std::string& studyUid,
+                                      const std::string& s3Key) {
+    InstanceRecord instance;
+    instance.studyUid = studyUid;
+    instance.s3Key = s3Key;
+    return queueInstance(tableName, instance);
+}
+
+bool DynamoDBManager::queueInstance(const std::string& tableName,
+                                  const InstanceRecord& instance) {
+    // Journal first so an uploaded object is never only in memory
+    if (m_journal && !m_journal->recordPending(instance)) {
+        LOG_WARNING("Failed to journal file location: " + instance.s3Key);
+    }
+    
+    bool flushNow = false;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        auto now = std::chrono::steady_clock::now();
+        auto& pending = m_pendingLocations[{tableName, instance.studyUid}];
+        if (pending.instances.empty()) {
+            pending.firstQueued = now;
+        }
+        pending.instances.push_back(instance);
+        
+        flushNow = pending.instances.size() >= m_locationBatchSize ||
+                   now - pending.firstQueued >= m_locationBatchAge;
+    }
+    
+    if (flushNow && !flushFileLocations(tableName, instance.studyUid)) {
+        // Instances stay buffered; the study-end flush retries them
+        LOG_WARNING("Deferred file location flush for study: " + instance.studyUid);
+    }
+    return true;
+}
+
+bool DynamoDBManager::flushFileLocations(const std::string& tableName,
+                                       const std::string& studyUid) {
+    const auto studyKey = std::make_pair(tableName, studyUid);
+    std::vector<InstanceRecord> instances;
+    {
+        // One flush per study at a time: a caller that finds one in flight (e.g.
+        // the aged-flush timer) waits for it, and then retries anything it requeued,
+        // so returning true means every instance queued so far is written
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        m_flushFinished.wait(lock, [&] { return m_flushing.count(studyKey) == 0; });
+        auto it = m_pendingLocations.find(studyKey);
+        if (it == m_pendingLocations.end()) {
+            return true;
+        }
+        instances.swap(it->second.instances);
+        m_pendingLocations.erase(it);
+        if (instances.empty()) {
+            return true;
+        }
+        m_flushing.insert(studyKey);
+    }
+    
+    bool written = writeFileLocations(tableName, studyUid, instances);
+    
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_flushing.erase(studyKey);
+    }
+    m_flushFinished.notify_all();
+    return written;
+}
+
+bool DynamoDBManager::writeFileLocations(const std::string& tableName,
+                                       const std::string& studyUid,
+                                       const std::vector<InstanceRecord>& instances) {
+    // Make the pending records durable before relying on them for recovery
+    if (m_journal) {
+        m_journal->sync();
+    }
+    
+    LOG_INFO("Flushing " + std::to_string(instances.size()) + 
+             " file locations to DynamoDB for study: " + studyUid);
+    
+    for (size_t begin = 0; begin < instances.size(); begin += MAX_BATCH_WRITE_ITEMS) {
+        size_t end = std::min(begin + MAX_BATCH_WRITE_ITEMS, instances.size());
+        std::vector<InstanceRecord> batch(instances.begin() + begin, instances.begin() + end);
+        
+        if (!writeInstances(tableName, batch)) {
+            requeueFileLocations(tableName, studyUid,
+                                 std::vector<InstanceRecord>(instances.begin() + begin, instances.end()));
+            return false;
+        }
+        
+        if (m_journal) {
+            std::vector<std::string> keys;
+            for (const auto& instance : batch) {
+                keys.push_back(instance.s3Key);
+            }
+            m_journal->recordFlushed(studyUid, keys);
+        }
+    }
+    
+    return true;
+}
+
+bool DynamoDBManager::flushAllFileLocations() {
+    std::vector<std::pair<std::string, std::string>> studies;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        for (const auto& entry : m_pendingLocations) {
+            studies.push_back(entry.first);
+        }
+    }
+    
+    bool success = true;
+    for (const auto& [tableName, studyUid] : studies) {
+        success &= flushFileLocations(tableName, studyUid);
+    }
+    return success;
+}
+
+bool DynamoDBManager::flushAgedFileLocations() {
+    std::vector<std::pair<std::string, std::string>> studies;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        auto now = std::chrono::steady_clock::now();
+        for (const auto& entry : m_pendingLocations) {
+            if (!entry.second.instances.empty() &&
+                now - entry.second.firstQueued >= m_locationBatchAge) {
+                studies.push_back(entry.first);
+            }
+        }
+    }
+    
+    bool success = true;
+    for (const auto& [tableName, studyUid] : studies) {
+        success &= flushFileLocations(tableName, studyUid);
+    }
+    return success;
+}
+
+void DynamoDBManager::requeueFileLocations(const std::string& tableName,
+                                         const std::string& studyUid,
+                                         const std::vector<InstanceRecord>& instances) {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    auto& pending = m_pendingLocations[{tableName, studyUid}];
+    if (pending.instances.empty()) {
+        pending.firstQueued = std::chrono::steady_clock::now();
+    }
+    pending.instances.insert(pending.instances.begin(), instances.begin(), instances.end());
+}
+
+void DynamoDBManager::setFileLocationBatching(size_t maxKeys, std::chrono::milliseconds maxAge) {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    m_locationBatchSize = std::max<size_t>(maxKeys, 1);
+    m_locationBatchAge = maxAge;
+}
+
+void DynamoDBManager::setUploadJournal(UploadJournal* journal) {
+    m_journal = journal;
+}
+
+std::vector<std::string> DynamoDBManager::getFileLocations(const std::string& tableName,
+                                                         const std::string& studyUid) {
+    std::vector<std::string> fileLocations;
+    std::vector<InstanceRecord> instances;
+    getInstances(tableName, studyUid, instances);
+    for (const auto& instance : instances) {
+        fileLocations.push_back(instance.s3Key);
+    }
+    return fileLocations;
+}
+
+bool DynamoDBManager::getInstances(const std::string& tableName,
+                                 const std::string& studyUid,
+                                 std::vector<InstanceRecord>& instances) {
+    instances.clear();
+    bool listed = streamInstances(tableName, studyUid, [&instances](const std::vector<InstanceRecord>& page) {
+        instances.insert(instances.end(), page.begin(), page.end());
+        return true;
+    });
+    
+    sortInstances(instances);
+    return listed;
+}
+
+bool DynamoDBManager::streamInstances(const std::string& tableName,
+                                    const std::string& studyUid,
+                                    const InstancePageCallback& onPage) {
+    LOG_INFO("Retrieving file locations from DynamoDB for study: " + studyUid);
+    
+    // Studies written before the instance table still list their keys in the
+    // FileLocations set; read that concurrently with the instance Query
+    std::vector<std::string> legacyKeys;
+    auto legacyLocations = std::async(std::launch::async, [this, &tableName, &studyUid, &legacyKeys]() {
+        return getLegacyFileLocations(tableName, studyUid, legacyKeys);
+    });
+    
+    std::set<std::string> knownKeys;
+    size_t total = 0;
+    bool stopped = false;
+    
+    bool success = queryInstances(tableName, studyUid,
+        [&](const std::vector<InstanceRecord>& page) {
+            for (const auto& instance : page) {
+                knownKeys.insert(instance.s3Key);
+            }
+            total += page.size();
+            stopped = !onPage(page);
+            return !stopped;
+        });
+    
+    success &= legacyLocations.get();
+    if (stopped) {
+        return false;
+    }
+    
+    std::vector<InstanceRecord> legacyPage;
+    for (const auto& s3Key : legacyKeys) {
+        if (knownKeys.insert(s3Key).second) {
+            InstanceRecord instance;
+            instance.studyUid = studyUid;
+            instance.s3Key = s3Key;
+            legacyPage.push_back(instance);
+        }
+    }
+    if (!legacyPage.empty()) {
+        total += legacyPage.size();
+        if (!onPage(legacyPage)) {
+            return false;
+        }
+    }
+    
+    if (total == 0) {
+        LOG_WARNING("No file locations found for study: " + studyUid);
+    } else {
+        LOG_INFO("Retrieved " + std::to_string(total) + 
+                " file locations for study: " + studyUid);
+    }
+    
+    return success;
+}
+
+bool DynamoDBManager::streamInstancesForStudies(const std::string& tableName,
+                                              const std::vector<std::string>& studyUids,
+                                              size_t segments,
+                                              const InstancePageCallback& onPage) {
+    segments = std::max<size_t>(1, std::min(segments, studyUids.size()));
+    
+    // Each segment claims the next unlisted study, so one large study
+    // doesn't hold up the listings queued behind it
+    std::atomic<size_t> nextStudy(0);
+    std::atomic<bool> stopped(false);
+    
+    auto runSegment = [&]() {
+        bool success = true;
+        while (!stopped) {
+            size_t index = nextStudy++;
+            if (index >= studyUids.size()) {
+                break;
+            }
+            bool listed = streamInstances(tableName, studyUids[index],
+                [&](const std::vector<InstanceRecord>& page) {
+                    if (stopped) {
+                        return false;
+                    }
+                    if (!onPage(page)) {
+                        stopped = true;
+                        return false;
+                    }
+                    return true;
+                });
+            success &= listed;
+        }
+        return success;
+    };
+    
+    std::vector<std::future<bool>> segmentResults;
+    for (size_t i = 1; i < segments; ++i) {
+        segmentResults.push_back(std::async(std::launch::async, runSegment));
+    }
+    
+    bool success = runSegment();
+    for (auto& result : segmentResults) {
+        success &= result.get();
+    }
+    return success && !stopped;
+}
+
+bool DynamoDBManager::queryInstances(const std::string& tableName,
+                                   const std::string& studyUid,
+                                   const InstancePageCallback& onPage) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> expressionAttributeValues;
+    expressionAttributeValues[":study"].SetS(studyUid);
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> startKey;
+    bool firstPage = true;
+    
+    // Follow pages until DynamoDB stops returning a continuation key
+    while (true) {
+        Aws::DynamoDB::Model::QueryRequest queryRequest;
+        queryRequest.SetTableName(instanceTableName(tableName));
+        queryRequest.SetKeyConditionExpression("StudyInstanceUID = :study");
+        queryRequest.SetExpressionAttributeValues(expressionAttributeValues);
+        // Commits count and checksum this listing, so it must see the writes just confirmed
+        queryRequest.SetConsistentRead(true);
+        if (firstPage) {
+            // A short first page lets the caller start work without waiting for a full 1 MB page
+            queryRequest.SetLimit(FIRST_PAGE_LIMIT);
+        } else {
+            queryRequest.SetExclusiveStartKey(startKey);
+        }
+        
+        queryRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+        auto queryOutcome = callWithCapacity<Aws::DynamoDB::Model::QueryOutcome>(
+            instanceTableName(tableName), CapacityKind::READ, QUERY_PAGE_READ_ESTIMATE,
+            [&]() { return m_dynamoClient.Query(queryRequest); });
+        
+        if (!queryOutcome.IsSuccess()) {
+            auto error = queryOutcome.GetError();
+            if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND) {
+                // Only legacy-format studies exist so far
+                return true;
+            }
+            LOG_ERROR("Failed to query instances from DynamoDB: " + 
+                     error.GetExceptionName() + " - " + 
+                     error.GetMessage());
+            return false;
+        }
+        
+        const auto& result = queryOutcome.GetResult();
+        std::vector<InstanceRecord> page;
+        page.reserve(result.GetItems().size());
+        for (const auto& item : result.GetItems()) {
+            page.push_back(itemToInstance(item));
+        }
+        
+        if (!page.empty() && !onPage(page)) {
+            return true;
+        }
+        
+        if (result.GetLastEvaluatedKey().empty()) {
+            return true;
+        }
+        startKey = result.GetLastEvaluatedKey();
+        firstPage = false;
+    }
+}
+
+bool DynamoDBManager::getLegacyFileLocations(const std::string& tableName,
+                                            const std::string& studyUid,
+                                            std::vector<std::string>& fileLocations) {
+    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+    
+    // Set up key with the study UID
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
+    
+    getItemRequest.SetTableName(tableName);
+    getItemRequest.SetKey(key);
+    getItemRequest.AddAttributesToGet("FileLocations");
+    
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        tableName, CapacityKind::READ, ITEM_READ_ESTIMATE,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
+    
+    if (getItemOutcome.IsSuccess()) {
+        const auto& item = getItemOutcome.GetResult().GetItem();
+        
+        if (!item.empty() && item.count("FileLocations") > 0) {
+            const auto& locations = item.at("FileLocations").GetSS();
+            for (const auto& location : locations) {
+                fileLocations.push_back(location);
+            }
+        }
+        return true;
+    }
+    
+    auto error = getItemOutcome.GetError();
+    if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND) {
+        return true;
+    }
+    LOG_ERROR("Failed to retrieve file locations from DynamoDB: " + 
+             error.GetExceptionName() + " - " + 
+             error.GetMessage());
+    return false;
+}
+
+Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> DynamoDBManager::studyToItem(
+    const StudyRecord& record) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item;
+    for (const auto& field : StudyRecord::fields()) {
+        const std::string& value = record.*field.member;
+        // Only attributes present in the dataset are stored
+        if (!value.empty()) {
+            item[field.name].SetS(value);
+        }
+    }
+    return item;
+}
+
+StudyRecord DynamoDBManager::itemToStudy(
+    const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item) {
+    StudyRecord record;
+    for (const auto& field : StudyRecord::fields()) {
+        auto it = item.find(field.name);
+        if (it != item.end()) {
+            record.*field.member = it->second.GetS();
+        }
+    }
+    
+    auto blob = item.find(METADATA_BLOB_ATTRIBUTE);
+    if (blob != item.end()) {
+        const auto& buffer = blob->second.GetB();
+        std::string packed;
+        if (!Compression::decompress(std::string(reinterpret_cast<const char*>(buffer.GetUnderlyingData()),
+                                                 buffer.GetLength()), packed) ||
+            !record.unpackAttributes(packed)) {
+            LOG_WARNING("Unreadable metadata blob for study: " + record.studyInstanceUid);
+        }
+    }
+    return record;
+}
+
+Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> DynamoDBManager::compressedStudyItem(
+    const StudyRecord& record, const std::string& blob) {
+    auto attributes = studyToItem(record);
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item;
+    for (const char* name : PROJECTED_STUDY_ATTRIBUTES) {
+        auto it = attributes.find(name);
+        if (it != attributes.end()) {
+            item[name] = it->second;
+        }
+    }
+    item[METADATA_BLOB_ATTRIBUTE].SetB(Aws::Utils::ByteBuffer(
+        reinterpret_cast<const unsigned char*>(blob.data()), blob.size()));
+    return item;
+}
+
+Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> DynamoDBManager::instanceToItem(
+    const InstanceRecord& instance) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item;
+    item["StudyInstanceUID"].SetS(instance.studyUid);
+    item[INSTANCE_SORT_KEY].SetS(instance.instanceKey());
+    item["S3Key"].SetS(instance.s3Key);
+    item["InstanceNumber"].SetN(std::to_string(instance.instanceNumber));
+    item["Size"].SetN(std::to_string(instance.size));
+    
+    if (!instance.seriesUid.empty()) {
+        item["SeriesInstanceUID"].SetS(instance.seriesUid);
+    }
+    if (!instance.sopInstanceUid.empty()) {
+        item["SOPInstanceUID"].SetS(instance.sopInstanceUid);
+    }
+    if (!instance.contentHash.empty()) {
+        item["ContentHash"].SetS(instance.contentHash);
+    }
+    
+    return item;
+}
+
+InstanceRecord DynamoDBManager::itemToInstance(
+    const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item) {
+    InstanceRecord instance;
+    
+    auto getString = [&item](const char* name) -> std::string {
+        auto it = item.find(name);
+        return it != item.end() ? std::string(it->second.GetS()) : std::string();
+    };
+    auto getNumber = [&item](const char* name) -> std::string {
+        auto it = item.find(name);
+        return it != item.end() ? std::string(it->second.GetN()) : std::string("0");
+    };
+    
+    instance.studyUid = getString("StudyInstanceUID");
+    instance.seriesUid = getString("SeriesInstanceUID");
+    instance.sopInstanceUid = getString("SOPInstanceUID");
+    instance.s3Key = getString("S3Key");
+    instance.contentHash = getString("ContentHash");
+    
+    try {
+        instance.instanceNumber = std::stoi(getNumber("InstanceNumber"));
+        instance.size = std::stoull(getNumber("Size"));
+    } catch (const std::exception&) {
+        LOG_WARNING("Malformed instance item for key: " + instance.s3Key);
+    }
+    
+    return instance;
+}
+
+std::string DynamoDBManager::leaseTableName(const std::string& tableName) {
+    return tableName + "-leases";
+}
+
+bool DynamoDBManager::createLeaseTableIfNotExists(const std::string& tableName) {
+    return ensureTable(leaseTableName(tableName), "", false);
+}
+
+DynamoDBManager::LeaseResult DynamoDBManager::acquireLease(const std::string& tableName,
+                                                           const std::string& studyUid,
+                                                           const std::string& owner,
+                                                           std::chrono::seconds duration) {
+    long long now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":owner"].SetS(owner);
+    values[":now"].SetN(std::to_string(now));
+    values[":expires"].SetN(std::to_string(now + duration.count()));
+    
+    bool conditionFailed = false;
+    if (updateLease(tableName, studyUid, "SET #owner = :owner, #expires = :expires",
+                    "attribute_not_exists(#done) AND "
+                    "(attribute_not_exists(#owner) OR #owner = :owner OR #expires < :now)",
+                    values, conditionFailed)) {
+        return LeaseResult::ACQUIRED;
+    }
+    if (!conditionFailed) {
+        return LeaseResult::FAILED;
+    }
+    
+    // Either someone else's live lease or a finished study; tell them apart
+    Aws::DynamoDB::Model::GetItemRequest getItemRequest;
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
+    getItemRequest.SetTableName(leaseTableName(tableName));
+    getItemRequest.SetKey(key);
+    getItemRequest.SetConsistentRead(true);
+    getItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    auto getItemOutcome = callWithCapacity<Aws::DynamoDB::Model::GetItemOutcome>(
+        leaseTableName(tableName), CapacityKind::READ, ITEM_READ_ESTIMATE * 2,
+        [&]() { return m_dynamoClient.GetItem(getItemRequest); });
+    
+    if (!getItemOutcome.IsSuccess()) {
+        return LeaseResult::FAILED;
+    }
+    const auto& item = getItemOutcome.GetResult().GetItem();
+    return item.find(LEASE_DONE_ATTRIBUTE) != item.end() ? LeaseResult::DONE
+                                                         : LeaseResult::HELD_ELSEWHERE;
+}
+
+DynamoDBManager::LeaseResult DynamoDBManager::renewLease(const std::string& tableName,
+                                                         const std::string& studyUid,
+                                                         const std::string& owner,
+                                                         std::chrono::seconds duration) {
+    long long now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":owner"].SetS(owner);
+    values[":expires"].SetN(std::to_string(now + duration.count()));
+    
+    bool conditionFailed = false;
+    if (updateLease(tableName, studyUid, "SET #expires = :expires",
+                    "#owner = :owner AND attribute_not_exists(#done)",
+                    values, conditionFailed)) {
+        return LeaseResult::ACQUIRED;
+    }
+    return conditionFailed ? LeaseResult::HELD_ELSEWHERE : LeaseResult::FAILED;
+}
+
+bool DynamoDBManager::completeLease(const std::string& tableName,
+                                    const std::string& studyUid,
+                                    const std::string& owner) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":owner"].SetS(owner);
+    values[":done"].SetBool(true);
+    
+    bool conditionFailed = false;
+    if (updateLease(tableName, studyUid, "SET #done = :done", "#owner = :owner",
+                    values, conditionFailed)) {
+        return true;
+    }
+    if (conditionFailed) {
+        LOG_WARNING("Lost the lease on study " + studyUid + " before completing it");
+    }
+    return false;
+}
+
+bool DynamoDBManager::releaseLease(const std::string& tableName,
+                                   const std::string& studyUid,
+                                   const std::string& owner) {
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> values;
+    values[":owner"].SetS(owner);
+    
+    bool conditionFailed = false;
+    return updateLease(tableName, studyUid, "REMOVE #owner, #expires", "#owner = :owner",
+                       values, conditionFailed);
+}
+
+bool DynamoDBManager::updateLease(const std::string& tableName,
+                                  const std::string& studyUid,
+                                  const std::string& updateExpression,
+                                  const std::string& conditionExpression,
+                                  const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& values,
+                                  bool& conditionFailed) {
+    const std::string leaseTable = leaseTableName(tableName);
+    
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> key;
+    key["StudyInstanceUID"].SetS(studyUid);
+    
+    // DynamoDB rejects attribute names an expression doesn't use
+    Aws::Map<Aws::String, Aws::String> attributeNames;
+    const std::pair<const char*, const char*> leaseAttributes[] = {
+        {"#owner", LEASE_OWNER_ATTRIBUTE},
+        {"#expires", LEASE_EXPIRES_ATTRIBUTE},
+        {"#done", LEASE_DONE_ATTRIBUTE}
+    };
+    for (const auto& [placeholder, name] : leaseAttributes) {
+        if (updateExpression.find(placeholder) != std::string::npos ||
+            conditionExpression.find(placeholder) != std::string::npos) {
+            attributeNames[placeholder] = name;
+        }
+    }
+    
+    Aws::DynamoDB::Model::UpdateItemRequest updateItemRequest;
+    updateItemRequest.SetTableName(leaseTable);
+    updateItemRequest.SetKey(key);
+    updateItemRequest.SetUpdateExpression(updateExpression);
+    updateItemRequest.SetConditionExpression(conditionExpression);
+    updateItemRequest.SetExpressionAttributeNames(attributeNames);
+    updateItemRequest.SetExpressionAttributeValues(values);
+    updateItemRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+    
+    auto updateItemOutcome = callWithCapacity<Aws::DynamoDB::Model::UpdateItemOutcome>(
+        leaseTable, CapacityKind::WRITE, ITEM_WRITE_ESTIMATE,
+        [&]() { return m_dynamoClient.UpdateItem(updateItemRequest); });
+    
+    conditionFailed = false;
+    if (updateItemOutcome.IsSuccess()) {
+        return true;
+    }
+    
+    const auto& error = updateItemOutcome.GetError();
+    if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::CONDITIONAL_CHECK_FAILED) {
+        conditionFailed = true;
+        return false;
+    }
+    LOG_ERROR("Failed to update lease for study " + studyUid + ": " +
+              error.GetExceptionName() + " - " + error.GetMessage());
+    return false;
+}
+
+bool DynamoDBManager::tableExists(const std::string& tableName) {
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+    if (isTableCached(tableName)) {
+        return true;
+    }
+    
+    TableState state = describeTable(tableName, "");
+    if (state == TableState::ACTIVE) {
+        m_verifiedTables[tableName] = std::chrono::steady_clock::now();
+    }
+    return state != TableState::MISSING && state != TableState::UNAVAILABLE;
+}
+
+DynamoDBManager::TableState DynamoDBManager::describeTable(const std::string& tableName,
+                                                          const std::string& sortKey) {
+    Aws::DynamoDB::Model::DescribeTableRequest describeTableRequest;
+    describeTableRequest.SetTableName(tableName);
+    
+    auto describeTableOutcome = m_dynamoClient.DescribeTable(describeTableRequest);
+    
+    if (!describeTableOutcome.IsSuccess()) {
+        const auto& error = describeTableOutcome.GetError();
+        if (error.GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_NOT_FOUND) {
+            return TableState::MISSING;
+        }
+        LOG_ERROR("Failed to describe DynamoDB table " + tableName + ": " +
+                  error.GetExceptionName() + " - " + error.GetMessage());
+        return TableState::UNAVAILABLE;
+    }
+    
+    const auto& table = describeTableOutcome.GetResult().GetTable();
+    
+    // Every read and write addresses items by StudyInstanceUID
+    bool hashKeyMatches = false;
+    std::string rangeKey;
+    for (const auto& element : table.GetKeySchema()) {
+        if (element.GetKeyType() == Aws::DynamoDB::Model::KeyType::HASH &&
+            element.GetAttributeName() == "StudyInstanceUID") {
+            hashKeyMatches = true;
+        } else if (element.GetKeyType() == Aws::DynamoDB::Model::KeyType::RANGE) {
+            rangeKey = element.GetAttributeName();
+        }
+    }
+    if (!hashKeyMatches) {
+        LOG_ERROR("Table " + tableName + " is not keyed on StudyInstanceUID");
+        return TableState::INVALID_SCHEMA;
+    }
+    if (rangeKey != sortKey) {
+        LOG_ERROR("Table " + tableName + " has an unexpected sort key: " + rangeKey);
+        return TableState::INVALID_SCHEMA;
+    }
+    
+    // On-demand tables report zero provisioned units, which leaves them unpaced
+    const auto& throughput = table.GetProvisionedThroughput();
+    applyTableCapacity(tableName,
+                       static_cast<double>(throughput.GetReadCapacityUnits()),
+                       static_cast<double>(throughput.GetWriteCapacityUnits()));
+    
+    return table.GetTableStatus() == Aws::DynamoDB::Model::TableStatus::ACTIVE
+        ? TableState::ACTIVE : TableState::PENDING;
+}
+
+bool DynamoDBManager::isTableCached(const std::string& tableName) const {
+    auto it = m_verifiedTables.find(tableName);
+    if (it == m_verifiedTables.end()) {
+        return false;
+    }
+    return m_tableCacheTtl.count() == 0 ||
+           std::chrono::steady_clock::now() - it->second < m_tableCacheTtl;
+}
+
+void DynamoDBManager::setTableCacheTtl(std::chrono::seconds ttl) {
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+    m_tableCacheTtl = ttl;
+}
+
+void DynamoDBManager::invalidateTableCache(const std::string& tableName) {
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+    m_verifiedTables.erase(tableName);
+}
+
+bool DynamoDBManager::waitForTableActive(const std::string& tableName,
+                                        const std::string& sortKey) {
+    auto delay = TABLE_WAIT_INITIAL_DELAY;
+    auto deadline = std::chrono::steady_clock::now() + TABLE_WAIT_TIMEOUT;
+    
+    while (true) {
+        TableState state = describeTable(tableName, sortKey);
+        if (state == TableState::ACTIVE) {
+            LOG_INFO("DynamoDB table is now active: " + tableName);
+            return true;
+        }
+        if (state == TableState::INVALID_SCHEMA) {
+            return false;
+        }
+        
+        if (std::chrono::steady_clock::now() + delay > deadline) {
+            LOG_ERROR("Timed out waiting for DynamoDB table to become active: " + tableName);
+            return false;
+        }
+        
+        std::this_thread::sleep_for(delay);
+        delay = std::min(delay * 2, TABLE_WAIT_MAX_DELAY);
+    }
+}
+
+bool DynamoDBManager::createTableIfNotExists(const std::string& tableName) {
+    return ensureTable(tableName, "", true);
+}
+
+bool DynamoDBManager::ensureTable(const std::string& tableName, const std::string& sortKey,
+                                  bool studyIndexes) {
+    // Held across create-and-wait so concurrent studies issue a single DescribeTable
+    std::lock_guard<std::mutex> lock(m_tableMutex);
+    if (isTableCached(tableName)) {
+        return true;
+    }
+    
+    TableState state = describeTable(tableName, sortKey);
+    if (state == TableState::INVALID_SCHEMA || state == TableState::UNAVAILABLE) {
+        return false;
+    }
+    if (state != TableState::MISSING) {
+        if (state == TableState::PENDING && !waitForTableActive(tableName, sortKey)) {
+            return false;
+        }
+        if (studyIndexes) {
+            addMissingStudyIndexes(tableName);
+        }
+        m_verifiedTables[tableName] = std::chrono::steady_clock::now();
+        return true;
+    }
+    
+    LOG_INFO("Creating DynamoDB table: " + tableName);
+    
+    Aws::DynamoDB::Model::CreateTableRequest createTableRequest;
+    createTableRequest.SetTableName(tableName);
+    
+    // Define attribute definitions
+    Aws::Vector<Aws::DynamoDB::Model::AttributeDefinition> attributeDefinitions;
+    Aws::DynamoDB::Model::AttributeDefinition studyUidAttribute;
+    studyUidAttribute.SetAttributeName("StudyInstanceUID");
+    studyUidAttribute.SetAttributeType(Aws::DynamoDB::Model::ScalarAttributeType::S);
+    attributeDefinitions.push_back(studyUidAttribute);
+    
+    if (!sortKey.empty()) {
+        Aws::DynamoDB::Model::AttributeDefinition sortKeyAttribute;
+        sortKeyAttribute.SetAttributeName(sortKey);
+        sortKeyAttribute.SetAttributeType(Aws::DynamoDB::Model::ScalarAttributeType::S);
+        attributeDefinitions.push_back(sortKeyAttribute);
+    }
+    
+    if (studyIndexes) {
+        for (const auto& attribute : studyIndexAttributes()) {
+            attributeDefinitions.push_back(attribute);
+        }
+        for (const auto& index : STUDY_INDEXES) {
+            createTableRequest.AddGlobalSecondaryIndexes(buildStudyIndex(index, !m_onDemandBilling));
+        }
+    }
+    
+    createTableRequest.SetAttributeDefinitions(attributeDefinitions);
+    
+    // Define key schema
+    Aws::Vector<Aws::DynamoDB::Model::KeySchemaElement> keySchema;
+    Aws::DynamoDB::Model::KeySchemaElement studyUidKeyElement;
+    studyUidKeyElement.SetAttributeName("StudyInstanceUID");
+    studyUidKeyElement.SetKeyType(Aws::DynamoDB::Model::KeyType::HASH);
+    keySchema.push_back(studyUidKeyElement);
+    
+    if (!sortKey.empty()) {
+        Aws::DynamoDB::Model::KeySchemaElement sortKeyElement;
+        sortKeyElement.SetAttributeName(sortKey);
+        sortKeyElement.SetKeyType(Aws::DynamoDB::Model::KeyType::RANGE);
+        keySchema.push_back(sortKeyElement);
+    }
+    
+    createTableRequest.SetKeySchema(keySchema);
+    
+    if (m_onDemandBilling) {
+        createTableRequest.SetBillingMode(Aws::DynamoDB::Model::BillingMode::PAY_PER_REQUEST);
+    } else {
+        createTableRequest.SetBillingMode(Aws::DynamoDB::Model::BillingMode::PROVISIONED);
+        createTableRequest.SetProvisionedThroughput(tableThroughput());
+    }
+    
+    auto createTableOutcome = m_dynamoClient.CreateTable(createTableRequest);
+    
+    if (createTableOutcome.IsSuccess() ||
+        createTableOutcome.GetError().GetErrorType() == Aws::DynamoDB::DynamoDBErrors::RESOURCE_IN_USE) {
+        // RESOURCE_IN_USE means another process created it first; wait for it either way
+        if (createTableOutcome.IsSuccess()) {
+            LOG_INFO("Successfully created DynamoDB table: " + tableName);
+        } else {
+            LOG_INFO("DynamoDB table already exists or is being created: " + tableName);
+        }
+        
+        if (!waitForTableActive(tableName, sortKey)) {
+            return false;
+        }
+        m_verifiedTables[tableName] = std::chrono::steady_clock::now();
+        return true;
+    } else {
+        auto error = createTableOutcome.GetError();
+        LOG_ERROR("Failed to create DynamoDB table: " + 
+                 error.GetExceptionName() + " - " + 
+                 error.GetMessage());
+        return false;
+    }
+}
+
+void DynamoDBManager::addMissingStudyIndexes(const std::string& tableName) {
+    Aws::DynamoDB::Model::DescribeTableRequest describeTableRequest;
+    describeTableRequest.SetTableName(tableName);
+    
+    auto describeTableOutcome = m_dynamoClient.DescribeTable(describeTableRequest);
+    if (!describeTableOutcome.IsSuccess()) {
+        return;
+    }
+    
+    const auto& table = describeTableOutcome.GetResult().GetTable();
+    bool provisioned = table.GetBillingModeSummary().GetBillingMode() !=
+                       Aws::DynamoDB::Model::BillingMode::PAY_PER_REQUEST;
+    
+    std::set<std::string> existingIndexes;
+    for (const auto& index : table.GetGlobalSecondaryIndexes()) {
+        if (index.GetIndexStatus() == Aws::DynamoDB::Model::IndexStatus::CREATING) {
+            // DynamoDB backfills one new index at a time; the next run adds the rest
+            return;
+        }
+        existingIndexes.insert(index.GetIndexName());
+    }
+    
+    for (const auto& spec : STUDY_INDEXES) {
+        if (existingIndexes.count(spec.name) > 0) {
+            continue;
+        }
+        
+        Aws::DynamoDB::Model::CreateGlobalSecondaryIndexAction createAction;
+        createAction.SetIndexName(spec.name);
+        createAction.SetKeySchema(studyIndexKeySchema(spec));
+        createAction.SetProjection(studyIndexProjection());
+        if (provisioned) {
+            createAction.SetProvisionedThroughput(tableThroughput());
+        }
+        
+        Aws::DynamoDB::Model::GlobalSecondaryIndexUpdate indexUpdate;
+        indexUpdate.SetCreate(createAction);
+        
+        Aws::DynamoDB::Model::UpdateTableRequest updateTableRequest;
+        updateTableRequest.SetTableName(tableName);
+        updateTableRequest.SetAttributeDefinitions(studyIndexAttributes());
+        updateTableRequest.SetGlobalSecondaryIndexUpdates({indexUpdate});
+        
+        // Not waited for: the index backfills in the background and queries use it once ACTIVE
+        auto updateTableOutcome = m_dynamoClient.UpdateTable(updateTableRequest);
+        if (updateTableOutcome.IsSuccess()) {
+            LOG_INFO("Adding index " + std::string(spec.name) + " to table: " + tableName);
+        } else {
+            auto error = updateTableOutcome.GetError();
+            LOG_WARNING("Failed to add index " + std::string(spec.name) + ": " + 
+                       error.GetExceptionName() + " - " + 
+                       error.GetMessage());
+        }
+        return;
+    }
+}
+
+bool DynamoDBManager::findStudies(const std::string& tableName,
+                                  const StudyQuery& query,
+                                  std::vector<StudyRecord>& studies) {
+    studies.clear();
+    std::set<std::string> seenStudies;
+    
+    auto collect = [&](const StudyRecord& record) {
+        if (query.matches(record) && seenStudies.insert(record.studyInstanceUid).second) {
+            studies.push_back(record);
+        }
+    };
+    
+    // The most selective criterion picks the index; the rest are applied to the results
+    bool success = true;
+    if (!query.accessionNumber.empty()) {
+        success = queryStudyIndex(tableName, "AccessionNumber-index", "AccessionNumber",
+                                  query.accessionNumber, "", "", collect);
+    } else if (!query.patientId.empty()) {
+        success = queryStudyIndex(tableName, "PatientID-index", "PatientID",
+                                  query.patientId, query.studyDateFrom, query.studyDateTo, collect);
+    } else if (!query.studyDateFrom.empty() || !query.studyDateTo.empty()) {
+        std::vector<std::string> dates = StudyQuery::expandDates(query.studyDateFrom, query.studyDateTo);
+        if (dates.empty() || dates.size() > MAX_QUERY_DAYS) {
+            LOG_ERROR("Study date range must be valid and at most " + 
+                     std::to_string(MAX_QUERY_DAYS) + " days");
+            return false;
+        }
+        for (const auto& date : dates) {
+            if (!queryStudyIndex(tableName, "StudyDate-index", "StudyDate", date, "", "", collect)) {
+                success = false;
+                break;
+            }
+        }
+    } else {
+        LOG_ERROR("Study query needs a patient ID, accession number or study date");
+        return false;
+    }
+    
+    if (!success) {
+        LOG_ERROR("Study query failed after " + std::to_string(studies.size()) + " matches");
+        return false;
+    }
+    
+    LOG_INFO("Query matched " + std::to_string(studies.size()) + " studies");
+    return true;
+}
+
+bool DynamoDBManager::queryStudyIndex(const std::string& tableName,
+                                    const std::string& indexName,
+                                    const std::string& hashKey,
+                                    const std::string& hashValue,
+                                    const std::string& dateFrom,
+                                    const std::string& dateTo,
+                                    const std::function<void(const StudyRecord&)>& onStudy) {
+    Aws::Map<Aws::String, Aws::String> attributeNames;
+    Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> attributeValues;
+    attributeNames["#k"] = hashKey;
+    attributeValues[":k"].SetS(hashValue);
+    std::string keyCondition = "#k = :k";
+    
+    // Only the PatientID index has StudyDate as its sort key
+    if (!dateFrom.empty() || !dateTo.empty()) {
+        attributeNames["#d"] = "StudyDate";
+        if (!dateFrom.empty() && !dateTo.empty()) {
+            keyCondition += " AND #d BETWEEN :from AND :to";
+            attributeValues[":from"].SetS(dateFrom);
+            attributeValues[":to"].SetS(dateTo);
+        } else if (!dateFrom.empty()) {
+            keyCondition += " AND #d >= :from";
+            attributeValues[":from"].SetS(dateFrom);
+        } else {
+            keyCondition += " AND #d <= :to";
+            attributeValues[":to"].SetS(dateTo);
+        }
+    }
+    
+    Aws::DynamoDB::Model::QueryRequest queryRequest;
+    queryRequest.SetTableName(tableName);
+    queryRequest.SetIndexName(indexName);
+    queryRequest.SetKeyConditionExpression(keyCondition);
+    queryRequest.SetExpressionAttributeNames(attributeNames);
+    queryRequest.SetExpressionAttributeValues(attributeValues);
+    
+    while (true) {
+        queryRequest.SetReturnConsumedCapacity(Aws::DynamoDB::Model::ReturnConsumedCapacity::TOTAL);
+        auto queryOutcome = callWithCapacity<Aws::DynamoDB::Model::QueryOutcome>(
+            tableName, CapacityKind::READ, QUERY_PAGE_READ_ESTIMATE,
+            [&]() { return m_dynamoClient.Query(queryRequest); });
+        
+        if (!queryOutcome.IsSuccess()) {
+            auto error = queryOutcome.GetError();
+            LOG_ERROR("Failed to query " + indexName + " (it may still be building): " + 
+                     error.GetExceptionName() + " - " + 
+                     error.GetMessage());
+            return false;
+        }
+        
+        const auto& result = queryOutcome.GetResult();
+        for (const auto& item : result.GetItems()) {
+            if (isCommittedItem(item)) {
+                onStudy(itemToStudy(item));
+            }
+        }
+        
+        if (result.GetLastEvaluatedKey().empty()) {
+            return true;
+        }
+        queryRequest.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+    }
+}
+
 std::map<std::string, Aws::DynamoDB::Model::AttributeValue> DynamoDBManager::jsonToAttributeMap(
     const Json::Value& json) {
     std::map<std::string, Aws::DynamoDB::Model::AttributeValue> attributeMap;
@@ -2,14 +2,39 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
 #include <aws/core/Aws.h>
 #include <aws/dynamodb/DynamoDBClient.h>
 #include <aws/dynamodb/model/AttributeValue.h>
 #include <json/json.h>
 
+#include "study_record.h"
+#include "token_bucket.h"
+
+// Forward declaration
+class UploadJournal;
+
 class DynamoDBManager {
 public:
-    DynamoDBManager(const std::string& region = "ap-south-1");
+    // Receives one page of a study listing; return false to stop the listing
+    using InstancePageCallback = std::function<bool(const std::vector<InstanceRecord>&)>;
+    
+    // Outcome of claiming a study's lease in the lease table
+    enum class LeaseResult {
+        ACQUIRED,        // this owner now holds the lease
+        HELD_ELSEWHERE,  // another owner holds a live lease
+        DONE,            // the study was already completed under a lease
+        FAILED
+    };
+    
+    // endpoint overrides the service URL, e.g. a local DynamoDB stand-in
+    DynamoDBManager(const std::string& region = "ap-south-1", const std::string& endpoint = "");
     ~DynamoDBManager();
     
     // Store study metadata in DynamoDB
@@ -17,29 +42,311 @@ public:
                             const std::string& studyUid,
                             const Json::Value& metadata);
     
-    // Retrieve study metadata from DynamoDB
+    // Retrieve a committed study's metadata from DynamoDB
     bool getStudyMetadata(const std::string& tableName,
                          const std::string& studyUid,
                          Json::Value& metadata);
     
+    // Store a study record, converting its fields directly to attribute values
+    bool storeStudyRecord(const std::string& tableName,
+                          const StudyRecord& record);
+    
+    // Publish a study once every instance item is written: its PENDING item
+    // (or the copy staged beside a previously committed one) becomes COMMITTED
+    // with the instance count and checksum. Readers only see committed studies.
+    bool markStudyCommitted(const std::string& tableName,
+                            const std::string& studyUid);
+    
+    // Read a committed study's instance checksum, to check a manifest or cached
+    // listing against; empty for studies committed before checksums were kept.
+    // False if the study is missing, still pending, or the read failed.
+    bool getCommittedChecksum(const std::string& tableName,
+                              const std::string& studyUid,
+                              std::string& checksum);
+    
+    // Retrieve only the study record's fields from a committed study item
+    bool getStudyRecord(const std::string& tableName,
+                        const std::string& studyUid,
+                        StudyRecord& record);
+    
     // Store file location in DynamoDB
     bool storeFileLocation(const std::string& tableName,
                           const std::string& studyUid,
                           const std::string& s3Key);
     
+    // Store one instance as its own item in the study's instance table
+    bool storeInstance(const std::string& tableName,
+                       const InstanceRecord& instance);
+    
+    // Buffer a file location so it is written together with other keys of the same study
+    bool queueFileLocation(const std::string& tableName,
+                           const std::string& studyUid,
+                           const std::string& s3Key);
+    
+    // Buffer an instance record for a batched write
+    bool queueInstance(const std::string& tableName,
+                       const InstanceRecord& instance);
+    
+    // Write all buffered file locations for a study in batched updates
+    bool flushFileLocations(const std::string& tableName,
+                            const std::string& studyUid);
+    
+    // Write buffered file locations for every study
+    bool flushAllFileLocations();
+    
+    // Write the buffers whose oldest entry has reached the batching age, so a
+    // study that stops receiving instances is not held until its commit
+    bool flushAgedFileLocations();
+    
+    // Flush a study's buffer once it holds maxKeys locations or its oldest entry reaches maxAge
+    void setFileLocationBatching(size_t maxKeys, std::chrono::milliseconds maxAge);
+    
+    // Journal that records buffered file locations until they are flushed
+    void setUploadJournal(UploadJournal* journal);
+    
     // Get all file locations for a study
     std::vector<std::string> getFileLocations(const std::string& tableName,
                                             const std::string& studyUid);
     
-    // Check if a table exists
+    // Get every instance of a study, ordered by series and instance number.
+    // Includes keys still held in a legacy FileLocations set. False if any
+    // page of the listing failed, leaving instances incomplete.
+    bool getInstances(const std::string& tableName,
+                      const std::string& studyUid,
+                      std::vector<InstanceRecord>& instances);
+    
+    // Deliver a study's instances page by page as the Query returns them.
+    // Keys from a legacy FileLocations set arrive as a final page.
+    bool streamInstances(const std::string& tableName,
+                         const std::string& studyUid,
+                         const InstancePageCallback& onPage);
+    
+    // List several studies on parallel segments; onPage may be called concurrently
+    bool streamInstancesForStudies(const std::string& tableName,
+                                   const std::vector<std::string>& studyUids,
+                                   size_t segments,
+                                   const InstancePageCallback& onPage);
+    
+    // Name of the per-instance table that accompanies a study table
+    static std::string instanceTableName(const std::string& tableName);
+    
+    // Name of the table through which sharded workers lease studies
+    static std::string leaseTableName(const std::string& tableName);
+    
+    // Create the lease table, keyed on StudyInstanceUID, unless it exists
+    bool createLeaseTableIfNotExists(const std::string& tableName);
+    
+    // Take or renew a study's lease until now + duration. Succeeds if the lease is
+    // free, expired or already this owner's, and the study is not done.
+    LeaseResult acquireLease(const std::string& tableName,
+                             const std::string& studyUid,
+                             const std::string& owner,
+                             std::chrono::seconds duration);
+    
+    // Extend a lease this owner still holds; HELD_ELSEWHERE if it lapsed and was
+    // taken, or the study was completed
+    LeaseResult renewLease(const std::string& tableName,
+                    const std::string& studyUid,
+                    const std::string& owner,
+                    std::chrono::seconds duration);
+    
+    // Mark a study done under this owner's lease so no worker claims it again
+    bool completeLease(const std::string& tableName,
+                       const std::string& studyUid,
+                       const std::string& owner);
+    
+    // Drop this owner's lease so another worker can claim the study at once
+    bool releaseLease(const std::string& tableName,
+                      const std::string& studyUid,
+                      const std::string& owner);
+    
+    // Check if a table exists (answered from the table cache when still valid)
     bool tableExists(const std::string& tableName);
     
-    // Create table if it doesn't exist
+    // Create table if it doesn't exist, with the PatientID, AccessionNumber and StudyDate indexes
     bool createTableIfNotExists(const std::string& tableName);
     
+    // Resolve studies through the secondary indexes; false if any index
+    // query failed, leaving only a partial list in studies
+    bool findStudies(const std::string& tableName,
+                     const StudyQuery& query,
+                     std::vector<StudyRecord>& studies);
+    
+    // How long a verified table stays cached (zero keeps it for the process lifetime)
+    void setTableCacheTtl(std::chrono::seconds ttl);
+    
+    // Forget a cached table so the next call describes it again
+    void invalidateTableCache(const std::string& tableName);
+    
+    // Generation stamped on study items; a write never replaces an item from a newer
+    // generation. Defaults to the construction time in milliseconds.
+    void setUploadGeneration(long long generation);
+    long long getUploadGeneration() const;
+    
+    // Store study records as a zstd-compressed blob of every attribute, keeping
+    // only the key and index attributes as plain attributes
+    void setCompressedMetadata(bool compress);
+    
+    // Create new tables with PAY_PER_REQUEST billing instead of provisioned capacity
+    void setOnDemandBilling(bool onDemand);
+    
+    // Pace every table to these units per second instead of its provisioned rate (zero: unset)
+    void setCapacityLimits(double readUnitsPerSecond, double writeUnitsPerSecond);
+    
 private:
     Aws::DynamoDB::DynamoDBClient m_dynamoClient;
     
+    // File locations waiting to be written, keyed by (table, study)
+    struct PendingLocations {
+        std::vector<InstanceRecord> instances;
+        std::chrono::steady_clock::time_point firstQueued;
+    };
+    std::map<std::pair<std::string, std::string>, PendingLocations> m_pendingLocations;
+    // Studies with a flush in flight; other flushes of the study wait for it
+    std::set<std::pair<std::string, std::string>> m_flushing;
+    std::condition_variable m_flushFinished;
+    std::mutex m_pendingMutex;
+    size_t m_locationBatchSize;
+    std::chrono::milliseconds m_locationBatchAge;
+    UploadJournal* m_journal;
+    
+    // Tables verified as ACTIVE with the expected key schema, and when that was checked
+    std::map<std::string, std::chrono::steady_clock::time_point> m_verifiedTables;
+    std::chrono::seconds m_tableCacheTtl;
+    std::mutex m_tableMutex;
+    bool m_onDemandBilling;
+    
+    // Client-side pacing per table, sized from the table's provisioned throughput
+    enum class CapacityKind {
+        READ,
+        WRITE
+    };
+    struct TableLimiters {
+        TokenBucket read;
+        TokenBucket write;
+    };
+    std::map<std::string, std::unique_ptr<TableLimiters>> m_limiters;
+    double m_readLimit;
+    double m_writeLimit;
+    std::mutex m_limiterMutex;
+    bool m_compressMetadata;
+    long long m_uploadGeneration;
+    
+    // State of a table as reported by DescribeTable; UNAVAILABLE when the call
+    // itself failed (throttling, permissions, network) and the state is unknown
+    enum class TableState {
+        MISSING,
+        PENDING,
+        ACTIVE,
+        INVALID_SCHEMA,
+        UNAVAILABLE
+    };
+    
+    // Describe a table, checking its status and that it is keyed on StudyInstanceUID
+    // with the given sort key (empty for none)
+    TableState describeTable(const std::string& tableName, const std::string& sortKey);
+    
+    // Poll until a table is ACTIVE, backing off exponentially between checks
+    bool waitForTableActive(const std::string& tableName, const std::string& sortKey);
+    
+    // Create a table keyed on StudyInstanceUID (plus sortKey if given) unless it exists
+    bool ensureTable(const std::string& tableName, const std::string& sortKey,
+                     bool studyIndexes);
+    
+    // Size a table's buckets from its provisioned units (zero for on-demand tables)
+    void applyTableCapacity(const std::string& tableName, double readUnits, double writeUnits);
+    
+    // Bucket that paces one kind of capacity on a table
+    TokenBucket& limiterFor(const std::string& tableName, CapacityKind kind);
+    
+    // Issue a request through the table's bucket: take the estimated units first,
+    // settle against the consumed capacity it reports, and retry throttled calls
+    template <typename Outcome>
+    Outcome callWithCapacity(const std::string& tableName, CapacityKind kind,
+                             double estimatedUnits, const std::function<Outcome()>& call);
+    
+    // Start creating the first study index an older table lacks
+    void addMissingStudyIndexes(const std::string& tableName);
+    
+    // Put a study item unless a newer upload generation already stored it
+    bool putStudyItem(const std::string& tableName,
+                      const std::string& studyUid,
+                      Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> item);
+    
+    // Park a re-upload's item beside the committed one, which stays visible
+    bool stagePendingStudy(const std::string& tableName,
+                           const std::string& studyUid,
+                           const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item);
+    
+    // Replace the committed item with this generation's staged copy
+    bool promoteStagedStudy(const std::string& tableName,
+                            const std::string& studyUid,
+                            size_t instanceCount,
+                            const std::string& checksum);
+    
+    // Page through one secondary index, optionally bounding StudyDate
+    bool queryStudyIndex(const std::string& tableName,
+                         const std::string& indexName,
+                         const std::string& hashKey,
+                         const std::string& hashValue,
+                         const std::string& dateFrom,
+                         const std::string& dateTo,
+                         const std::function<void(const StudyRecord&)>& onStudy);
+    
+    // Whether a cached verification for the table is still valid (m_tableMutex held)
+    bool isTableCached(const std::string& tableName) const;
+    
+    // Conditional UpdateItem on a study's lease item; false if the condition failed
+    bool updateLease(const std::string& tableName,
+                     const std::string& studyUid,
+                     const std::string& updateExpression,
+                     const std::string& conditionExpression,
+                     const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& values,
+                     bool& conditionFailed);
+    
+    // Put instance items with BatchWriteItem, retrying unprocessed items
+    bool writeInstances(const std::string& tableName,
+                        const std::vector<InstanceRecord>& instances);
+    
+    // Page through a study's items in the instance table
+    bool queryInstances(const std::string& tableName,
+                        const std::string& studyUid,
+                        const InstancePageCallback& onPage);
+    
+    // Keys stored in the study item's FileLocations set by older releases;
+    // false if the study item could not be read
+    bool getLegacyFileLocations(const std::string& tableName,
+                                const std::string& studyUid,
+                                std::vector<std::string>& fileLocations);
+    
+    // Write a study's swapped-out buffer in batches, requeueing the rest on failure
+    bool writeFileLocations(const std::string& tableName,
+                            const std::string& studyUid,
+                            const std::vector<InstanceRecord>& instances);
+    
+    // Return instances to the front of a study's buffer after a failed flush
+    void requeueFileLocations(const std::string& tableName,
+                              const std::string& studyUid,
+                              const std::vector<InstanceRecord>& instances);
+    
+    // Conversion between study records and study table items
+    static Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> studyToItem(
+        const StudyRecord& record);
+    
+    static StudyRecord itemToStudy(
+        const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item);
+    
+    // Study item holding the projected attributes and the compressed blob
+    static Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> compressedStudyItem(
+        const StudyRecord& record, const std::string& blob);
+    
+    // Conversion between instance records and instance table items
+    static Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue> instanceToItem(
+        const InstanceRecord& instance);
+    
+    static InstanceRecord itemToInstance(
+        const Aws::Map<Aws::String, Aws::DynamoDB::Model::AttributeValue>& item);
+    
     // Helper methods for converting between JSON and DynamoDB attribute values
     std::map<std::string, Aws::DynamoDB::Model::AttributeValue> jsonToAttributeMap(
         const Json::Value& json);
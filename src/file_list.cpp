@@ -0,0 +1,57 @@
+#include "file_list.h"
+#include "logger.h"
+#include "utils.h"
+
+FileListReader::FileListReader(std::istream& input)
+    : m_input(input),
+      m_lineNumber(0),
+      m_skippedLines(0) {
+}
+
+bool FileListReader::next(FileListEntry& entry) {
+    std::string line;
+    while (std::getline(m_input, line)) {
+        m_lineNumber++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (Utils::trim(line).empty() || line[0] == '#') {
+            continue;
+        }
+
+        // Paths may contain spaces, so only tabs separate fields
+        std::vector<std::string> fields = Utils::split(line, '\t');
+        if (fields.size() > 3 || fields[0].empty()) {
+            LOG_WARNING("Skipping malformed file list line " + std::to_string(m_lineNumber));
+            m_skippedLines++;
+            continue;
+        }
+
+        entry = FileListEntry();
+        entry.path = fields[0];
+        if (fields.size() > 1) {
+            entry.studyUid = Utils::trim(fields[1]);
+        }
+        if (fields.size() > 2 && !Utils::trim(fields[2]).empty()) {
+            std::string size = Utils::trim(fields[2]);
+            size_t parsed = 0;
+            try {
+                entry.size = std::stoull(size, &parsed);
+            } catch (...) {
+                parsed = 0;
+            }
+            if (parsed != size.size()) {
+                LOG_WARNING("Skipping file list line " + std::to_string(m_lineNumber) +
+                            " with invalid size: " + size);
+                m_skippedLines++;
+                continue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+size_t FileListReader::getSkippedLines() const {
+    return m_skippedLines;
+}
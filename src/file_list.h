@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <istream>
+
+// One file named by a file list
+struct FileListEntry {
+    std::string path;
+    std::string studyUid;   // Empty when the list leaves it to the DICOM parse
+    uint64_t size = 0;      // 0 when the list leaves it to a stat
+};
+
+// Streams a pre-enumerated file list, e.g. a PACS export, one entry per line:
+//   <path>[\t<study-uid>[\t<size>]]
+// Blank lines and '#' comments are skipped. Entries are read one at a time,
+// so memory does not grow with the length of the list.
+class FileListReader {
+public:
+    explicit FileListReader(std::istream& input);
+
+    // Next well-formed entry; false at end of input. Malformed lines are
+    // logged and skipped.
+    bool next(FileListEntry& entry);
+
+    size_t getSkippedLines() const;
+
+private:
+    std::istream& m_input;
+    size_t m_lineNumber;
+    size_t m_skippedLines;
+};
@@ -0,0 +1,448 @@
+#include "file_reader.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+    size_t alignUp(size_t value) {
+        return (value + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+    }
+
+    // Advise sequential access and switch large files to O_DIRECT.
+    // Returns whether the descriptor is now in direct mode.
+    bool prepareDescriptor(int fd, size_t fileSize, const FileReadOptions& options) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (options.directIoThreshold == 0 || fileSize < options.directIoThreshold) {
+            return false;
+        }
+
+        int flags = fcntl(fd, F_GETFL);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0;
+    }
+
+    // Fall back to buffered reads when the filesystem rejects a direct read
+    void disableDirectIo(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        if (flags >= 0) {
+            fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+        }
+    }
+
+    // Drop the file's pages once its contents are in our buffer
+    void releaseDescriptor(int fd, const FileReadOptions& options) {
+        if (options.dropCache) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    }
+}
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+
+struct FileReaderRing {
+    struct io_uring ring;
+};
+
+namespace {
+    // Operation tags packed into the low bits of each SQE's user data
+    enum RingOp : uintptr_t {
+        OP_OPEN = 0,
+        OP_STATX = 1,
+        OP_READ = 2,
+        OP_CLOSE = 3
+    };
+
+    // Largest single read submitted; a multiple of the direct I/O alignment
+    const size_t MAX_RING_READ = size_t(1) << 30;
+
+    void* encodeUserData(size_t index, RingOp op) {
+        return reinterpret_cast<void*>((static_cast<uintptr_t>(index) << 2) | op);
+    }
+
+    void decodeUserData(void* data, size_t& index, RingOp& op) {
+        uintptr_t value = reinterpret_cast<uintptr_t>(data);
+        index = static_cast<size_t>(value >> 2);
+        op = static_cast<RingOp>(value & 0x3);
+    }
+
+    // Wait for a single completion, retrying on EINTR
+    bool waitCompletion(struct io_uring* ring, size_t& index, RingOp& op, int& result) {
+        struct io_uring_cqe* cqe = nullptr;
+        int ret;
+        do {
+            ret = io_uring_wait_cqe(ring, &cqe);
+        } while (ret == -EINTR);
+
+        if (ret < 0) {
+            LOG_ERROR("io_uring_wait_cqe failed: " + std::string(strerror(-ret)));
+            return false;
+        }
+
+        decodeUserData(io_uring_cqe_get_data(cqe), index, op);
+        result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        return true;
+    }
+
+    // Like waitCompletion, but gives up after a bounded wait; used to drain a failing ring
+    bool waitCompletionTimeout(struct io_uring* ring, size_t& index, RingOp& op, int& result) {
+        struct __kernel_timespec timeout{};
+        timeout.tv_sec = 1;
+        struct io_uring_cqe* cqe = nullptr;
+        int ret;
+        do {
+            ret = io_uring_wait_cqe_timeout(ring, &cqe, &timeout);
+        } while (ret == -EINTR);
+
+        if (ret < 0) {
+            return false;
+        }
+
+        decodeUserData(io_uring_cqe_get_data(cqe), index, op);
+        result = cqe->res;
+        io_uring_cqe_seen(ring, cqe);
+        return true;
+    }
+
+    // Take a submission slot, pushing queued entries to the kernel once if the ring is full
+    struct io_uring_sqe* acquireSqe(struct io_uring* ring) {
+        struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+        if (!sqe && io_uring_submit(ring) >= 0) {
+            sqe = io_uring_get_sqe(ring);
+        }
+        return sqe;
+    }
+}
+#else
+struct FileReaderRing {};
+#endif
+
+FileReader::FileReader(size_t queueDepth, const FileReadOptions& options)
+    : m_queueDepth(std::max<size_t>(queueDepth, 1)),
+      m_options(options) {
+#ifdef HAVE_LIBURING
+    // Each file needs an openat and a statx in flight at the same time
+    auto ring = std::make_unique<FileReaderRing>();
+    int ret = io_uring_queue_init(static_cast<unsigned>(m_queueDepth * 2), &ring->ring, 0);
+    if (ret == 0) {
+        m_ring = std::move(ring);
+        LOG_DEBUG("FileReader using io_uring with queue depth " + std::to_string(m_queueDepth));
+    } else {
+        LOG_WARNING("io_uring unavailable (" + std::string(strerror(-ret)) +
+                    "), falling back to pread");
+    }
+#endif
+}
+
+FileReader::~FileReader() {
+#ifdef HAVE_LIBURING
+    if (m_ring) {
+        io_uring_queue_exit(&m_ring->ring);
+    }
+#endif
+}
+
+bool FileReader::usingIoUring() const {
+    return m_ring != nullptr;
+}
+
+size_t FileReader::getQueueDepth() const {
+    return m_queueDepth;
+}
+
+void FileReader::readBatch(const std::vector<std::string>& paths,
+                           const std::function<void(FileBuffer&&)>& onComplete) {
+    for (size_t begin = 0; begin < paths.size(); begin += m_queueDepth) {
+        size_t end = std::min(begin + m_queueDepth, paths.size());
+
+        if (m_ring) {
+            readChunkUring(paths, begin, end, onComplete);
+            continue;
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            FileBuffer buffer;
+            readFile(paths[i], buffer, m_options);
+            onComplete(std::move(buffer));
+        }
+    }
+}
+
+bool FileReader::readFile(const std::string& path, FileBuffer& buffer,
+                          const FileReadOptions& options) {
+    buffer.path = path;
+    buffer.ok = false;
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("Failed to open file for reading: " + path + " - " + strerror(errno));
+        return false;
+    }
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) != 0) {
+        LOG_ERROR("Failed to stat file: " + path + " - " + strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    const size_t fileSize = static_cast<size_t>(statbuf.st_size);
+    bool direct = prepareDescriptor(fd, fileSize, options);
+
+    // Direct reads must cover whole aligned blocks
+    buffer.data.resize(direct ? alignUp(fileSize) : fileSize);
+
+    size_t offset = 0;
+    while (offset < fileSize) {
+        ssize_t n = pread(fd, buffer.data.data() + offset, buffer.data.size() - offset,
+                          static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && direct) {
+                disableDirectIo(fd);
+                direct = false;
+                continue;
+            }
+            LOG_ERROR("Failed to read file: " + path + " - " + strerror(errno));
+            releaseDescriptor(fd, options);
+            close(fd);
+            return false;
+        }
+        if (n == 0) {
+            // File shrank after fstat; keep what was read
+            break;
+        }
+        offset += static_cast<size_t>(n);
+    }
+    buffer.data.resize(offset);
+
+    releaseDescriptor(fd, options);
+    close(fd);
+    buffer.ok = true;
+    return true;
+}
+
+#ifdef HAVE_LIBURING
+void FileReader::readChunkUring(const std::vector<std::string>& paths,
+                                size_t begin, size_t end,
+                                const std::function<void(FileBuffer&&)>& onComplete) {
+    struct io_uring* ring = &m_ring->ring;
+    const size_t count = end - begin;
+
+    // Heap-held so the memory can outlive this call if the ring has to be abandoned
+    auto buffers = std::make_unique<std::vector<FileBuffer>>(count);
+    auto stats = std::make_unique<std::vector<struct statx>>(count);
+    std::vector<int> fds(count, -1);
+    std::vector<bool> sized(count, false);
+    std::vector<bool> direct(count, false);
+    std::vector<size_t> offsets(count, 0);
+
+    // Files the ring couldn't take (no submission slot); read with pread afterwards
+    std::vector<bool> fallback(count, false);
+    size_t outstanding = 0;
+    bool ringFailed = false;
+
+    // Only completions of requests that are still in flight matter once the ring fails
+    auto handleOpen = [&](size_t index, int result) {
+        if (result >= 0) {
+            fds[index] = result;
+        } else {
+            LOG_ERROR("Failed to open file for reading: " + (*buffers)[index].path +
+                      " - " + strerror(-result));
+        }
+    };
+
+    auto reap = [&](size_t& index, RingOp& op, int& result) {
+        if (ringFailed || !waitCompletion(ring, index, op, result)) {
+            ringFailed = true;
+            return false;
+        }
+        outstanding--;
+        return true;
+    };
+
+    auto submitRead = [&](size_t i) {
+        struct io_uring_sqe* sqe = acquireSqe(ring);
+        if (!sqe) {
+            fallback[i] = true;
+            return;
+        }
+        // A read's length is 32-bit; larger files take several reads
+        size_t length = std::min((*buffers)[i].data.size() - offsets[i], MAX_RING_READ);
+        io_uring_prep_read(sqe, fds[i], (*buffers)[i].data.data() + offsets[i],
+                           static_cast<unsigned>(length), offsets[i]);
+        io_uring_sqe_set_data(sqe, encodeUserData(i, OP_READ));
+        outstanding++;
+    };
+
+    // Stage 1: open and size every file in the chunk with one submission
+    for (size_t i = 0; i < count; ++i) {
+        (*buffers)[i].path = paths[begin + i];
+
+        struct io_uring_sqe* sqe = acquireSqe(ring);
+        if (!sqe) {
+            fallback[i] = true;
+            continue;
+        }
+        io_uring_prep_openat(sqe, AT_FDCWD, (*buffers)[i].path.c_str(), O_RDONLY | O_CLOEXEC, 0);
+        io_uring_sqe_set_data(sqe, encodeUserData(i, OP_OPEN));
+        outstanding++;
+
+        // Without a size the opened file is closed and read with pread instead
+        sqe = acquireSqe(ring);
+        if (!sqe) {
+            fallback[i] = true;
+            continue;
+        }
+        io_uring_prep_statx(sqe, AT_FDCWD, (*buffers)[i].path.c_str(), 0, STATX_SIZE, &(*stats)[i]);
+        io_uring_sqe_set_data(sqe, encodeUserData(i, OP_STATX));
+        outstanding++;
+    }
+    io_uring_submit(ring);
+
+    while (outstanding > 0) {
+        size_t index;
+        RingOp op;
+        int result;
+        if (!reap(index, op, result)) {
+            break;
+        }
+        if (op == OP_OPEN) {
+            handleOpen(index, result);
+        } else if (op == OP_STATX) {
+            sized[index] = (result == 0);
+            if (!sized[index]) {
+                fallback[index] = true;
+            }
+        }
+    }
+
+    // Stage 2: read every opened file, resubmitting short reads
+    if (!ringFailed) {
+        for (size_t i = 0; i < count; ++i) {
+            if (fds[i] < 0 || !sized[i] || fallback[i]) {
+                continue;
+            }
+            const size_t fileSize = static_cast<size_t>((*stats)[i].stx_size);
+            direct[i] = prepareDescriptor(fds[i], fileSize, m_options);
+            (*buffers)[i].data.resize(direct[i] ? alignUp(fileSize) : fileSize);
+            if (fileSize == 0) {
+                (*buffers)[i].ok = true;
+            } else {
+                submitRead(i);
+            }
+        }
+        io_uring_submit(ring);
+    }
+
+    while (outstanding > 0) {
+        size_t index;
+        RingOp op;
+        int result;
+        if (!reap(index, op, result)) {
+            break;
+        }
+
+        if (result == -EINVAL && direct[index]) {
+            disableDirectIo(fds[index]);
+            direct[index] = false;
+            submitRead(index);
+            io_uring_submit(ring);
+            continue;
+        }
+        if (result < 0) {
+            LOG_ERROR("Failed to read file: " + (*buffers)[index].path + " - " + strerror(-result));
+            continue;
+        }
+
+        offsets[index] += static_cast<size_t>(result);
+        if (result == 0 || offsets[index] >= static_cast<size_t>((*stats)[index].stx_size)) {
+            // Complete, or the file shrank after statx
+            (*buffers)[index].data.resize(offsets[index]);
+            (*buffers)[index].ok = true;
+        } else {
+            submitRead(index);
+            io_uring_submit(ring);
+        }
+    }
+
+    if (ringFailed) {
+        // Reap what is still in flight, recording opened descriptors so they get closed
+        size_t index;
+        RingOp op;
+        int result;
+        while (outstanding > 0 && waitCompletionTimeout(ring, index, op, result)) {
+            outstanding--;
+            if (op == OP_OPEN) {
+                handleOpen(index, result);
+            }
+        }
+        if (outstanding > 0) {
+            // The kernel may still write into this chunk's buffers, so they are
+            // never freed; later batches read with pread
+            LOG_ERROR("Abandoning io_uring with " + std::to_string(outstanding) +
+                      " requests in flight; falling back to pread");
+            io_uring_queue_exit(ring);
+            m_ring.reset();
+            buffers.release();
+            stats.release();
+            buffers = std::make_unique<std::vector<FileBuffer>>(count);
+            for (size_t i = 0; i < count; ++i) {
+                (*buffers)[i].path = paths[begin + i];
+            }
+        }
+
+        // Whatever the ring didn't finish is read again with pread
+        for (size_t i = 0; i < count; ++i) {
+            fallback[i] = fallback[i] || !(*buffers)[i].ok;
+        }
+    }
+
+    // Stage 3: close all descriptors, in one submission while the ring works
+    size_t closes = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (fds[i] < 0) {
+            continue;
+        }
+        releaseDescriptor(fds[i], m_options);
+        struct io_uring_sqe* sqe = ringFailed ? nullptr : acquireSqe(ring);
+        if (!sqe) {
+            close(fds[i]);
+            continue;
+        }
+        io_uring_prep_close(sqe, fds[i]);
+        io_uring_sqe_set_data(sqe, encodeUserData(i, OP_CLOSE));
+        closes++;
+    }
+    if (closes > 0) {
+        outstanding = closes;
+        io_uring_submit(ring);
+        size_t index;
+        RingOp op;
+        int result;
+        while (outstanding > 0 && reap(index, op, result)) {
+            // Nothing to record for a close
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (fallback[i]) {
+            readFile((*buffers)[i].path, (*buffers)[i], m_options);
+        }
+        onComplete(std::move((*buffers)[i]));
+    }
+}
+#else
+void FileReader::readChunkUring(const std::vector<std::string>&, size_t, size_t,
+                                const std::function<void(FileBuffer&&)>&) {
+    // Never reached: m_ring is only set when built with liburing
+}
+#endif
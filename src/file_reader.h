@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <new>
+
+// Alignment required for O_DIRECT buffers, offsets and lengths
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+
+// Allocator handing out page-aligned storage so buffers can be read with O_DIRECT
+template<class T>
+struct PageAlignedAllocator {
+    using value_type = T;
+
+    PageAlignedAllocator() = default;
+    template<class U> PageAlignedAllocator(const PageAlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(DIRECT_IO_ALIGNMENT)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(DIRECT_IO_ALIGNMENT));
+    }
+
+    template<class U> bool operator==(const PageAlignedAllocator<U>&) const { return true; }
+    template<class U> bool operator!=(const PageAlignedAllocator<U>&) const { return false; }
+};
+
+// Contents of a source file read fully into memory
+struct FileBuffer {
+    std::string path;
+    std::vector<unsigned char, PageAlignedAllocator<unsigned char>> data;
+    bool ok = false;
+};
+
+// Page-cache behaviour for source reads
+struct FileReadOptions {
+    // Drop the file's pages from the page cache once it has been read
+    bool dropCache = true;
+    
+    // Files at least this large are read with O_DIRECT (0 disables)
+    size_t directIoThreshold = 0;
+};
+
+// Forward declaration of the io_uring state (only defined when built with liburing)
+struct FileReaderRing;
+
+class FileReader {
+public:
+    // queueDepth is the number of files kept in flight per batch
+    explicit FileReader(size_t queueDepth = 32,
+                        const FileReadOptions& options = FileReadOptions());
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // Whether batches are submitted through io_uring or read with pread
+    bool usingIoUring() const;
+
+    size_t getQueueDepth() const;
+
+    // Read all files, invoking onComplete once per file as soon as its batch completes
+    void readBatch(const std::vector<std::string>& paths,
+                   const std::function<void(FileBuffer&&)>& onComplete);
+
+    // Read a single file with open/fstat/pread (the fallback path)
+    static bool readFile(const std::string& path, FileBuffer& buffer,
+                         const FileReadOptions& options = FileReadOptions());
+
+private:
+    void readChunkUring(const std::vector<std::string>& paths,
+                        size_t begin, size_t end,
+                        const std::function<void(FileBuffer&&)>& onComplete);
+
+    size_t m_queueDepth;
+    FileReadOptions m_options;
+    std::unique_ptr<FileReaderRing> m_ring;
+};
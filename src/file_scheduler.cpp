@@ -0,0 +1,140 @@
+#include "file_scheduler.h"
+
+#include <algorithm>
+
+bool parseSchedulePolicy(const std::string& name, SchedulePolicy& policy) {
+    if (name == "fifo") {
+        policy = SchedulePolicy::FIFO;
+    } else if (name == "largest") {
+        policy = SchedulePolicy::LARGEST_FIRST;
+    } else if (name == "study") {
+        policy = SchedulePolicy::STUDY_COMPLETION;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::string schedulePolicyName(SchedulePolicy policy) {
+    switch (policy) {
+        case SchedulePolicy::FIFO:
+            return "fifo";
+        case SchedulePolicy::LARGEST_FIRST:
+            return "largest";
+        case SchedulePolicy::STUDY_COMPLETION:
+            return "study";
+    }
+    return "";
+}
+
+FileScheduler::FileScheduler(SchedulePolicy policy, size_t capacity)
+    : m_policy(policy),
+      m_capacity(std::max<size_t>(capacity, 1)),
+      m_closed(false),
+      m_nextSequence(0),
+      m_queued(0) {
+}
+
+bool FileScheduler::push(InstanceRecord instance) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_queued < m_capacity; });
+        if (m_closed) {
+            return false;
+        }
+
+        m_remaining[instance.studyUid]++;
+        Entry entry{std::move(instance), m_nextSequence++};
+        if (m_policy == SchedulePolicy::STUDY_COMPLETION) {
+            m_studyQueues[entry.instance.studyUid].push_back(std::move(entry));
+        } else {
+            m_heap.push_back(std::move(entry));
+            std::push_heap(m_heap.begin(), m_heap.end(),
+                           [this](const Entry& a, const Entry& b) { return runsAfter(a, b); });
+        }
+        m_queued++;
+    }
+    m_notEmpty.notify_one();
+    return true;
+}
+
+bool FileScheduler::popBatch(std::vector<InstanceRecord>& instances, size_t maxItems) {
+    instances.clear();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || m_queued > 0; });
+        while (m_queued > 0 && instances.size() < std::max<size_t>(maxItems, 1)) {
+            instances.push_back(takeNext());
+        }
+    }
+    m_notFull.notify_all();
+    return !instances.empty();
+}
+
+void FileScheduler::complete(const std::string& studyUid) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_remaining.find(studyUid);
+    if (it != m_remaining.end() && --it->second == 0) {
+        m_remaining.erase(it);
+    }
+}
+
+void FileScheduler::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_notEmpty.notify_all();
+    m_notFull.notify_all();
+}
+
+size_t FileScheduler::size() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queued;
+}
+
+size_t FileScheduler::remaining(const std::string& studyUid) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_remaining.find(studyUid);
+    return it == m_remaining.end() ? 0 : it->second;
+}
+
+InstanceRecord FileScheduler::takeNext() {
+    m_queued--;
+    if (m_policy != SchedulePolicy::STUDY_COMPLETION) {
+        std::pop_heap(m_heap.begin(), m_heap.end(),
+                      [this](const Entry& a, const Entry& b) { return runsAfter(a, b); });
+        InstanceRecord instance = std::move(m_heap.back().instance);
+        m_heap.pop_back();
+        return instance;
+    }
+
+    // Fewest files left to upload wins; ties go to the study that was found first
+    auto next = m_studyQueues.end();
+    for (auto it = m_studyQueues.begin(); it != m_studyQueues.end(); ++it) {
+        if (next == m_studyQueues.end()) {
+            next = it;
+            continue;
+        }
+        size_t left = m_remaining[it->first];
+        size_t nextLeft = m_remaining[next->first];
+        if (left < nextLeft ||
+            (left == nextLeft && it->second.front().sequence < next->second.front().sequence)) {
+            next = it;
+        }
+    }
+
+    InstanceRecord instance = std::move(next->second.front().instance);
+    next->second.pop_front();
+    if (next->second.empty()) {
+        m_studyQueues.erase(next);
+    }
+    return instance;
+}
+
+bool FileScheduler::runsAfter(const Entry& a, const Entry& b) const {
+    if (m_policy == SchedulePolicy::LARGEST_FIRST && a.instance.size != b.instance.size) {
+        return a.instance.size < b.instance.size;
+    }
+    return a.sequence > b.sequence;
+}
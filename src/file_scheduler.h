@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "study_record.h"
+
+// Order in which queued files across all studies are handed to uploaders
+enum class SchedulePolicy {
+    FIFO,               // discovery order
+    LARGEST_FIRST,      // biggest files first, so the last upload to finish is a small one
+    STUDY_COMPLETION    // files of the study closest to done first, so studies become available sooner
+};
+
+// Parse "fifo", "largest" or "study"; false for anything else
+bool parseSchedulePolicy(const std::string& name, SchedulePolicy& policy);
+
+std::string schedulePolicyName(SchedulePolicy policy);
+
+// Global, bounded queue of files waiting for upload, flattened across studies.
+// Files are reordered by the policy within the queue's window; per-study
+// counters track files queued or in flight until the uploader completes them.
+class FileScheduler {
+public:
+    FileScheduler(SchedulePolicy policy, size_t capacity);
+
+    FileScheduler(const FileScheduler&) = delete;
+    FileScheduler& operator=(const FileScheduler&) = delete;
+
+    // Wait for space and queue a file; instance.size is used for LARGEST_FIRST.
+    // False if the scheduler was closed.
+    bool push(InstanceRecord instance);
+
+    // Wait for work and take up to maxItems files in policy order; false once closed and empty
+    bool popBatch(std::vector<InstanceRecord>& instances, size_t maxItems);
+
+    // A popped file of the study has been uploaded or given up on
+    void complete(const std::string& studyUid);
+
+    // No more files will be pushed
+    void close();
+
+    // Files queued and not yet popped
+    size_t size() const;
+
+    // Files of the study queued or in flight
+    size_t remaining(const std::string& studyUid) const;
+
+private:
+    struct Entry {
+        InstanceRecord instance;
+        uint64_t sequence;
+    };
+
+    // Remove the next file under the policy (m_mutex held, queue not empty)
+    InstanceRecord takeNext();
+
+    // Heap order for FIFO and LARGEST_FIRST: true if a runs after b
+    bool runsAfter(const Entry& a, const Entry& b) const;
+
+    SchedulePolicy m_policy;
+    size_t m_capacity;
+    bool m_closed;
+    uint64_t m_nextSequence;
+    size_t m_queued;
+
+    // FIFO and LARGEST_FIRST keep one heap; STUDY_COMPLETION keeps a queue per study
+    std::vector<Entry> m_heap;
+    std::map<std::string, std::deque<Entry>> m_studyQueues;
+    std::map<std::string, size_t> m_remaining;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+};
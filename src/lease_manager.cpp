@@ -0,0 +1,142 @@
+#include "lease_manager.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <vector>
+#include <unistd.h>
+
+LeaseManager::LeaseManager(DynamoDBManager& dbManager,
+                           const std::string& tableName,
+                           std::chrono::seconds leaseDuration)
+    : m_dbManager(dbManager),
+      m_tableName(tableName),
+      m_leaseDuration(leaseDuration),
+      m_stop(false) {
+    char hostname[256] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+    m_owner = std::string(hostname) + ":" + std::to_string(getpid()) + ":" +
+              Utils::generateUuid().substr(0, 8);
+}
+
+LeaseManager::~LeaseManager() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_stopRequested.notify_all();
+    if (m_heartbeat.joinable()) {
+        m_heartbeat.join();
+    }
+
+    // Unfinished studies go back to the pool without waiting for expiry
+    for (const auto& studyUid : m_held) {
+        m_dbManager.releaseLease(m_tableName, studyUid, m_owner);
+    }
+}
+
+bool LeaseManager::start() {
+    if (!m_dbManager.createLeaseTableIfNotExists(m_tableName)) {
+        LOG_ERROR("Failed to create lease table: " + DynamoDBManager::leaseTableName(m_tableName));
+        return false;
+    }
+    m_heartbeat = std::thread(&LeaseManager::heartbeatLoop, this);
+    LOG_INFO("Leasing studies as " + m_owner + " for " +
+             std::to_string(m_leaseDuration.count()) + "s at a time");
+    return true;
+}
+
+const std::string& LeaseManager::getOwner() const {
+    return m_owner;
+}
+
+DynamoDBManager::LeaseResult LeaseManager::claim(const std::string& studyUid) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held.count(studyUid)) {
+            return DynamoDBManager::LeaseResult::ACQUIRED;
+        }
+    }
+
+    auto result = m_dbManager.acquireLease(m_tableName, studyUid, m_owner, m_leaseDuration);
+    if (result == DynamoDBManager::LeaseResult::ACQUIRED) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_held.insert(studyUid);
+        LOG_INFO("Leased study: " + studyUid);
+    }
+    return result;
+}
+
+void LeaseManager::complete(const std::string& studyUid) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held.erase(studyUid) == 0) {
+            return;
+        }
+    }
+    m_dbManager.completeLease(m_tableName, studyUid, m_owner);
+}
+
+void LeaseManager::release(const std::string& studyUid) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held.erase(studyUid) == 0) {
+            return;
+        }
+    }
+    m_dbManager.releaseLease(m_tableName, studyUid, m_owner);
+}
+
+bool LeaseManager::renewForCommit(const std::string& studyUid) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held.count(studyUid) == 0) {
+            return false;
+        }
+    }
+
+    auto result = m_dbManager.renewLease(m_tableName, studyUid, m_owner, m_leaseDuration);
+    if (result == DynamoDBManager::LeaseResult::ACQUIRED) {
+        return true;
+    }
+    if (result == DynamoDBManager::LeaseResult::HELD_ELSEWHERE) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_held.erase(studyUid)) {
+            LOG_WARNING("Lost lease on study: " + studyUid);
+        }
+    } else {
+        LOG_ERROR("Could not confirm the lease on study before committing it: " + studyUid);
+    }
+    return false;
+}
+
+size_t LeaseManager::getHeldCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_held.size();
+}
+
+void LeaseManager::heartbeatLoop() {
+    const auto interval = std::max<std::chrono::seconds>(m_leaseDuration / 3, std::chrono::seconds(1));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopRequested.wait_for(lock, interval, [this] { return m_stop; })) {
+        std::vector<std::string> held(m_held.begin(), m_held.end());
+        lock.unlock();
+
+        std::vector<std::string> lost;
+        for (const auto& studyUid : held) {
+            // A failed call is retried next beat; only a failed condition means the lease is gone
+            auto result = m_dbManager.renewLease(m_tableName, studyUid, m_owner, m_leaseDuration);
+            if (result == DynamoDBManager::LeaseResult::HELD_ELSEWHERE) {
+                lost.push_back(studyUid);
+            }
+        }
+
+        lock.lock();
+        for (const auto& studyUid : lost) {
+            // Not a loss if the study was completed or released meanwhile
+            if (m_held.erase(studyUid)) {
+                LOG_WARNING("Lost lease on study: " + studyUid);
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+#include "dynamodb_manager.h"
+
+// Dynamic split of studies across workers through conditional-write leases in
+// the lease table. A worker claims a study before uploading it and renews every
+// lease it holds from a heartbeat thread; if it dies, its leases lapse and
+// another worker claims the studies. Completed studies are marked done.
+class LeaseManager {
+public:
+    LeaseManager(DynamoDBManager& dbManager,
+                 const std::string& tableName,
+                 std::chrono::seconds leaseDuration);
+    ~LeaseManager();
+
+    LeaseManager(const LeaseManager&) = delete;
+    LeaseManager& operator=(const LeaseManager&) = delete;
+
+    // Create the lease table if needed and start heartbeats
+    bool start();
+
+    // Identity written into leases: host, process and a random suffix
+    const std::string& getOwner() const;
+
+    // Claim a study, or confirm a lease already held
+    DynamoDBManager::LeaseResult claim(const std::string& studyUid);
+
+    // Mark a held study done and stop renewing it
+    void complete(const std::string& studyUid);
+
+    // Give up a held study so another worker can retry it
+    void release(const std::string& studyUid);
+
+    // Renew a held study's lease right before publishing it, so it can't lapse
+    // to another worker mid-commit. False, and the lease is dropped, unless
+    // this worker still owns it; the study must then not be published.
+    bool renewForCommit(const std::string& studyUid);
+
+    size_t getHeldCount() const;
+
+private:
+    // Renew held leases every third of the lease duration until stopped
+    void heartbeatLoop();
+
+    DynamoDBManager& m_dbManager;
+    std::string m_tableName;
+    std::chrono::seconds m_leaseDuration;
+    std::string m_owner;
+
+    std::set<std::string> m_held;
+    bool m_stop;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stopRequested;
+    std::thread m_heartbeat;
+};
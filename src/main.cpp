@@ -6,6 +6,20 @@
 #include "logger.h"
 #include "profiler.h"
 #include "utils.h"
+#include "file_reader.h"
+#include "upload_journal.h"
+#include "metadata_sink.h"
+#include "metadata_cache.h"
+#include "study_manifest.h"
+#include "upload_pipeline.h"
+#include "download_progress.h"
+#include "directory_watcher.h"
+#include "study_shard.h"
+#include "lease_manager.h"
+#include "sync_planner.h"
+#include "file_list.h"
+#include "memory_budget.h"
+#include "run_deadline.h"
 
 #include <iostream>
 #include <string>
@@ -15,6 +29,12 @@
 #include <map>
 #include <filesystem>
 #include <fstream>
+#include <algorithm>
+#include <deque>
+#include <csignal>
+#include <set>
+#include <memory>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -23,9 +43,68 @@ const std::string S3_BUCKET_NAME = "dicom-transfer-bucket";
 const std::string DYNAMODB_TABLE_NAME = "dicom-studies";
 const std::string AWS_REGION = "ap-south-1";
 
+// Local journal of uploaded files whose DynamoDB locations are not yet written
+const std::string UPLOAD_JOURNAL_PATH = "dicom_transfer.journal";
+
+// Number of source files read per batched submission
+const size_t READ_QUEUE_DEPTH = 32;
+
+// Local cache of study metadata and file listings for repeat downloads
+const std::string METADATA_CACHE_DIR = ".dicom_transfer_cache";
+
+// Record of finished studies kept in a download list's output directory
+const std::string DOWNLOAD_PROGRESS_FILE = ".download_progress";
+
+// Studies of a download list planned ahead of the one being waited on
+const size_t MAX_STUDIES_IN_FLIGHT = 8;
+
+// Watch mode: a file nobody closes is taken after this long without writes,
+// and the watcher wakes at least this often to finalize idle studies
+const std::chrono::seconds WATCH_QUIET_PERIOD(30);
+const std::chrono::milliseconds WATCH_POLL_INTERVAL(1000);
+
+// DynamoDB writers behind uploads, and how many writes may queue before uploads wait
+const size_t METADATA_SINK_WORKERS = 2;
+const size_t METADATA_SINK_CAPACITY = 4096;
+
+// Sharded uploads: how long a study lease lasts without a heartbeat, and how
+// often a worker checks whether studies other workers hold have lapsed
+const std::chrono::seconds STUDY_LEASE_DURATION(60);
+const std::chrono::seconds LEASE_RECHECK_INTERVAL(20);
+
+// DynamoDB service URL override (e.g. a local stand-in); empty uses the region's endpoint
+std::string g_dynamoDbEndpoint;
+
+// Upload and watch mode settings from the command line
+struct UploadOptions {
+    int threadCount = 1;
+    size_t directIoThreshold = 0;
+    int cacheTtl = 0;
+    bool onDemandBilling = false;
+    bool compressMetadata = false;
+    SchedulePolicy schedulePolicy = SchedulePolicy::LARGEST_FIRST;
+    bool watch = false;
+    int idleTimeout = 0;
+    StudyShard shard;
+    bool useLeases = false;
+    bool sync = false;
+    bool fileList = false;   // The source path is a file list (or - for stdin)
+    uint64_t prefetchBudget = 0;
+    RunDeadline deadline;
+    uint64_t maxMemory = 0;  // 0 when unlimited
+};
+
 // Forward declarations
-bool uploadMode(const std::string& sourcePath, int threadCount);
-bool downloadMode(const std::string& studyUid, const std::string& outputPath, int threadCount);
+bool uploadMode(const std::string& sourcePath, const UploadOptions& options);
+bool downloadMode(const std::string& studyUid, const std::string& outputPath, int threadCount,
+                  int cacheTtl);
+bool downloadListMode(const std::string& listPath, const std::string& outputPath, int threadCount,
+                      int cacheTtl);
+bool queryMode(const StudyQuery& query, const std::string& outputPath, int threadCount,
+               int cacheTtl);
+bool copyMode(const std::string& studyUid, const std::string& destinationBucket,
+              const std::string& destinationRegion, const std::string& destinationTable,
+              int threadCount);
 
 int main(int argc, char* argv[]) {
     // Parse command-line arguments
@@ -49,6 +128,7 @@ int main(int argc, char* argv[]) {
     }
     
     bool success = false;
+    g_dynamoDbEndpoint = parser.getDynamoDbEndpoint();
     
     // Start profiling
     Profiler::getInstance().startOperation("Total Execution");
@@ -57,11 +137,52 @@ int main(int argc, char* argv[]) {
         // Execute the appropriate mode
         switch (parser.getMode()) {
             case CommandMode::UPLOAD:
-                success = uploadMode(parser.getSourcePath(), parser.getThreadCount());
+            case CommandMode::WATCH:
+            case CommandMode::SYNC:
+            case CommandMode::FILE_LIST: {
+                UploadOptions options;
+                options.threadCount = parser.getThreadCount();
+                options.directIoThreshold = parser.getDirectIoThreshold();
+                options.cacheTtl = parser.getCacheTtl();
+                options.onDemandBilling = parser.isOnDemandBilling();
+                options.compressMetadata = parser.isCompressedMetadata();
+                options.schedulePolicy = parser.getSchedulePolicy();
+                options.watch = parser.getMode() == CommandMode::WATCH;
+                options.idleTimeout = parser.getIdleTimeout();
+                options.shard = parser.getShard();
+                options.useLeases = parser.isUsingLeases();
+                options.sync = parser.getMode() == CommandMode::SYNC;
+                options.fileList = parser.getMode() == CommandMode::FILE_LIST;
+                options.prefetchBudget = parser.getPrefetchBudget();
+                options.deadline = parser.getDeadline();
+                options.maxMemory = parser.getMaxMemory();
+                success = uploadMode(parser.getSourcePath(), options);
                 break;
+            }
                 
             case CommandMode::DOWNLOAD:
-                success = downloadMode(parser.getStudyUid(), parser.getOutputPath(), parser.getThreadCount());
+                success = downloadMode(parser.getStudyUid(), parser.getOutputPath(), parser.getThreadCount(),
+                                       parser.getCacheTtl());
+                break;
+                
+            case CommandMode::DOWNLOAD_LIST:
+                success = downloadListMode(parser.getStudyListPath(), parser.getOutputPath(),
+                                           parser.getThreadCount(), parser.getCacheTtl());
+                break;
+                
+            case CommandMode::QUERY:
+                success = queryMode(parser.getStudyQuery(), parser.getOutputPath(), parser.getThreadCount(),
+                                    parser.getCacheTtl());
+                break;
+                
+            case CommandMode::COPY:
+                success = copyMode(parser.getStudyUid(), parser.getDestinationBucket(),
+                                   parser.getDestinationRegion().empty() ? AWS_REGION
+                                                                         : parser.getDestinationRegion(),
+                                   parser.getDestinationTable().empty()
+                                       ? DYNAMODB_TABLE_NAME + "-" + parser.getDestinationBucket()
+                                       : parser.getDestinationTable(),
+                                   parser.getThreadCount());
                 break;
                 
             default:
@@ -85,174 +206,513 @@ int main(int argc, char* argv[]) {
     return success ? 0 : 1;
 }
 
-bool uploadMode(const std::string& sourcePath, int threadCount) {
-    LOG_INFO("Starting upload mode with source path: " + sourcePath);
-    LOG_INFO("Using " + std::to_string(threadCount) + " threads");
+// Store a study's manifest in S3, merged with the instances earlier uploads recorded
+bool writeStudyManifest(S3Manager& s3Manager,
+                        DynamoDBManager& dbManager,
+                        const StudyRecord& studyRecord,
+                        const std::vector<InstanceRecord>& uploadedInstances) {
+    const std::string& studyUid = studyRecord.studyInstanceUid;
+    const std::string manifestKey = StudyManifest::objectKey(studyUid);
     
-    // Check if source path exists and is a directory
-    if (!Utils::isDirectory(sourcePath)) {
-        LOG_ERROR("Source path is not a valid directory: " + sourcePath);
+    std::string existingData;
+    StudyRecord existingRecord;
+    std::vector<InstanceRecord> existingInstances;
+    if (!s3Manager.downloadBuffer(S3_BUCKET_NAME, manifestKey, existingData) ||
+        !StudyManifest::decode(existingData, studyUid, existingRecord, existingInstances)) {
+        // First manifest for this study: include instances uploaded before manifests existed
+        if (!dbManager.getInstances(DYNAMODB_TABLE_NAME, studyUid, existingInstances)) {
+            return false;
+        }
+    }
+    
+    std::map<std::string, InstanceRecord> merged;
+    for (const auto& instance : existingInstances) {
+        merged[instance.instanceKey()] = instance;
+    }
+    for (const auto& instance : uploadedInstances) {
+        merged[instance.instanceKey()] = instance;
+    }
+    
+    std::vector<InstanceRecord> instances;
+    for (auto& entry : merged) {
+        instances.push_back(std::move(entry.second));
+    }
+    sortInstances(instances);
+    
+    std::string data = StudyManifest::encode(studyRecord, instances);
+    return s3Manager.uploadBuffer(S3_BUCKET_NAME,
+                                  reinterpret_cast<const unsigned char*>(data.data()),
+                                  data.size(), manifestKey);
+}
+
+// Whether a manifest or cached listing is the study's committed upload: the study
+// item must be committed and, where it records a checksum, list the same instances
+bool isCommittedListing(DynamoDBManager& dbManager,
+                        const std::string& studyUid,
+                        const std::vector<InstanceRecord>& instances) {
+    std::string checksum;
+    if (!dbManager.getCommittedChecksum(DYNAMODB_TABLE_NAME, studyUid, checksum)) {
+        return false;
+    }
+    return checksum.empty() || checksum == instancesChecksum(instances);
+}
+
+// Plan a study's download from its S3 manifest; false if it has none or it
+// doesn't match the committed study
+bool loadStudyManifest(S3Manager& s3Manager,
+                       DynamoDBManager& dbManager,
+                       const std::string& studyUid,
+                       StudyRecord& studyRecord,
+                       std::vector<InstanceRecord>& instances) {
+    std::string data;
+    if (!s3Manager.downloadBuffer(S3_BUCKET_NAME, StudyManifest::objectKey(studyUid), data)) {
+        return false;
+    }
+    StudyRecord manifestRecord;
+    std::vector<InstanceRecord> manifestInstances;
+    if (!StudyManifest::decode(data, studyUid, manifestRecord, manifestInstances)) {
+        LOG_WARNING("Ignoring unreadable manifest for study: " + studyUid);
+        return false;
+    }
+    if (!isCommittedListing(dbManager, studyUid, manifestInstances)) {
+        LOG_INFO("Ignoring manifest that is not the committed upload of study: " + studyUid);
+        return false;
+    }
+    studyRecord = std::move(manifestRecord);
+    instances = std::move(manifestInstances);
+    return true;
+}
+
+// Landing directory watch: stop on SIGINT/SIGTERM after finalizing open studies
+volatile std::sig_atomic_t g_stopRequested = 0;
+
+void requestStop(int) {
+    g_stopRequested = 1;
+}
+
+// Feed files from a landing directory into a started pipeline until asked to stop
+bool watchLandingDirectory(UploadPipeline& pipeline, const std::string& sourcePath,
+                           const RunDeadline& deadline) {
+    DirectoryWatcher watcher(sourcePath, WATCH_QUIET_PERIOD);
+    if (!watcher.isOpen()) {
+        LOG_ERROR("Failed to watch landing directory: " + sourcePath);
         return false;
     }
     
-    // Initialize components
-    S3Manager s3Manager(AWS_REGION);
-    DynamoDBManager dbManager(AWS_REGION);
-    DicomProcessor dicomProcessor;
-    ThreadPool threadPool(threadCount);
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
     
-    // Create vector to store all upload results
-    std::vector<std::future<bool>> studyUploadResults;
+    // Files that landed while no watcher was running
+    pipeline.submit(sourcePath);
+    LOG_INFO("Watching " + std::to_string(watcher.getWatchCount()) + " directories under: " + sourcePath);
     
-    // List all files in the source directory
-    std::vector<std::string> allFiles = Utils::listFilesInDirectory(sourcePath, true);
-    LOG_INFO("Found " + std::to_string(allFiles.size()) + " files to process");
+    while (!g_stopRequested && !deadline.passed()) {
+        watcher.poll(WATCH_POLL_INTERVAL, [&](const std::string& path) {
+            pipeline.submit(path);
+        });
+        pipeline.finalizeIdle();
+    }
     
-    // Filter and group DICOM files by study
-    std::vector<std::string> dicomFiles;
-    for (const auto& file : allFiles) {
-        if (dicomProcessor.isDicomFile(file)) {
-            dicomFiles.push_back(file);
+    LOG_INFO("Stopping watch; finalizing open studies");
+    return true;
+}
+
+// Studies another worker held when this one reached them, with their files
+struct DeferredStudies {
+    std::mutex mutex;
+    std::map<std::string, std::vector<std::string>> files;
+    std::set<std::string> done;
+};
+
+// Parser-side lease check: upload a study only under this worker's lease
+bool claimStudyFile(LeaseManager& leaseManager, DeferredStudies& deferred,
+                    const InstanceRecord& instance) {
+    const std::string& studyUid = instance.studyUid;
+    {
+        std::lock_guard<std::mutex> lock(deferred.mutex);
+        auto it = deferred.files.find(studyUid);
+        if (it != deferred.files.end()) {
+            it->second.push_back(instance.sourcePath);
+            return false;
+        }
+        if (deferred.done.count(studyUid)) {
+            return false;
         }
     }
-    LOG_INFO("Found " + std::to_string(dicomFiles.size()) + " DICOM files");
     
-    auto studyGroups = dicomProcessor.groupFilesByStudy(dicomFiles);
-    LOG_INFO("Grouped into " + std::to_string(studyGroups.size()) + " studies");
+    auto result = leaseManager.claim(studyUid);
+    if (result == DynamoDBManager::LeaseResult::ACQUIRED) {
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(deferred.mutex);
+    if (result == DynamoDBManager::LeaseResult::DONE) {
+        deferred.done.insert(studyUid);
+    } else {
+        deferred.files[studyUid].push_back(instance.sourcePath);
+    }
+    return false;
+}
 
-    // Process each study
-    for (const auto& [studyUid, studyFiles] : studyGroups) {
-        // Submit study processing task to thread pool
-        studyUploadResults.push_back(
-            threadPool.enqueue([&, studyUid, studyFiles]() {
-                LOG_INFO("Processing study: " + studyUid + " with " + 
-                         std::to_string(studyFiles.size()) + " files");
-                
-                // Process metadata first
-                Json::Value metadata;
-                if (!dicomProcessor.extractMetadata(studyFiles[0], metadata)) {
-                    LOG_ERROR("Failed to extract metadata for study: " + studyUid);
-                    return false;
+// Take over deferred studies whose owners stop renewing their leases, until
+// every one is done. Each is attempted at most once by this worker.
+bool uploadDeferredStudies(LeaseManager& leaseManager, DeferredStudies& deferred,
+                           const RunDeadline& deadline,
+                           const std::function<std::unique_ptr<UploadPipeline>()>& makePipeline) {
+    bool success = true;
+    while (!deadline.passed()) {
+        std::map<std::string, std::vector<std::string>> claimed;
+        {
+            std::lock_guard<std::mutex> lock(deferred.mutex);
+            for (auto it = deferred.files.begin(); it != deferred.files.end(); ) {
+                auto result = leaseManager.claim(it->first);
+                if (result == DynamoDBManager::LeaseResult::HELD_ELSEWHERE) {
+                    ++it;
+                    continue;
                 }
-                
-                if (!dbManager.storeStudyMetadata(DYNAMODB_TABLE_NAME, studyUid, metadata)) {
-                    LOG_ERROR("Failed to store metadata in DynamoDB for study: " + studyUid);
-                    return false;
+                if (result == DynamoDBManager::LeaseResult::ACQUIRED) {
+                    claimed.insert(std::move(*it));
+                } else if (result == DynamoDBManager::LeaseResult::FAILED) {
+                    LOG_ERROR("Giving up on study after lease errors: " + it->first);
+                    success = false;
                 }
+                it = deferred.files.erase(it);
+            }
+            if (claimed.empty() && deferred.files.empty()) {
+                break;
+            }
+        }
+        
+        if (claimed.empty()) {
+            LOG_INFO("Waiting on studies leased by other workers");
+            std::this_thread::sleep_for(LEASE_RECHECK_INTERVAL);
+            continue;
+        }
+        
+        LOG_INFO("Taking over " + std::to_string(claimed.size()) + " studies from lapsed leases");
+        auto pipeline = makePipeline();
+        pipeline->start();
+        for (const auto& [studyUid, paths] : claimed) {
+            for (const auto& path : paths) {
+                pipeline->submit(path);
+            }
+        }
+        success &= pipeline->finish();
+    }
+    return success;
+}
 
-                // Create a separate thread pool for file uploads within this study
-                ThreadPool fileUploadPool(std::min(threadCount, 4));  // Limit concurrent uploads per study
-                std::vector<std::future<bool>> fileUploadResults;
-                
-                // Upload each file in the study
-                for (const auto& file : studyFiles) {
-                    std::string s3Key = Utils::generateS3Key(studyUid, file);
-                    fileUploadResults.push_back(
-                        fileUploadPool.enqueue([&, file, s3Key]() {
-                            if (!s3Manager.uploadFile(S3_BUCKET_NAME, file, s3Key)) {
-                                LOG_ERROR("Failed to upload file: " + file);
-                                return false;
-                            }
-                            if (!dbManager.storeFileLocation(DYNAMODB_TABLE_NAME, studyUid, s3Key)) {
-                                LOG_ERROR("Failed to store file location: " + s3Key);
-                                return false;
-                            }
-                            LOG_DEBUG("Successfully uploaded: " + file);
-                            return true;
-                        })
-                    );
-                }
-                
-                // Wait for all file uploads in this study to complete
-                bool allFilesUploaded = true;
-                for (auto& future : fileUploadResults) {
-                    if (!future.get()) {
-                        allFilesUploaded = false;
-                        LOG_ERROR("One or more files failed to upload in study: " + studyUid);
-                    }
-                }
-                
-                return allFilesUploaded;
-            })
-        );
+// Feed a pipeline from a file list, streamed so memory stays flat however long
+// it is. Entries that name their study skip the DICOM parse, and a study is
+// closed as soon as the list moves on to another one.
+bool uploadFileList(UploadPipeline& pipeline, const std::string& listPath,
+                    const RunDeadline& deadline) {
+    std::ifstream listFile;
+    if (listPath != "-") {
+        listFile.open(listPath);
+        if (!listFile.is_open()) {
+            LOG_ERROR("Failed to open file list: " + listPath);
+            return false;
+        }
     }
+    FileListReader reader(listPath == "-" ? std::cin : listFile);
     
-    // Wait for all studies to complete
-    bool success = true;
-    for (auto& future : studyUploadResults) {
-        if (!future.get()) {
-            success = false;
-            LOG_ERROR("One or more studies failed to process");
+    pipeline.start();
+    FileListEntry entry;
+    std::string currentStudy;
+    while (!deadline.passed() && reader.next(entry)) {
+        if (entry.studyUid.empty()) {
+            pipeline.submit(entry.path);
+            continue;
+        }
+        if (entry.studyUid != currentStudy) {
+            if (!currentStudy.empty()) {
+                pipeline.closeStudy(currentStudy);
+            }
+            currentStudy = entry.studyUid;
         }
+        InstanceRecord instance;
+        instance.sourcePath = entry.path;
+        instance.studyUid = entry.studyUid;
+        instance.size = entry.size;
+        pipeline.submitInstance(instance);
     }
     
+    bool success = pipeline.finish();
+    if (reader.getSkippedLines() > 0) {
+        LOG_ERROR("Skipped " + std::to_string(reader.getSkippedLines()) + " malformed file list lines");
+        success = false;
+    }
     return success;
 }
 
-bool downloadMode(const std::string& studyUid, const std::string& outputPath, int threadCount) {
-    LOG_INFO("Starting download mode for study: " + studyUid);
-    LOG_INFO("Output path: " + outputPath);
-    LOG_INFO("Using " + std::to_string(threadCount) + " threads");
+// Show what a sync will transfer before it starts
+void printSyncPlan(const SyncPlan& plan) {
+    std::cout << "Sync plan for " << plan.studies << " studies:" << std::endl;
+    std::cout << "  up to date:  " << plan.upToDate << " files" << std::endl;
+    std::cout << "  new:         " << plan.newFiles << " files" << std::endl;
+    std::cout << "  changed:     " << plan.changedFiles << " files" << std::endl;
+    std::cout << "  index only:  " << plan.indexOnly.size() << " files already in S3" << std::endl;
+    std::cout << "  to transfer: " << plan.uploads.size() << " files, "
+              << Utils::bytesToHumanReadable(plan.uploadBytes) << std::endl;
+}
+
+// Write the instance items and manifest entries of objects a sync found already in S3.
+// A study that also has files to upload is left pending; the pipeline commits it
+// once those settle.
+bool indexExistingObjects(S3Manager& s3Manager, DynamoDBManager& dbManager,
+                          MetadataCache& metadataCache,
+                          const std::vector<InstanceRecord>& instances,
+                          const std::set<std::string>& uploadingStudies) {
+    std::map<std::string, std::vector<InstanceRecord>> instancesByStudy;
+    for (const auto& instance : instances) {
+        instancesByStudy[instance.studyUid].push_back(instance);
+    }
     
-    // Create base output directory if it doesn't exist
-    if (!Utils::createDirectoryIfNotExists(outputPath)) {
-        LOG_ERROR("Failed to create output directory: " + outputPath);
-        return false;
+    DicomProcessor dicomProcessor;
+    bool success = true;
+    for (const auto& [studyUid, studyInstances] : instancesByStudy) {
+        StudyRecord studyRecord;
+        if (!dicomProcessor.extractStudyRecord(studyInstances.front().sourcePath, studyRecord)) {
+            LOG_ERROR("Failed to extract metadata for study: " + studyUid);
+            success = false;
+            continue;
+        }
+        studyRecord.studyInstanceUid = studyUid;
+        
+        for (const auto& instance : studyInstances) {
+            dbManager.queueInstance(DYNAMODB_TABLE_NAME, instance);
+        }
+        if (!dbManager.storeStudyRecord(DYNAMODB_TABLE_NAME, studyRecord) ||
+            !dbManager.flushFileLocations(DYNAMODB_TABLE_NAME, studyUid)) {
+            LOG_ERROR("Failed to store metadata in DynamoDB for study: " + studyUid);
+            success = false;
+            continue;
+        }
+        if (uploadingStudies.count(studyUid)) {
+            LOG_INFO("Indexed " + std::to_string(studyInstances.size()) +
+                     " existing objects for study: " + studyUid + "; it commits after its uploads");
+            continue;
+        }
+        if (!dbManager.markStudyCommitted(DYNAMODB_TABLE_NAME, studyUid)) {
+            LOG_ERROR("Failed to commit study in DynamoDB: " + studyUid);
+            success = false;
+            continue;
+        }
+        metadataCache.invalidate(studyUid);
+        if (!writeStudyManifest(s3Manager, dbManager, studyRecord, studyInstances)) {
+            LOG_WARNING("Failed to store manifest for study: " + studyUid);
+        }
+        LOG_INFO("Indexed " + std::to_string(studyInstances.size()) +
+                 " existing objects for study: " + studyUid);
     }
+    return success;
+}
+
+bool uploadMode(const std::string& sourcePath, const UploadOptions& options) {
+    LOG_INFO(std::string(options.watch ? "Starting watch mode" :
+                         options.sync ? "Starting sync mode" :
+                         options.fileList ? "Starting file list upload" : "Starting upload mode") +
+             " with source path: " + sourcePath);
+    LOG_INFO("Using " + std::to_string(options.threadCount) + " threads, " +
+             schedulePolicyName(options.schedulePolicy) + " scheduling");
     
-    // Create study-specific directory
-    std::string studyPath = Utils::joinPath(outputPath, studyUid);
-    if (!Utils::createDirectoryIfNotExists(studyPath)) {
-        LOG_ERROR("Failed to create study directory: " + studyPath);
+    // Check if source path exists and is a directory
+    if (!options.fileList && !Utils::isDirectory(sourcePath)) {
+        LOG_ERROR("Source path is not a valid directory: " + sourcePath);
         return false;
     }
     
-    LOG_INFO("Created study directory: " + studyPath);
-    
-    // Create instances of required services
+    // Initialize components
+    UploadJournal uploadJournal(UPLOAD_JOURNAL_PATH);
     S3Manager s3Manager(AWS_REGION);
-    DynamoDBManager dbManager(AWS_REGION);
-    ThreadPool threadPool(threadCount);
+    DynamoDBManager dbManager(AWS_REGION, g_dynamoDbEndpoint);
     
-    // Retrieve metadata from DynamoDB
-    Json::Value studyMetadata;
-    if (!dbManager.getStudyMetadata(DYNAMODB_TABLE_NAME, studyUid, studyMetadata)) {
-        LOG_ERROR("Failed to retrieve metadata for study: " + studyUid);
-        return false;
+    // File locations are coalesced per study and journaled until written
+    dbManager.setUploadJournal(&uploadJournal);
+    dbManager.setOnDemandBilling(options.onDemandBilling);
+    dbManager.setCompressedMetadata(options.compressMetadata);
+    
+    // Finish writing locations that an interrupted run uploaded but never stored
+    for (const auto& [studyUid, instances] : uploadJournal.getUnflushed()) {
+        LOG_INFO("Replaying " + std::to_string(instances.size()) + 
+                 " journaled file locations for study: " + studyUid);
+        for (const auto& instance : instances) {
+            dbManager.queueInstance(DYNAMODB_TABLE_NAME, instance);
+        }
+        if (!dbManager.flushFileLocations(DYNAMODB_TABLE_NAME, studyUid)) {
+            LOG_ERROR("Failed to replay journaled file locations for study: " + studyUid);
+        }
     }
     
-    LOG_INFO("Retrieved metadata for study: " + studyUid);
+    // Workers sharing a source tree split it by study, statically or through leases
+    std::unique_ptr<LeaseManager> leaseManager;
+    if (options.useLeases) {
+        leaseManager = std::make_unique<LeaseManager>(dbManager, DYNAMODB_TABLE_NAME,
+                                                      STUDY_LEASE_DURATION);
+        if (!leaseManager->start()) {
+            return false;
+        }
+    } else if (options.shard.isSharded()) {
+        LOG_INFO("Uploading shard " + std::to_string(options.shard.index) + " of " +
+                 std::to_string(options.shard.count));
+    }
+    DeferredStudies deferred;
     
-    // Save metadata to JSON file in study directory
-    std::string metadataPath = Utils::joinPath(studyPath, "study_metadata.json");
-    std::ofstream metadataFile(metadataPath);
-    if (!metadataFile.is_open()) {
-        LOG_ERROR("Failed to create metadata file: " + metadataPath);
-        return false;
+    // One accountant for the run: file contents wait on it, instance lists are charged to it
+    std::unique_ptr<MemoryBudget> memoryBudget;
+    if (options.maxMemory > 0) {
+        memoryBudget = std::make_unique<MemoryBudget>(options.maxMemory);
+        LOG_INFO("Holding file contents and study state within " +
+                 Utils::bytesToHumanReadable(options.maxMemory));
+    }
+    if (options.deadline.isSet()) {
+        LOG_INFO("Deadline in " + std::to_string(std::chrono::duration_cast<std::chrono::minutes>(
+                     options.deadline.remaining()).count()) + " minutes");
     }
     
-    Json::StyledWriter writer;
-    metadataFile << writer.write(studyMetadata);
-    metadataFile.close();
+    // Metadata writes happen behind the uploads; a study is committed once they are confirmed
+    MetadataSink metadataSink(dbManager, DYNAMODB_TABLE_NAME,
+                              METADATA_SINK_WORKERS, METADATA_SINK_CAPACITY);
     
-    LOG_INFO("Saved study metadata to: " + metadataPath);
+    // Studies uploaded again must not be served from a stale cached listing
+    MetadataCache metadataCache(METADATA_CACHE_DIR, std::chrono::seconds(options.cacheTtl));
     
-    // Get all file locations for the study
-    std::vector<std::string> fileLocations = dbManager.getFileLocations(DYNAMODB_TABLE_NAME, studyUid);
+    // Source reads advise sequential access and drop their pages once uploaded
+    FileReadOptions readOptions;
+    readOptions.directIoThreshold = options.directIoThreshold;
+    s3Manager.setReadOptions(readOptions);
     
-    if (fileLocations.empty()) {
-        LOG_ERROR("No files found for study: " + studyUid);
-        return false;
+    // A sync compares the tree with S3 and DynamoDB first and transfers only the difference
+    SyncPlan syncPlan;
+    if (options.sync) {
+        SyncPlanner syncPlanner(s3Manager, dbManager, S3_BUCKET_NAME, DYNAMODB_TABLE_NAME,
+                                options.threadCount, readOptions);
+        if (!syncPlanner.plan(sourcePath, syncPlan)) {
+            LOG_ERROR("Could not read the remote state; nothing was transferred");
+            return false;
+        }
+        printSyncPlan(syncPlan);
+    }
+    std::set<std::string> uploadingStudies;
+    for (const auto& instance : syncPlan.uploads) {
+        uploadingStudies.insert(instance.studyUid);
     }
     
-    LOG_INFO("Found " + std::to_string(fileLocations.size()) + " files for study: " + studyUid);
+    // Walking, parsing, uploading and metadata writes overlap; studies commit as they settle
+    auto makePipeline = [&]() {
+        auto pipeline = std::make_unique<UploadPipeline>(
+            s3Manager, metadataSink, S3_BUCKET_NAME,
+            std::max(options.threadCount / 2, 1), options.threadCount,
+            READ_QUEUE_DEPTH, readOptions, options.schedulePolicy);
+        pipeline->setPrefetchBudget(options.prefetchBudget);
+        pipeline->setDeadline(options.deadline);
+        pipeline->setMemoryBudget(memoryBudget.get());
+        if (leaseManager) {
+            pipeline->setCommitGuard([&](const std::string& studyUid) {
+                return leaseManager->renewForCommit(studyUid);
+            });
+        }
+        pipeline->setStudyCompleteCallback([&](const StudyRecord& studyRecord,
+                                               const std::vector<InstanceRecord>& uploadedInstances,
+                                               bool complete) {
+            metadataCache.invalidate(studyRecord.studyInstanceUid);
+            
+            // A partial study gets no manifest, so downloads fall back to DynamoDB.
+            // A list released under the memory budget, or one missing the objects a
+            // sync indexed, is read back from the committed items.
+            bool written = true;
+            if (complete && (uploadedInstances.empty() ||
+                             uploadingStudies.count(studyRecord.studyInstanceUid))) {
+                std::vector<InstanceRecord> committedInstances;
+                written = dbManager.getInstances(DYNAMODB_TABLE_NAME, studyRecord.studyInstanceUid,
+                                                 committedInstances) &&
+                          writeStudyManifest(s3Manager, dbManager, studyRecord, committedInstances);
+            } else if (complete) {
+                written = writeStudyManifest(s3Manager, dbManager, studyRecord, uploadedInstances);
+            }
+            if (!written) {
+                LOG_WARNING("Failed to store manifest for study: " + studyRecord.studyInstanceUid);
+            }
+            
+            // A failed study goes back to the pool for another worker to retry.
+            // A lost lease arrives here as incomplete, and release() ignores it.
+            if (leaseManager && complete) {
+                leaseManager->complete(studyRecord.studyInstanceUid);
+            } else if (leaseManager) {
+                leaseManager->release(studyRecord.studyInstanceUid);
+            }
+        });
+        return pipeline;
+    };
     
-    // Download all files for the study
-    std::vector<std::future<bool>> downloadResults;
+    auto pipeline = makePipeline();
+    if (leaseManager) {
+        pipeline->setStudyFilter([&](const InstanceRecord& instance) {
+            return claimStudyFile(*leaseManager, deferred, instance);
+        });
+    } else if (options.shard.isSharded()) {
+        pipeline->setStudyFilter([&](const InstanceRecord& instance) {
+            return options.shard.owns(instance.studyUid);
+        });
+    }
+    
+    bool success;
+    if (options.watch) {
+        // Studies are committed once idle rather than when a walk ends
+        pipeline->setIdleTimeout(std::chrono::seconds(options.idleTimeout));
+        pipeline->start();
+        bool watched = watchLandingDirectory(*pipeline, sourcePath, options.deadline);
+        success = pipeline->finish() && watched;
+    } else if (options.sync) {
+        success = indexExistingObjects(s3Manager, dbManager, metadataCache, syncPlan.indexOnly,
+                                       uploadingStudies);
+        pipeline->start();
+        for (const auto& instance : syncPlan.uploads) {
+            if (options.deadline.passed()) {
+                break;
+            }
+            pipeline->submit(instance.sourcePath);
+        }
+        success = pipeline->finish() && success;
+    } else if (options.fileList) {
+        success = uploadFileList(*pipeline, sourcePath, options.deadline);
+    } else {
+        success = pipeline->run(sourcePath);
+        if (leaseManager) {
+            success &= uploadDeferredStudies(*leaseManager, deferred, options.deadline, makePipeline);
+        }
+    }
+    
+    // Deferred studies are pending with their uploaded files indexed, a clean
+    // point for the next run to resume from
+    size_t deferredStudies = pipeline->getDeferredStudyCount();
+    if (options.deadline.passed()) {
+        // Lapsed leases this worker never got to take over
+        deferredStudies += deferred.files.size();
+    }
+    if (deferredStudies > 0) {
+        LOG_WARNING("Deadline reached with " + std::to_string(deferredStudies) +
+                    " studies left for the next run; rerun with --sync to resume");
+        success = false;
+    }
+    if (!success) {
+        LOG_ERROR("One or more studies failed to process");
+    }
     
-    for (const auto& s3Key : fileLocations) {
+    return success;
+}
+
+// Queue S3 downloads of a study's files into its directory
+void enqueueStudyDownloads(const std::vector<InstanceRecord>& instances,
+                           const std::string& studyPath,
+                           S3Manager& s3Manager,
+                           ThreadPool& threadPool,
+                           std::vector<std::future<bool>>& downloadResults) {
+    for (const auto& instance : instances) {
+        const std::string s3Key = instance.s3Key;
         downloadResults.push_back(
-            threadPool.enqueue([&, s3Key]() {
+            threadPool.enqueue([&s3Manager, studyPath, s3Key]() {
                 // Generate local file path in study directory
                 std::string filename = Utils::getFileName(s3Key);
                 std::string localFilePath = Utils::joinPath(studyPath, filename);
@@ -281,18 +741,475 @@ bool downloadMode(const std::string& studyUid, const std::string& outputPath, in
             })
         );
     }
+}
+
+// Save a study's metadata as study_metadata.json in its directory
+bool writeStudyMetadata(const std::string& studyPath, const StudyRecord& studyRecord) {
+    std::string metadataPath = Utils::joinPath(studyPath, "study_metadata.json");
+    std::ofstream metadataFile(metadataPath);
+    if (!metadataFile.is_open()) {
+        LOG_ERROR("Failed to create metadata file: " + metadataPath);
+        return false;
+    }
     
-    // Wait for all downloads to complete
-    bool allFilesDownloaded = true;
-    for (auto& future : downloadResults) {
+    Json::StyledWriter writer;
+    metadataFile << writer.write(studyRecord.toJson());
+    metadataFile.close();
+    
+    LOG_INFO("Saved study metadata to: " + metadataPath);
+    return true;
+}
+
+// A study's downloads in flight within a shared thread pool
+struct StudyDownload {
+    std::string studyUid;
+    std::string studyPath;
+    std::vector<std::future<bool>> results;
+    bool planned = true;
+};
+
+// Plan a study from the cache, its manifest or DynamoDB, queueing its files as they are listed
+void startStudyDownload(StudyDownload& download,
+                        const std::string& outputPath,
+                        S3Manager& s3Manager,
+                        DynamoDBManager& dbManager,
+                        MetadataCache& metadataCache,
+                        ThreadPool& threadPool) {
+    const std::string& studyUid = download.studyUid;
+    download.studyPath = Utils::joinPath(outputPath, studyUid);
+    if (!Utils::createDirectoryIfNotExists(download.studyPath)) {
+        LOG_ERROR("Failed to create study directory: " + download.studyPath);
+        download.planned = false;
+        return;
+    }
+    
+    LOG_INFO("Created study directory: " + download.studyPath);
+    
+    // Repeat downloads of a study are served from the local cache, confirmed
+    // against the committed study item instead of listing DynamoDB again
+    StudyRecord studyRecord;
+    std::vector<InstanceRecord> instances;
+    bool metadataRetrieved = true;
+    
+    bool cached = metadataCache.load(DYNAMODB_TABLE_NAME, studyUid, studyRecord, instances);
+    if (cached && !isCommittedListing(dbManager, studyUid, instances)) {
+        LOG_INFO("Cached listing is not the committed upload of study: " + studyUid);
+        instances.clear();
+        cached = false;
+    }
+    if (metadataCache.isEnabled()) {
+        Profiler::getInstance().recordCacheLookup("Study Metadata", cached);
+    }
+    
+    if (cached) {
+        LOG_INFO("Using cached metadata and file listing for study: " + studyUid);
+        enqueueStudyDownloads(instances, download.studyPath, s3Manager, threadPool, download.results);
+    } else if (loadStudyManifest(s3Manager, dbManager, studyUid, studyRecord, instances)) {
+        // One GET plans the whole download; DynamoDB is only the fallback
+        LOG_INFO("Using S3 manifest for study: " + studyUid);
+        enqueueStudyDownloads(instances, download.studyPath, s3Manager, threadPool, download.results);
+        metadataCache.store(DYNAMODB_TABLE_NAME, studyUid, studyRecord, instances);
+    } else {
+        // Fetch metadata alongside the file listing rather than ahead of it
+        auto metadataResult = std::async(std::launch::async, [&]() {
+            return dbManager.getStudyRecord(DYNAMODB_TABLE_NAME, studyUid, studyRecord);
+        });
+        
+        // Nothing is fetched until the study item confirms the study is committed;
+        // a pending study's instance items may belong to an unfinished upload
+        bool metadataChecked = false;
+        bool listed = dbManager.streamInstances(DYNAMODB_TABLE_NAME, studyUid,
+            [&](const std::vector<InstanceRecord>& page) {
+                if (!metadataChecked) {
+                    metadataRetrieved = metadataResult.get();
+                    metadataChecked = true;
+                }
+                if (!metadataRetrieved) {
+                    return false;
+                }
+                instances.insert(instances.end(), page.begin(), page.end());
+                enqueueStudyDownloads(page, download.studyPath, s3Manager, threadPool, download.results);
+                return true;
+            });
+        if (!metadataChecked) {
+            metadataRetrieved = metadataResult.get();
+        }
+        download.planned &= listed;
+        
+        // Only complete answers are cached
+        if (metadataRetrieved && listed && !instances.empty()) {
+            metadataCache.store(DYNAMODB_TABLE_NAME, studyUid, studyRecord, instances);
+        }
+    }
+    
+    if (!metadataRetrieved) {
+        LOG_ERROR("Failed to retrieve metadata for study: " + studyUid);
+        download.planned = false;
+    } else {
+        LOG_INFO("Retrieved metadata for study: " + studyUid);
+        download.planned &= writeStudyMetadata(download.studyPath, studyRecord);
+    }
+}
+
+// Wait for a study's files; true if the whole study is on disk
+bool finishStudyDownload(StudyDownload& download) {
+    if (download.results.empty()) {
+        LOG_ERROR("No files found for study: " + download.studyUid);
+        return false;
+    }
+    
+    LOG_INFO("Found " + std::to_string(download.results.size()) + " files for study: " +
+             download.studyUid);
+    
+    bool allFilesDownloaded = download.planned;
+    for (auto& future : download.results) {
         allFilesDownloaded &= future.get();
     }
+    return allFilesDownloaded;
+}
+
+bool downloadMode(const std::string& studyUid, const std::string& outputPath, int threadCount,
+                  int cacheTtl) {
+    LOG_INFO("Starting download mode for study: " + studyUid);
+    LOG_INFO("Output path: " + outputPath);
+    LOG_INFO("Using " + std::to_string(threadCount) + " threads");
+    
+    // Create base output directory if it doesn't exist
+    if (!Utils::createDirectoryIfNotExists(outputPath)) {
+        LOG_ERROR("Failed to create output directory: " + outputPath);
+        return false;
+    }
+    
+    // Create instances of required services
+    S3Manager s3Manager(AWS_REGION);
+    DynamoDBManager dbManager(AWS_REGION, g_dynamoDbEndpoint);
+    ThreadPool threadPool(threadCount);
+    MetadataCache metadataCache(METADATA_CACHE_DIR, std::chrono::seconds(cacheTtl));
+    
+    // Downloads are enqueued page by page as the listing arrives
+    StudyDownload download;
+    download.studyUid = studyUid;
+    startStudyDownload(download, outputPath, s3Manager, dbManager, metadataCache, threadPool);
     
-    if (allFilesDownloaded) {
+    if (finishStudyDownload(download)) {
         LOG_INFO("Download mode completed successfully");
         return true;
     } else {
         LOG_ERROR("Download mode completed with errors");
         return false;
     }
-} 
\ No newline at end of file
+}
+
+bool downloadListMode(const std::string& listPath, const std::string& outputPath, int threadCount,
+                      int cacheTtl) {
+    LOG_INFO("Starting download list mode from: " + (listPath == "-" ? std::string("stdin") : listPath));
+    
+    std::vector<std::string> studyUids;
+    if (listPath == "-") {
+        studyUids = readStudyList(std::cin);
+    } else {
+        std::ifstream listFile(listPath);
+        if (!listFile.is_open()) {
+            LOG_ERROR("Failed to open study list: " + listPath);
+            return false;
+        }
+        studyUids = readStudyList(listFile);
+    }
+    
+    if (studyUids.empty()) {
+        LOG_WARNING("Study list is empty");
+        return false;
+    }
+    
+    if (!Utils::createDirectoryIfNotExists(outputPath)) {
+        LOG_ERROR("Failed to create output directory: " + outputPath);
+        return false;
+    }
+    
+    // Studies finished by an earlier run of the same list are skipped
+    DownloadProgress progress(Utils::joinPath(outputPath, DOWNLOAD_PROGRESS_FILE));
+    
+    // One set of clients and one pool is the whole run's connection and concurrency budget
+    S3Manager s3Manager(AWS_REGION, static_cast<unsigned>(threadCount));
+    DynamoDBManager dbManager(AWS_REGION, g_dynamoDbEndpoint);
+    ThreadPool threadPool(threadCount);
+    MetadataCache metadataCache(METADATA_CACHE_DIR, std::chrono::seconds(cacheTtl));
+    
+    LOG_INFO("Downloading " + std::to_string(studyUids.size()) + " studies to: " + outputPath +
+             " with " + std::to_string(threadCount) + " threads");
+    
+    // Per-study report lines go to stdout as each study settles
+    size_t downloaded = 0;
+    size_t failed = 0;
+    size_t skipped = 0;
+    
+    auto settle = [&](StudyDownload& download) {
+        size_t files = download.results.size();
+        if (finishStudyDownload(download)) {
+            progress.markComplete(download.studyUid);
+            std::cout << download.studyUid << "\tOK\t" << files << std::endl;
+            downloaded++;
+        } else {
+            LOG_ERROR("Failed to download study: " + download.studyUid);
+            std::cout << download.studyUid << "\tFAILED\t" << files << std::endl;
+            failed++;
+        }
+    };
+    
+    // A few studies are planned ahead so the pool never drains between them
+    std::deque<StudyDownload> inFlight;
+    for (const auto& studyUid : studyUids) {
+        if (progress.isComplete(studyUid)) {
+            std::cout << studyUid << "\tSKIPPED" << std::endl;
+            skipped++;
+            continue;
+        }
+        
+        inFlight.emplace_back();
+        inFlight.back().studyUid = studyUid;
+        startStudyDownload(inFlight.back(), outputPath, s3Manager, dbManager, metadataCache, threadPool);
+        
+        while (inFlight.size() > MAX_STUDIES_IN_FLIGHT) {
+            settle(inFlight.front());
+            inFlight.pop_front();
+        }
+    }
+    while (!inFlight.empty()) {
+        settle(inFlight.front());
+        inFlight.pop_front();
+    }
+    
+    std::cout << "Downloaded " << downloaded << ", failed " << failed
+              << ", already complete " << skipped << " of " << studyUids.size()
+              << " studies" << std::endl;
+    
+    if (failed > 0) {
+        LOG_ERROR("Download list completed with " + std::to_string(failed) + " failed studies");
+        return false;
+    }
+    LOG_INFO("Download list completed successfully");
+    return true;
+}
+
+bool queryMode(const StudyQuery& query, const std::string& outputPath, int threadCount,
+               int cacheTtl) {
+    LOG_INFO("Starting query mode");
+    
+    DynamoDBManager dbManager(AWS_REGION, g_dynamoDbEndpoint);
+    std::vector<StudyRecord> studies;
+    if (!dbManager.findStudies(DYNAMODB_TABLE_NAME, query, studies)) {
+        // A partial listing would silently miss studies
+        LOG_ERROR("Study query failed");
+        return false;
+    }
+    
+    for (const auto& study : studies) {
+        std::cout << study.studyInstanceUid << "\t" << study.patientId << "\t"
+                  << study.accessionNumber << "\t" << study.studyDate << "\t"
+                  << study.studyDescription << std::endl;
+    }
+    
+    if (studies.empty()) {
+        LOG_WARNING("No studies matched the query");
+        return false;
+    }
+    
+    // Without an output folder the matches are only listed
+    if (outputPath.empty()) {
+        return true;
+    }
+    
+    if (!Utils::createDirectoryIfNotExists(outputPath)) {
+        LOG_ERROR("Failed to create output directory: " + outputPath);
+        return false;
+    }
+    
+    LOG_INFO("Downloading " + std::to_string(studies.size()) + " studies to: " + outputPath);
+    
+    S3Manager s3Manager(AWS_REGION);
+    ThreadPool threadPool(threadCount);
+    MetadataCache metadataCache(METADATA_CACHE_DIR, std::chrono::seconds(cacheTtl));
+    
+    std::vector<std::future<bool>> downloadResults;
+    std::map<std::string, std::string> studyPaths;
+    std::map<std::string, StudyRecord> studyRecords;
+    std::vector<std::string> uncachedStudies;
+    bool success = true;
+    
+    // The index projection already carries each study's metadata
+    for (const auto& study : studies) {
+        std::string studyPath = Utils::joinPath(outputPath, study.studyInstanceUid);
+        if (!Utils::createDirectoryIfNotExists(studyPath)) {
+            LOG_ERROR("Failed to create study directory: " + studyPath);
+            success = false;
+            continue;
+        }
+        success &= writeStudyMetadata(studyPath, study);
+        studyPaths[study.studyInstanceUid] = studyPath;
+        studyRecords[study.studyInstanceUid] = study;
+        
+        StudyRecord cachedRecord;
+        std::vector<InstanceRecord> cachedInstances;
+        bool cached = metadataCache.load(DYNAMODB_TABLE_NAME, study.studyInstanceUid,
+                                         cachedRecord, cachedInstances) &&
+                      isCommittedListing(dbManager, study.studyInstanceUid, cachedInstances);
+        if (!cached) {
+            cachedInstances.clear();
+        }
+        if (metadataCache.isEnabled()) {
+            Profiler::getInstance().recordCacheLookup("Study Metadata", cached);
+        }
+        if (cached) {
+            enqueueStudyDownloads(cachedInstances, studyPath, s3Manager, threadPool, downloadResults);
+        } else if (loadStudyManifest(s3Manager, dbManager, study.studyInstanceUid,
+                                     cachedRecord, cachedInstances)) {
+            enqueueStudyDownloads(cachedInstances, studyPath, s3Manager, threadPool, downloadResults);
+            metadataCache.store(DYNAMODB_TABLE_NAME, study.studyInstanceUid, study, cachedInstances);
+        } else {
+            uncachedStudies.push_back(study.studyInstanceUid);
+        }
+    }
+    
+    // List the remaining studies on parallel segments, downloading as pages arrive
+    std::mutex resultsMutex;
+    std::map<std::string, std::vector<InstanceRecord>> listedInstances;
+    bool listed = dbManager.streamInstancesForStudies(DYNAMODB_TABLE_NAME, uncachedStudies,
+        static_cast<size_t>(threadCount),
+        [&](const std::vector<InstanceRecord>& page) {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            const std::string& studyUid = page.front().studyUid;
+            auto& instances = listedInstances[studyUid];
+            instances.insert(instances.end(), page.begin(), page.end());
+            enqueueStudyDownloads(page, studyPaths[studyUid], s3Manager, threadPool, downloadResults);
+            return true;
+        });
+    success &= listed;
+    
+    if (listed) {
+        for (const auto& [studyUid, instances] : listedInstances) {
+            metadataCache.store(DYNAMODB_TABLE_NAME, studyUid, studyRecords[studyUid], instances);
+        }
+    }
+    
+    LOG_INFO("Found " + std::to_string(downloadResults.size()) + " files across " +
+             std::to_string(studies.size()) + " studies");
+    
+    // Wait for all downloads to complete
+    for (auto& future : downloadResults) {
+        success &= future.get();
+    }
+    
+    if (success) {
+        LOG_INFO("Query download completed successfully");
+    } else {
+        LOG_ERROR("Query download completed with errors");
+    }
+    return success;
+}
+
+// Copy one study to another bucket, possibly in another region, without its
+// bytes leaving S3: the destination client issues server-side copies, then the
+// study's DynamoDB items go into the destination's own table and its manifest
+// into the destination bucket
+bool copyMode(const std::string& studyUid, const std::string& destinationBucket,
+              const std::string& destinationRegion, const std::string& destinationTable,
+              int threadCount) {
+    LOG_INFO("Starting copy of study " + studyUid + " to S3://" + destinationBucket +
+             " in " + destinationRegion + " (table " + destinationTable + ")");
+    
+    if (destinationBucket == S3_BUCKET_NAME) {
+        LOG_ERROR("Copy destination must be a different bucket than " + S3_BUCKET_NAME);
+        return false;
+    }
+    // Records hold only keys, so sharing the source table would point the source study at the copy
+    if (destinationTable == DYNAMODB_TABLE_NAME && destinationRegion == AWS_REGION) {
+        LOG_ERROR("Copy destination table must differ from the source table " + DYNAMODB_TABLE_NAME);
+        return false;
+    }
+    
+    S3Manager sourceS3(AWS_REGION);
+    DynamoDBManager sourceDb(AWS_REGION, g_dynamoDbEndpoint);
+    S3Manager destinationS3(destinationRegion, static_cast<unsigned>(threadCount));
+    DynamoDBManager destinationDb(destinationRegion, g_dynamoDbEndpoint);
+    
+    // Only a committed study is copied; getStudyRecord rejects one still pending
+    StudyRecord studyRecord;
+    std::vector<InstanceRecord> instances;
+    if (!sourceDb.getStudyRecord(DYNAMODB_TABLE_NAME, studyUid, studyRecord)) {
+        LOG_ERROR("Failed to retrieve committed metadata for study: " + studyUid);
+        return false;
+    }
+    if (loadStudyManifest(sourceS3, sourceDb, studyUid, studyRecord, instances)) {
+        LOG_INFO("Using S3 manifest for study: " + studyUid);
+    } else if (!sourceDb.getInstances(DYNAMODB_TABLE_NAME, studyUid, instances)) {
+        LOG_ERROR("Failed to list the files of study: " + studyUid);
+        return false;
+    }
+    if (instances.empty()) {
+        LOG_ERROR("No files found for study: " + studyUid);
+        return false;
+    }
+    studyRecord.studyInstanceUid = studyUid;
+    
+    uint64_t totalBytes = 0;
+    for (const auto& instance : instances) {
+        totalBytes += instance.size;
+    }
+    
+    // One progress line, rewritten as copies finish
+    std::mutex progressMutex;
+    size_t copiedObjects = 0;
+    uint64_t copiedBytes = 0;
+    auto reportCopied = [&](uint64_t bytes) {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        copiedObjects++;
+        copiedBytes += bytes;
+        std::cout << "\rCopied " << copiedObjects << "/" << instances.size() << " objects, "
+                  << Utils::bytesToHumanReadable(copiedBytes) << " of "
+                  << Utils::bytesToHumanReadable(totalBytes) << std::flush;
+    };
+    
+    ThreadPool threadPool(threadCount);
+    std::vector<std::future<bool>> copyResults;
+    for (const auto& instance : instances) {
+        copyResults.push_back(threadPool.enqueue([&, instance]() {
+            if (!destinationS3.copyObject(S3_BUCKET_NAME, instance.s3Key,
+                                          destinationBucket, instance.s3Key, instance.size)) {
+                return false;
+            }
+            reportCopied(instance.size);
+            return true;
+        }));
+    }
+    
+    bool success = true;
+    for (auto& result : copyResults) {
+        success &= result.get();
+    }
+    std::cout << std::endl;
+    if (!success) {
+        LOG_ERROR("Failed to copy one or more objects of study: " + studyUid);
+        return false;
+    }
+    
+    // Records go in only once every object they point to is in place
+    for (const auto& instance : instances) {
+        destinationDb.queueInstance(destinationTable, instance);
+    }
+    if (!destinationDb.storeStudyRecord(destinationTable, studyRecord) ||
+        !destinationDb.flushFileLocations(destinationTable, studyUid) ||
+        !destinationDb.markStudyCommitted(destinationTable, studyUid)) {
+        LOG_ERROR("Failed to store metadata in destination DynamoDB for study: " + studyUid);
+        return false;
+    }
+    
+    std::string manifest = StudyManifest::encode(studyRecord, instances);
+    if (!destinationS3.uploadBuffer(destinationBucket,
+                                    reinterpret_cast<const unsigned char*>(manifest.data()),
+                                    manifest.size(), StudyManifest::objectKey(studyUid))) {
+        LOG_WARNING("Failed to store manifest for study: " + studyUid);
+    }
+    
+    LOG_INFO("Copied study " + studyUid + " with " + std::to_string(instances.size()) + " files");
+    return true;
+}
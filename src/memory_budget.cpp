@@ -0,0 +1,86 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+    : m_limit(limit),
+      m_used(0),
+      m_charged(0),
+      m_closed(false) {
+}
+
+bool MemoryBudget::acquire(uint64_t bytes) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released.wait(lock, [&] {
+        return m_closed || m_used == m_charged || m_used + bytes <= m_limit;
+    });
+    if (m_closed) {
+        return false;
+    }
+    m_used += bytes;
+    return true;
+}
+
+bool MemoryBudget::tryAcquire(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_closed || (m_used > m_charged && m_used + bytes > m_limit)) {
+        return false;
+    }
+    m_used += bytes;
+    return true;
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_used -= std::min(bytes, m_used - m_charged);
+    }
+    m_released.notify_all();
+}
+
+void MemoryBudget::charge(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_used += bytes;
+    m_charged += bytes;
+}
+
+void MemoryBudget::discharge(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bytes = std::min(bytes, m_charged);
+        m_charged -= bytes;
+        m_used -= bytes;
+    }
+    m_released.notify_all();
+}
+
+void MemoryBudget::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+    }
+    m_released.notify_all();
+}
+
+void MemoryBudget::setLimit(uint64_t limit) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_limit = limit;
+    }
+    m_released.notify_all();
+}
+
+uint64_t MemoryBudget::getLimit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit;
+}
+
+uint64_t MemoryBudget::getUsed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+uint64_t MemoryBudget::getCharged() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_charged;
+}
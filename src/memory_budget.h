@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+// Byte budget shared by the stages that hold file contents in memory.
+// acquire blocks until the bytes fit; a request larger than the whole
+// budget is let through once nothing else is held, so one oversized file
+// cannot stall the pipeline.
+// Memory that cannot wait for room (state already accepted) is charged
+// instead: it counts against the limit but never blocks. Charged bytes don't
+// hold back that oversized admission, so acquirers degrade to one request at
+// a time rather than deadlocking behind state only they could drain.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(uint64_t limit);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // Wait until the bytes fit and reserve them; false if the budget was closed
+    bool acquire(uint64_t bytes);
+
+    // Reserve the bytes only if they fit now
+    bool tryAcquire(uint64_t bytes);
+
+    void release(uint64_t bytes);
+
+    // Count bytes without waiting, even past the limit
+    void charge(uint64_t bytes);
+
+    // Return charged bytes
+    void discharge(uint64_t bytes);
+
+    // Wake every waiter; later acquires fail
+    void close();
+
+    void setLimit(uint64_t limit);
+    uint64_t getLimit() const;
+    uint64_t getUsed() const;
+    uint64_t getCharged() const;
+
+private:
+    uint64_t m_limit;
+    uint64_t m_used;
+    uint64_t m_charged;   // Part of m_used that was charged rather than acquired
+    bool m_closed;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+};
@@ -0,0 +1,128 @@
+#include "metadata_cache.h"
+#include "logger.h"
+#include "utils.h"
+#include "binary_io.h"
+#include "study_manifest.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+
+// Entry layout (little-endian host order, strings as uint32 length + bytes):
+//   "DTMC" uint32 version, string table, int64 storedAt (unix seconds),
+//   then the study body written by StudyManifest::writeStudy
+
+namespace {
+
+const char CACHE_MAGIC[4] = {'D', 'T', 'M', 'C'};
+const uint32_t CACHE_FORMAT_VERSION = 1;
+
+} // namespace
+
+MetadataCache::MetadataCache(const std::string& directory, std::chrono::seconds ttl)
+    : m_directory(directory),
+      m_ttl(ttl) {
+    if (isEnabled() && !Utils::createDirectoryIfNotExists(m_directory)) {
+        LOG_WARNING("Could not create metadata cache directory: " + m_directory);
+    }
+}
+
+bool MetadataCache::isEnabled() const {
+    return m_ttl.count() > 0;
+}
+
+std::string MetadataCache::entryPath(const std::string& studyUid) const {
+    std::string name = studyUid;
+    for (auto& c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-') {
+            c = '_';
+        }
+    }
+    return Utils::joinPath(m_directory, name + ".meta");
+}
+
+bool MetadataCache::load(const std::string& tableName,
+                         const std::string& studyUid,
+                         StudyRecord& record,
+                         std::vector<InstanceRecord>& instances) {
+    if (!isEnabled()) {
+        return false;
+    }
+
+    std::string path = entryPath(studyUid);
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint32_t version = 0;
+    std::string cachedTable;
+    int64_t storedAt = 0;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        !BinaryIO::readValue(in, version) || version != CACHE_FORMAT_VERSION ||
+        !BinaryIO::readString(in, cachedTable) || cachedTable != tableName ||
+        !BinaryIO::readValue(in, storedAt)) {
+        LOG_DEBUG("Discarding incompatible metadata cache entry: " + path);
+        in.close();
+        std::remove(path.c_str());
+        return false;
+    }
+
+    auto age = std::chrono::system_clock::now() -
+               std::chrono::system_clock::time_point(std::chrono::seconds(storedAt));
+    if (age >= m_ttl) {
+        LOG_DEBUG("Metadata cache entry expired for study: " + studyUid);
+        return false;
+    }
+
+    if (!StudyManifest::readStudy(in, studyUid, record, instances)) {
+        LOG_WARNING("Truncated metadata cache entry: " + path);
+        return false;
+    }
+    return true;
+}
+
+bool MetadataCache::store(const std::string& tableName,
+                          const std::string& studyUid,
+                          const StudyRecord& record,
+                          const std::vector<InstanceRecord>& instances) {
+    if (!isEnabled()) {
+        return false;
+    }
+
+    // Written beside the entry and renamed over it so readers never see a partial file
+    std::string path = entryPath(studyUid);
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_WARNING("Failed to write metadata cache entry: " + path);
+            return false;
+        }
+
+        int64_t storedAt = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        out.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        BinaryIO::writeValue<uint32_t>(out, CACHE_FORMAT_VERSION);
+        BinaryIO::writeString(out, tableName);
+        BinaryIO::writeValue<int64_t>(out, storedAt);
+
+        StudyManifest::writeStudy(out, record, instances);
+
+        out.flush();
+        if (!out.good()) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    return std::rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+void MetadataCache::invalidate(const std::string& studyUid) {
+    std::remove(entryPath(studyUid).c_str());
+}
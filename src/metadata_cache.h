@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "study_record.h"
+
+// On-disk cache of study records and file listings, one binary file per
+// study. Entries expire after a TTL and are discarded when written by a
+// different cache format version or for a different table.
+class MetadataCache {
+public:
+    MetadataCache(const std::string& directory, std::chrono::seconds ttl);
+
+    // Whether lookups are enabled (a zero TTL disables the cache)
+    bool isEnabled() const;
+
+    // Load a cached study; false on a miss, an expired entry or a version mismatch
+    bool load(const std::string& tableName,
+              const std::string& studyUid,
+              StudyRecord& record,
+              std::vector<InstanceRecord>& instances);
+
+    // Cache a study's record and complete file listing
+    bool store(const std::string& tableName,
+               const std::string& studyUid,
+               const StudyRecord& record,
+               const std::vector<InstanceRecord>& instances);
+
+    // Drop a study's entry, e.g. after it is uploaded again
+    void invalidate(const std::string& studyUid);
+
+private:
+    std::string entryPath(const std::string& studyUid) const;
+
+    std::string m_directory;
+    std::chrono::seconds m_ttl;
+};
@@ -0,0 +1,181 @@
+#include "metadata_sink.h"
+#include "dynamodb_manager.h"
+#include "logger.h"
+
+#include <algorithm>
+
+// How often idle or busy workers write out instance buffers that reached their batching age
+static const std::chrono::milliseconds AGED_FLUSH_INTERVAL(500);
+
+MetadataSink::MetadataSink(DynamoDBManager& dbManager,
+                           const std::string& tableName,
+                           size_t workerCount,
+                           size_t capacity)
+    : m_dbManager(dbManager),
+      m_tableName(tableName),
+      m_capacity(std::max<size_t>(capacity, 1)),
+      m_stop(false),
+      m_lastAgedFlush(std::chrono::steady_clock::now()) {
+    for (size_t i = 0; i < std::max<size_t>(workerCount, 1); ++i) {
+        m_workers.emplace_back(&MetadataSink::workerLoop, this);
+    }
+}
+
+MetadataSink::~MetadataSink() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_taskAvailable.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+
+    // Anything still buffered in DynamoDBManager is journaled; write it now
+    m_dbManager.flushAllFileLocations();
+}
+
+void MetadataSink::putStudy(const StudyRecord& record) {
+    Task task;
+    task.kind = Task::Kind::STUDY;
+    task.studyUid = record.studyInstanceUid;
+    task.study = record;
+    enqueue(std::move(task));
+}
+
+void MetadataSink::putInstance(const InstanceRecord& instance) {
+    Task task;
+    task.kind = Task::Kind::INSTANCE;
+    task.studyUid = instance.studyUid;
+    task.instance = instance;
+    enqueue(std::move(task));
+}
+
+std::future<bool> MetadataSink::commitStudy(const std::string& studyUid, bool publish,
+                                             CommitFence fence) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto& state = m_studies[studyUid];
+    state.commitRequested = true;
+    state.publish = publish;
+    state.fence = std::move(fence);
+    std::future<bool> committed = state.committed.get_future();
+
+    // Otherwise the worker that finishes the last outstanding write commits
+    if (state.outstanding == 0) {
+        Task task;
+        task.kind = Task::Kind::COMMIT;
+        task.studyUid = studyUid;
+        m_tasks.push_back(std::move(task));
+        lock.unlock();
+        m_taskAvailable.notify_one();
+    }
+    return committed;
+}
+
+size_t MetadataSink::getBacklog() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_tasks.size();
+}
+
+void MetadataSink::enqueue(Task&& task) {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_spaceAvailable.wait(lock, [this] { return m_tasks.size() < m_capacity; });
+        m_studies[task.studyUid].outstanding++;
+        m_tasks.push_back(std::move(task));
+    }
+    m_taskAvailable.notify_one();
+}
+
+void MetadataSink::workerLoop() {
+    while (true) {
+        Task task;
+        bool flushAged = false;
+        bool haveTask = false;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_taskAvailable.wait_for(lock, AGED_FLUSH_INTERVAL,
+                                     [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty() && m_stop) {
+                return;
+            }
+
+            // One worker per interval writes buffers that no new instance will push out
+            auto now = std::chrono::steady_clock::now();
+            if (now - m_lastAgedFlush >= AGED_FLUSH_INTERVAL) {
+                m_lastAgedFlush = now;
+                flushAged = true;
+            }
+
+            if (!m_tasks.empty()) {
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+                haveTask = true;
+            }
+        }
+
+        if (flushAged) {
+            m_dbManager.flushAgedFileLocations();
+        }
+        if (!haveTask) {
+            continue;
+        }
+        m_spaceAvailable.notify_one();
+
+        if (task.kind == Task::Kind::COMMIT) {
+            finishStudy(task.studyUid);
+            continue;
+        }
+
+        bool success = execute(task);
+
+        bool commitNow = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto& state = m_studies[task.studyUid];
+            state.failed |= !success;
+            commitNow = --state.outstanding == 0 && state.commitRequested;
+        }
+        if (commitNow) {
+            finishStudy(task.studyUid);
+        }
+    }
+}
+
+bool MetadataSink::execute(const Task& task) {
+    if (task.kind == Task::Kind::STUDY) {
+        return m_dbManager.storeStudyRecord(m_tableName, task.study);
+    }
+    return m_dbManager.queueInstance(m_tableName, task.instance);
+}
+
+void MetadataSink::finishStudy(const std::string& studyUid) {
+    bool flushed = m_dbManager.flushFileLocations(m_tableName, studyUid);
+
+    bool writesFailed = false;
+    bool publish = false;
+    CommitFence fence;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& state = m_studies[studyUid];
+        writesFailed = state.failed;
+        publish = state.publish;
+        fence = std::move(state.fence);
+    }
+
+    // Every instance item is confirmed, so readers may now see the study. The
+    // fence runs last, right before the commit, so whatever it renews is fresh.
+    bool committed = flushed && !writesFailed;
+    if (!committed) {
+        LOG_ERROR("Metadata writes failed for study: " + studyUid);
+    } else if (publish && fence && !fence()) {
+        committed = false;
+    } else if (publish && !m_dbManager.markStudyCommitted(m_tableName, studyUid)) {
+        committed = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_studies.find(studyUid);
+    it->second.committed.set_value(committed);
+    m_studies.erase(it);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <chrono>
+
+#include "study_record.h"
+
+class DynamoDBManager;
+
+// Write-behind queue for DynamoDB metadata. Uploaders hand off study and
+// instance records and keep going; a small worker set performs the writes.
+// Producers block once the queue reaches its capacity.
+class MetadataSink {
+public:
+    // Checked on the worker right before a study is published; returning
+    // false leaves the study pending (e.g. its lease was lost)
+    using CommitFence = std::function<bool()>;
+
+    MetadataSink(DynamoDBManager& dbManager,
+                 const std::string& tableName,
+                 size_t workerCount = 2,
+                 size_t capacity = 1024);
+    ~MetadataSink();
+
+    MetadataSink(const MetadataSink&) = delete;
+    MetadataSink& operator=(const MetadataSink&) = delete;
+
+    // Queue the study item write
+    void putStudy(const StudyRecord& record);
+
+    // Queue an instance write; batched per study by DynamoDBManager
+    void putInstance(const InstanceRecord& instance);
+
+    // Resolves once every write queued for the study has been confirmed and,
+    // when publish is set, the study item has been marked committed. Pass
+    // publish = false for a study whose uploads failed, leaving it pending.
+    // A fence that rejects the study also leaves it pending and resolves false.
+    // No further writes may be queued for the study after this call.
+    std::future<bool> commitStudy(const std::string& studyUid, bool publish = true,
+                                  CommitFence fence = nullptr);
+
+    // Writes queued but not yet started
+    size_t getBacklog() const;
+
+private:
+    struct Task {
+        enum class Kind { STUDY, INSTANCE, COMMIT } kind;
+        std::string studyUid;
+        StudyRecord study;
+        InstanceRecord instance;
+    };
+
+    // Outstanding writes and commit state for one study
+    struct StudyState {
+        size_t outstanding = 0;
+        bool failed = false;
+        bool commitRequested = false;
+        bool publish = false;
+        CommitFence fence;
+        std::promise<bool> committed;
+    };
+
+    void enqueue(Task&& task);
+    void workerLoop();
+    bool execute(const Task& task);
+
+    // Flush buffered instances, publish the study and resolve its commit
+    void finishStudy(const std::string& studyUid);
+
+    DynamoDBManager& m_dbManager;
+    std::string m_tableName;
+    size_t m_capacity;
+
+    std::deque<Task> m_tasks;
+    std::map<std::string, StudyState> m_studies;
+    bool m_stop;
+    // Last time a worker flushed aged instance buffers
+    std::chrono::steady_clock::time_point m_lastAgedFlush;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_taskAvailable;
+    std::condition_variable m_spaceAvailable;
+    std::vector<std::thread> m_workers;
+};
@@ -35,6 +35,22 @@ void Profiler::logTransferSize(const std::string& operationName, size_t bytes) {
     metrics.bytesTransferred += bytes;
 }
 
+void Profiler::recordCacheLookup(const std::string& cacheName, bool hit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    auto& metrics = m_caches[cacheName];
+    if (hit) {
+        metrics.hits++;
+    } else {
+        metrics.misses++;
+    }
+}
+
+void Profiler::incrementCounter(const std::string& counterName, size_t amount) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counters[counterName] += amount;
+}
+
 std::string Profiler::generateReport() const {
     std::lock_guard<std::mutex> lock(m_mutex);
     
@@ -72,10 +88,28 @@ std::string Profiler::generateReport() const {
         ss << std::endl;
     }
     
+    for (const auto& [name, metrics] : m_caches) {
+        size_t lookups = metrics.hits + metrics.misses;
+        if (lookups == 0) continue;
+        
+        ss << "Cache: " << name << std::endl;
+        ss << "  Hits: " << metrics.hits << std::endl;
+        ss << "  Misses: " << metrics.misses << std::endl;
+        ss << "  Hit rate: " << std::fixed << std::setprecision(1)
+           << (100.0 * metrics.hits / lookups) << "%" << std::endl;
+        ss << std::endl;
+    }
+    
+    for (const auto& [name, count] : m_counters) {
+        ss << "Counter: " << name << ": " << count << std::endl;
+    }
+    
     return ss.str();
 }
 
 void Profiler::reset() {
     std::lock_guard<std::mutex> lock(m_mutex);
     m_metrics.clear();
+    m_caches.clear();
+    m_counters.clear();
 } 
\ No newline at end of file
@@ -19,6 +19,12 @@ public:
     // Log bytes transferred for an operation
     void logTransferSize(const std::string& operationName, size_t bytes);
     
+    // Count a cache lookup as a hit or a miss
+    void recordCacheLookup(const std::string& cacheName, bool hit);
+    
+    // Add to a named event counter, such as throttled requests
+    void incrementCounter(const std::string& counterName, size_t amount = 1);
+    
     // Generate a performance report
     std::string generateReport() const;
     
@@ -40,6 +46,13 @@ private:
         int count = 0;
     };
     
+    struct CacheMetrics {
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+    
     std::map<std::string, OperationMetrics> m_metrics;
+    std::map<std::string, CacheMetrics> m_caches;
+    std::map<std::string, size_t> m_counters;
     mutable std::mutex m_mutex;
 }; 
\ No newline at end of file
@@ -0,0 +1,128 @@
+#include "run_deadline.h"
+
+#include <cctype>
+#include <limits>
+
+namespace {
+
+// Parse a whole string of decimal digits
+bool parseCount(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 18) {
+        return false;
+    }
+    value = 0;
+    for (char c : text) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+bool RunDeadline::parse(const std::string& spec, std::time_t now, std::chrono::seconds& fromNow) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+        if (spec.size() < 2) {
+            return false;
+        }
+        uint64_t count = 0;
+        if (!parseCount(spec.substr(0, spec.size() - 1), count) || count == 0) {
+            return false;
+        }
+        switch (spec.back()) {
+            case 's':
+                fromNow = std::chrono::seconds(count);
+                return true;
+            case 'm':
+                fromNow = std::chrono::minutes(count);
+                return true;
+            case 'h':
+                fromNow = std::chrono::hours(count);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    uint64_t hour = 0;
+    uint64_t minute = 0;
+    std::string minuteText = spec.substr(colon + 1);
+    if (!parseCount(spec.substr(0, colon), hour) || minuteText.size() != 2 ||
+        !parseCount(minuteText, minute) || hour > 23 || minute > 59) {
+        return false;
+    }
+
+    std::tm local{};
+    localtime_r(&now, &local);
+    local.tm_hour = static_cast<int>(hour);
+    local.tm_min = static_cast<int>(minute);
+    local.tm_sec = 0;
+    local.tm_isdst = -1;
+    std::time_t target = std::mktime(&local);
+    if (target <= now) {
+        // Already past today: the same time tomorrow
+        local.tm_mday++;
+        local.tm_isdst = -1;
+        target = std::mktime(&local);
+    }
+    fromNow = std::chrono::seconds(target - now);
+    return true;
+}
+
+RunDeadline RunDeadline::after(std::chrono::seconds fromNow) {
+    RunDeadline deadline;
+    deadline.at = Clock::now() + fromNow;
+    deadline.set = true;
+    return deadline;
+}
+
+bool RunDeadline::isSet() const {
+    return set;
+}
+
+bool RunDeadline::passed() const {
+    return set && Clock::now() >= at;
+}
+
+RunDeadline::Clock::duration RunDeadline::remaining() const {
+    if (!set) {
+        return Clock::duration::max();
+    }
+    auto now = Clock::now();
+    return now >= at ? Clock::duration::zero() : at - now;
+}
+
+bool parseByteSize(const std::string& spec, uint64_t& bytes) {
+    if (spec.empty()) {
+        return false;
+    }
+    uint64_t multiplier = 1;
+    std::string digits = spec;
+    switch (std::toupper(static_cast<unsigned char>(spec.back()))) {
+        case 'K':
+            multiplier = 1024ULL;
+            break;
+        case 'M':
+            multiplier = 1024ULL * 1024;
+            break;
+        case 'G':
+            multiplier = 1024ULL * 1024 * 1024;
+            break;
+        default:
+            break;
+    }
+    if (multiplier > 1) {
+        digits.pop_back();
+    }
+
+    uint64_t count = 0;
+    if (!parseCount(digits, count) ||
+        count > std::numeric_limits<uint64_t>::max() / multiplier) {
+        return false;
+    }
+    bytes = count * multiplier;
+    return true;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+
+// End of the window a run must finish in (--deadline). A default-constructed
+// deadline is unset and never passes. It is fixed on the steady clock, so
+// wall-clock adjustments during the run don't move it.
+struct RunDeadline {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point at;
+    bool set = false;
+
+    // Parse "HH:MM" (the next time the local clock reads it after now) or a
+    // duration "<n>s", "<n>m" or "<n>h"; fromNow is the time left
+    static bool parse(const std::string& spec, std::time_t now, std::chrono::seconds& fromNow);
+
+    static RunDeadline after(std::chrono::seconds fromNow);
+
+    bool isSet() const;
+    bool passed() const;
+
+    // Time left; zero once passed, and unbounded for an unset deadline
+    Clock::duration remaining() const;
+};
+
+// Parse a byte count with an optional K, M or G suffix (powers of 1024)
+bool parseByteSize(const std::string& spec, uint64_t& bytes);
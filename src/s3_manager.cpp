@@ -1,5 +1,6 @@
 #include "s3_manager.h"
 #include "logger.h"
+#include "utils.h"
 
 #include <aws/core/auth/AWSCredentialsProvider.h>
 #include <aws/s3/model/PutObjectRequest.h>
@@ -7,16 +8,28 @@
 #include <aws/s3/model/DeleteObjectRequest.h>
 #include <aws/s3/model/HeadObjectRequest.h>
 #include <aws/s3/model/ListObjectsV2Request.h>
+#include <aws/s3/model/CopyObjectRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/UploadPartCopyRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/core/utils/StringUtils.h>
 #include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/core/utils/memory/AWSMemory.h>
+#include <aws/core/utils/HashingUtils.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <sys/stat.h>
 
+// Objects larger than this are copied in parts of this size (CopyObject stops at 5 GB)
+static const uint64_t COPY_PART_SIZE = 512ULL * 1024 * 1024;
+
 bool S3Manager::s_awsInitialized = false;
 
-S3Manager::S3Manager(const std::string& region) {
+S3Manager::S3Manager(const std::string& region, unsigned maxConnections) {
     if (!s_awsInitialized) {
         LOG_ERROR("AWS SDK not initialized. Call S3Manager::initializeAWS() first");
         throw std::runtime_error("AWS SDK not initialized");
@@ -25,6 +38,9 @@ S3Manager::S3Manager(const std::string& region) {
     Aws::Client::ClientConfiguration clientConfig;
     clientConfig.region = region;
     clientConfig.scheme = Aws::Http::Scheme::HTTPS;
+    if (maxConnections > 0) {
+        clientConfig.maxConnections = maxConnections;
+    }
     
     // Enable multi-part upload with multi-threading
     clientConfig.executor = Aws::MakeShared<Aws::Utils::Threading::PooledThreadExecutor>("S3Client", 25);
@@ -71,13 +87,32 @@ bool S3Manager::uploadFile(const std::string& bucketName,
         return false;
     }
     
-    const size_t fileSize = statbuf.st_size;
+    if (static_cast<uint64_t>(statbuf.st_size) >= STREAM_UPLOAD_THRESHOLD) {
+        return uploadStream(bucketName, localFilePath, static_cast<size_t>(statbuf.st_size),
+                            s3Key, progressCallback);
+    }
     
-    std::shared_ptr<Aws::IOStream> inputData = 
-        Aws::MakeShared<Aws::FStream>("S3Stream", 
-                                     localFilePath.c_str(), 
-                                     std::ios_base::in | std::ios_base::binary);
+    // Read through FileReader so the source gets sequential read-ahead and
+    // its pages are dropped afterwards instead of crowding the page cache
+    FileBuffer buffer;
+    if (!FileReader::readFile(localFilePath, buffer, m_readOptions)) {
+        LOG_ERROR("Failed to open file for reading: " + localFilePath);
+        return false;
+    }
     
+    LOG_INFO("Uploading file: " + localFilePath + " to S3://" + bucketName + "/" + s3Key);
+    
+    return uploadBuffer(bucketName, buffer.data.data(), buffer.data.size(), s3Key, progressCallback);
+}
+
+bool S3Manager::uploadStream(const std::string& bucketName,
+                             const std::string& localFilePath,
+                             size_t fileSize,
+                             const std::string& s3Key,
+                             std::function<void(size_t)> progressCallback) {
+    std::shared_ptr<Aws::IOStream> inputData = 
+        Aws::MakeShared<Aws::FStream>("S3Stream", localFilePath.c_str(),
+                                      std::ios_base::in | std::ios_base::binary);
     if (!inputData->good()) {
         LOG_ERROR("Failed to open file for reading: " + localFilePath);
         return false;
@@ -90,7 +125,49 @@ bool S3Manager::uploadFile(const std::string& bucketName,
     putObjectRequest.SetContentLength(static_cast<long>(fileSize));
     putObjectRequest.WithServerSideEncryption(Aws::S3::Model::ServerSideEncryption::AES256);
     
-    LOG_INFO("Uploading file: " + localFilePath + " to S3://" + bucketName + "/" + s3Key);
+    LOG_INFO("Streaming file (" + std::to_string(fileSize) + " bytes): " + localFilePath +
+             " to S3://" + bucketName + "/" + s3Key);
+    
+    auto putObjectOutcome = m_s3Client.PutObject(putObjectRequest);
+    
+    // Streamed pages are dropped the same way FileReader drops what it reads
+    if (m_readOptions.dropCache) {
+        Utils::dropFileCache(localFilePath);
+    }
+    
+    if (!putObjectOutcome.IsSuccess()) {
+        auto error = putObjectOutcome.GetError();
+        LOG_ERROR("Failed to upload file to S3: " + 
+                  error.GetExceptionName() + " - " + 
+                  error.GetMessage());
+        return false;
+    }
+    
+    LOG_INFO("Successfully uploaded file to S3: " + s3Key);
+    if (progressCallback) {
+        progressCallback(fileSize);
+    }
+    return true;
+}
+
+bool S3Manager::uploadBuffer(const std::string& bucketName,
+                             const unsigned char* data,
+                             size_t size,
+                             const std::string& s3Key,
+                             std::function<void(size_t)> progressCallback) {
+    // Wrap the caller's buffer without copying; it must outlive the request
+    Aws::Utils::Stream::PreallocatedStreamBuf streamBuf(const_cast<unsigned char*>(data), size);
+    std::shared_ptr<Aws::IOStream> inputData = 
+        Aws::MakeShared<Aws::IOStream>("S3Stream", &streamBuf);
+    
+    Aws::S3::Model::PutObjectRequest putObjectRequest;
+    putObjectRequest.SetBucket(bucketName);
+    putObjectRequest.SetKey(s3Key);
+    putObjectRequest.SetBody(inputData);
+    putObjectRequest.SetContentLength(static_cast<long>(size));
+    putObjectRequest.WithServerSideEncryption(Aws::S3::Model::ServerSideEncryption::AES256);
+    
+    LOG_INFO("Uploading buffer (" + std::to_string(size) + " bytes) to S3://" + bucketName + "/" + s3Key);
     
     auto putObjectOutcome = m_s3Client.PutObject(putObjectRequest);
     
@@ -98,7 +175,7 @@ bool S3Manager::uploadFile(const std::string& bucketName,
         LOG_INFO("Successfully uploaded file to S3: " + s3Key);
         
         if (progressCallback) {
-            progressCallback(fileSize);
+            progressCallback(size);
         }
         
         return true;
@@ -111,6 +188,21 @@ bool S3Manager::uploadFile(const std::string& bucketName,
     }
 }
 
+std::string S3Manager::calculateMd5Hex(const unsigned char* data, size_t size) {
+    Aws::Utils::Stream::PreallocatedStreamBuf streamBuf(const_cast<unsigned char*>(data), size);
+    Aws::IOStream stream(&streamBuf);
+    return Aws::Utils::HashingUtils::HexEncode(Aws::Utils::HashingUtils::CalculateMD5(stream));
+}
+
+bool S3Manager::calculateFileMd5Hex(const std::string& localFilePath, std::string& md5Hex) {
+    Aws::FStream stream(localFilePath.c_str(), std::ios_base::in | std::ios_base::binary);
+    if (!stream.good()) {
+        return false;
+    }
+    md5Hex = Aws::Utils::HashingUtils::HexEncode(Aws::Utils::HashingUtils::CalculateMD5(stream));
+    return true;
+}
+
 bool S3Manager::downloadFile(const std::string& bucketName,
                            const std::string& s3Key,
                            const std::string& localFilePath,
@@ -151,6 +243,137 @@ bool S3Manager::downloadFile(const std::string& bucketName,
     }
 }
 
+bool S3Manager::downloadBuffer(const std::string& bucketName,
+                             const std::string& s3Key,
+                             std::string& data) {
+    Aws::S3::Model::GetObjectRequest getObjectRequest;
+    getObjectRequest.WithBucket(bucketName)
+                     .WithKey(s3Key);
+    
+    auto getObjectOutcome = m_s3Client.GetObject(getObjectRequest);
+    
+    if (getObjectOutcome.IsSuccess()) {
+        std::ostringstream body;
+        body << getObjectOutcome.GetResult().GetBody().rdbuf();
+        data = body.str();
+        return true;
+    } else {
+        auto error = getObjectOutcome.GetError();
+        if (error.GetErrorType() == Aws::S3::S3Errors::NO_SUCH_KEY) {
+            LOG_DEBUG("Object not found in S3: " + s3Key);
+        } else {
+            LOG_ERROR("Failed to download object from S3: " + 
+                      error.GetExceptionName() + " - " + 
+                      error.GetMessage());
+        }
+        return false;
+    }
+}
+
+bool S3Manager::copyObject(const std::string& sourceBucket,
+                           const std::string& sourceKey,
+                           const std::string& destinationBucket,
+                           const std::string& destinationKey,
+                           uint64_t size) {
+    std::string copySource = sourceBucket + "/" +
+                             Aws::Utils::StringUtils::URLEncode(sourceKey.c_str());
+    if (size > COPY_PART_SIZE) {
+        return copyObjectInParts(copySource, destinationBucket, destinationKey, size);
+    }
+    
+    Aws::S3::Model::CopyObjectRequest copyObjectRequest;
+    copyObjectRequest.SetBucket(destinationBucket);
+    copyObjectRequest.SetKey(destinationKey);
+    copyObjectRequest.SetCopySource(copySource);
+    copyObjectRequest.SetServerSideEncryption(Aws::S3::Model::ServerSideEncryption::AES256);
+    
+    auto copyObjectOutcome = m_s3Client.CopyObject(copyObjectRequest);
+    if (!copyObjectOutcome.IsSuccess()) {
+        auto error = copyObjectOutcome.GetError();
+        LOG_ERROR("Failed to copy S3 object " + sourceKey + ": " +
+                  error.GetExceptionName() + " - " + 
+                  error.GetMessage());
+        return false;
+    }
+    
+    LOG_DEBUG("Copied S3://" + sourceBucket + "/" + sourceKey + " to S3://" +
+              destinationBucket + "/" + destinationKey);
+    return true;
+}
+
+bool S3Manager::copyObjectInParts(const std::string& copySource,
+                                  const std::string& destinationBucket,
+                                  const std::string& destinationKey,
+                                  uint64_t size) {
+    Aws::S3::Model::CreateMultipartUploadRequest createRequest;
+    createRequest.SetBucket(destinationBucket);
+    createRequest.SetKey(destinationKey);
+    createRequest.SetServerSideEncryption(Aws::S3::Model::ServerSideEncryption::AES256);
+    
+    auto createOutcome = m_s3Client.CreateMultipartUpload(createRequest);
+    if (!createOutcome.IsSuccess()) {
+        auto error = createOutcome.GetError();
+        LOG_ERROR("Failed to start multipart copy to " + destinationKey + ": " +
+                  error.GetExceptionName() + " - " + 
+                  error.GetMessage());
+        return false;
+    }
+    const Aws::String uploadId = createOutcome.GetResult().GetUploadId();
+    
+    Aws::S3::Model::CompletedMultipartUpload completedUpload;
+    bool copied = true;
+    int partNumber = 1;
+    for (uint64_t offset = 0; offset < size; offset += COPY_PART_SIZE, ++partNumber) {
+        uint64_t last = std::min(offset + COPY_PART_SIZE, size) - 1;
+        
+        Aws::S3::Model::UploadPartCopyRequest partRequest;
+        partRequest.SetBucket(destinationBucket);
+        partRequest.SetKey(destinationKey);
+        partRequest.SetCopySource(copySource);
+        partRequest.SetCopySourceRange("bytes=" + std::to_string(offset) + "-" + std::to_string(last));
+        partRequest.SetPartNumber(partNumber);
+        partRequest.SetUploadId(uploadId);
+        
+        auto partOutcome = m_s3Client.UploadPartCopy(partRequest);
+        if (!partOutcome.IsSuccess()) {
+            auto error = partOutcome.GetError();
+            LOG_ERROR("Failed to copy part " + std::to_string(partNumber) + " of " +
+                      destinationKey + ": " + error.GetExceptionName() + " - " + 
+                      error.GetMessage());
+            copied = false;
+            break;
+        }
+        completedUpload.AddParts(Aws::S3::Model::CompletedPart()
+                                     .WithETag(partOutcome.GetResult().GetCopyPartResult().GetETag())
+                                     .WithPartNumber(partNumber));
+    }
+    
+    if (copied) {
+        Aws::S3::Model::CompleteMultipartUploadRequest completeRequest;
+        completeRequest.SetBucket(destinationBucket);
+        completeRequest.SetKey(destinationKey);
+        completeRequest.SetUploadId(uploadId);
+        completeRequest.SetMultipartUpload(completedUpload);
+        
+        auto completeOutcome = m_s3Client.CompleteMultipartUpload(completeRequest);
+        if (completeOutcome.IsSuccess()) {
+            return true;
+        }
+        auto error = completeOutcome.GetError();
+        LOG_ERROR("Failed to complete multipart copy to " + destinationKey + ": " +
+                  error.GetExceptionName() + " - " + 
+                  error.GetMessage());
+    }
+    
+    // Don't leave the copied parts behind to be billed
+    Aws::S3::Model::AbortMultipartUploadRequest abortRequest;
+    abortRequest.SetBucket(destinationBucket);
+    abortRequest.SetKey(destinationKey);
+    abortRequest.SetUploadId(uploadId);
+    m_s3Client.AbortMultipartUpload(abortRequest);
+    return false;
+}
+
 bool S3Manager::doesObjectExist(const std::string& bucketName, const std::string& s3Key) {
     Aws::S3::Model::HeadObjectRequest headObjectRequest;
     headObjectRequest.WithBucket(bucketName)
@@ -182,6 +405,10 @@ bool S3Manager::deleteObject(const std::string& bucketName, const std::string& s
     }
 }
 
+void S3Manager::setReadOptions(const FileReadOptions& options) {
+    m_readOptions = options;
+}
+
 std::vector<std::string> S3Manager::listObjects(const std::string& bucketName, 
                                               const std::string& prefix) {
     std::vector<std::string> keys;
@@ -217,4 +444,37 @@ std::vector<std::string> S3Manager::listObjects(const std::string& bucketName,
     }
     
     return keys;
+}
+
+bool S3Manager::listObjectInfos(const std::string& bucketName,
+                                const std::string& prefix,
+                                std::vector<S3ObjectInfo>& objects) {
+    Aws::S3::Model::ListObjectsV2Request listObjectsRequest;
+    listObjectsRequest.WithBucket(bucketName).WithPrefix(prefix);
+    
+    while (true) {
+        auto listObjectsOutcome = m_s3Client.ListObjectsV2(listObjectsRequest);
+        if (!listObjectsOutcome.IsSuccess()) {
+            auto error = listObjectsOutcome.GetError();
+            LOG_ERROR("Failed to list objects from S3: " + 
+                      error.GetExceptionName() + " - " + 
+                      error.GetMessage());
+            return false;
+        }
+        
+        const auto& result = listObjectsOutcome.GetResult();
+        for (const auto& object : result.GetContents()) {
+            S3ObjectInfo info;
+            info.key = object.GetKey();
+            info.size = static_cast<uint64_t>(object.GetSize());
+            info.etag = object.GetETag();
+            info.etag.erase(std::remove(info.etag.begin(), info.etag.end(), '"'), info.etag.end());
+            objects.push_back(std::move(info));
+        }
+        
+        if (!result.GetIsTruncated()) {
+            return true;
+        }
+        listObjectsRequest.SetContinuationToken(result.GetNextContinuationToken());
+    }
 } 
\ No newline at end of file
@@ -1,31 +1,66 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <cstdint>
 #include <aws/core/Aws.h>
 #include <aws/s3/S3Client.h>
 #include <functional>
+#include "file_reader.h"
+
+// One object from a bucket listing
+struct S3ObjectInfo {
+    std::string key;
+    uint64_t size = 0;
+    std::string etag;   // Unquoted; the MD5 of the bytes unless uploaded in parts
+};
 
 class S3Manager {
 public:
-    S3Manager(const std::string& region = "ap-south-1");
+    // maxConnections caps the client's HTTP connection pool (0 keeps the SDK default)
+    S3Manager(const std::string& region = "ap-south-1", unsigned maxConnections = 0);
     ~S3Manager();
     
     // Initialize AWS SDK
     static bool initializeAWS();
     static void shutdownAWS();
     
+    // Files at least this large are streamed from disk by uploadFile instead of
+    // being read into memory first
+    static constexpr uint64_t STREAM_UPLOAD_THRESHOLD = 64ULL * 1024 * 1024;
+    
     // Upload a file to S3
     bool uploadFile(const std::string& bucketName, 
                     const std::string& localFilePath,
                     const std::string& s3Key,
                     std::function<void(size_t)> progressCallback = nullptr);
     
+    // Upload a buffer that has already been read into memory
+    bool uploadBuffer(const std::string& bucketName,
+                      const unsigned char* data,
+                      size_t size,
+                      const std::string& s3Key,
+                      std::function<void(size_t)> progressCallback = nullptr);
+    
     // Download a file from S3
     bool downloadFile(const std::string& bucketName,
                       const std::string& s3Key,
                       const std::string& localFilePath,
                       std::function<void(size_t)> progressCallback = nullptr);
     
+    // Download a small object into memory; a missing key fails quietly
+    bool downloadBuffer(const std::string& bucketName,
+                        const std::string& s3Key,
+                        std::string& data);
+    
+    // Server-side copy of an object into this client's region; objects over
+    // the part size are copied in parts with UploadPartCopy
+    bool copyObject(const std::string& sourceBucket,
+                    const std::string& sourceKey,
+                    const std::string& destinationBucket,
+                    const std::string& destinationKey,
+                    uint64_t size);
+    
     // Check if a file exists in S3
     bool doesObjectExist(const std::string& bucketName, const std::string& s3Key);
     
@@ -36,7 +71,34 @@ public:
     std::vector<std::string> listObjects(const std::string& bucketName, 
                                          const std::string& prefix = "");
     
+    // List objects under a prefix with their sizes and ETags; false if a page failed
+    bool listObjectInfos(const std::string& bucketName,
+                         const std::string& prefix,
+                         std::vector<S3ObjectInfo>& objects);
+    
+    // Hex-encoded MD5 of an in-memory object
+    static std::string calculateMd5Hex(const unsigned char* data, size_t size);
+    
+    // Hex-encoded MD5 of a file, read as a stream; false if it can't be opened
+    static bool calculateFileMd5Hex(const std::string& localFilePath, std::string& md5Hex);
+    
+    // Page-cache behaviour used when uploadFile reads its source
+    void setReadOptions(const FileReadOptions& options);
+    
 private:
+    // Upload a large file straight from disk without buffering it whole
+    bool uploadStream(const std::string& bucketName,
+                      const std::string& localFilePath,
+                      size_t fileSize,
+                      const std::string& s3Key,
+                      std::function<void(size_t)> progressCallback);
+    
+    bool copyObjectInParts(const std::string& copySource,
+                           const std::string& destinationBucket,
+                           const std::string& destinationKey,
+                           uint64_t size);
+    
     Aws::S3::S3Client m_s3Client;
+    FileReadOptions m_readOptions;
     static bool s_awsInitialized;
 }; 
\ No newline at end of file
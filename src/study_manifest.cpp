@@ -0,0 +1,108 @@
+#include "study_manifest.h"
+#include "binary_io.h"
+
+#include <sstream>
+#include <cstring>
+#include <cstdint>
+
+// Manifest layout:
+//   "DTSM" uint32 version, string studyUid, then the study body:
+//   uint32 fieldCount, StudyRecord fields in StudyRecord::fields() order
+//   uint32 instanceCount, per instance: s3Key, seriesUid, sopInstanceUid,
+//   int32 instanceNumber, uint64 size, contentHash
+
+namespace {
+
+const char MANIFEST_MAGIC[4] = {'D', 'T', 'S', 'M'};
+const uint32_t MANIFEST_FORMAT_VERSION = 1;
+
+} // namespace
+
+std::string StudyManifest::objectKey(const std::string& studyUid) {
+    return "manifests/" + studyUid + ".manifest";
+}
+
+std::string StudyManifest::encode(const StudyRecord& record,
+                                  const std::vector<InstanceRecord>& instances) {
+    std::ostringstream out(std::ios::binary);
+    out.write(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    BinaryIO::writeValue<uint32_t>(out, MANIFEST_FORMAT_VERSION);
+    BinaryIO::writeString(out, record.studyInstanceUid);
+    writeStudy(out, record, instances);
+    return out.str();
+}
+
+bool StudyManifest::decode(const std::string& data,
+                           const std::string& studyUid,
+                           StudyRecord& record,
+                           std::vector<InstanceRecord>& instances) {
+    std::istringstream in(data, std::ios::binary);
+
+    char magic[sizeof(MANIFEST_MAGIC)];
+    uint32_t version = 0;
+    std::string manifestStudy;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MANIFEST_MAGIC, sizeof(magic)) != 0 ||
+        !BinaryIO::readValue(in, version) || version != MANIFEST_FORMAT_VERSION ||
+        !BinaryIO::readString(in, manifestStudy) || manifestStudy != studyUid) {
+        return false;
+    }
+    return readStudy(in, studyUid, record, instances);
+}
+
+void StudyManifest::writeStudy(std::ostream& out,
+                               const StudyRecord& record,
+                               const std::vector<InstanceRecord>& instances) {
+    BinaryIO::writeValue<uint32_t>(out, static_cast<uint32_t>(StudyRecord::fields().size()));
+    for (const auto& field : StudyRecord::fields()) {
+        BinaryIO::writeString(out, record.*field.member);
+    }
+
+    BinaryIO::writeValue<uint32_t>(out, static_cast<uint32_t>(instances.size()));
+    for (const auto& instance : instances) {
+        BinaryIO::writeString(out, instance.s3Key);
+        BinaryIO::writeString(out, instance.seriesUid);
+        BinaryIO::writeString(out, instance.sopInstanceUid);
+        BinaryIO::writeValue<int32_t>(out, instance.instanceNumber);
+        BinaryIO::writeValue<uint64_t>(out, instance.size);
+        BinaryIO::writeString(out, instance.contentHash);
+    }
+}
+
+bool StudyManifest::readStudy(std::istream& in,
+                              const std::string& studyUid,
+                              StudyRecord& record,
+                              std::vector<InstanceRecord>& instances) {
+    StudyRecord readRecord;
+    uint32_t fieldCount = 0;
+    if (!BinaryIO::readValue(in, fieldCount) || fieldCount != StudyRecord::fields().size()) {
+        return false;
+    }
+    for (const auto& field : StudyRecord::fields()) {
+        if (!BinaryIO::readString(in, readRecord.*field.member)) {
+            return false;
+        }
+    }
+
+    uint32_t instanceCount = 0;
+    if (!BinaryIO::readValue(in, instanceCount) || instanceCount > BinaryIO::MAX_LENGTH) {
+        return false;
+    }
+    std::vector<InstanceRecord> readInstances(instanceCount);
+    for (auto& instance : readInstances) {
+        int32_t instanceNumber = 0;
+        instance.studyUid = studyUid;
+        if (!BinaryIO::readString(in, instance.s3Key) ||
+            !BinaryIO::readString(in, instance.seriesUid) ||
+            !BinaryIO::readString(in, instance.sopInstanceUid) ||
+            !BinaryIO::readValue(in, instanceNumber) ||
+            !BinaryIO::readValue(in, instance.size) ||
+            !BinaryIO::readString(in, instance.contentHash)) {
+            return false;
+        }
+        instance.instanceNumber = instanceNumber;
+    }
+
+    record = std::move(readRecord);
+    instances = std::move(readInstances);
+    return true;
+}
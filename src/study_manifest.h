@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <istream>
+#include <ostream>
+
+#include "study_record.h"
+
+// Binary manifest of a completed study: its record plus every instance's
+// key, size, hash and position, in download order. The uploader stores one
+// per study in S3 so a download can be planned from a single GET.
+class StudyManifest {
+public:
+    // S3 key of a study's manifest
+    static std::string objectKey(const std::string& studyUid);
+
+    // Serialize a study; instances are written in the order given
+    static std::string encode(const StudyRecord& record,
+                              const std::vector<InstanceRecord>& instances);
+
+    // Parse a manifest; false if it is truncated, for another study or another format version
+    static bool decode(const std::string& data,
+                       const std::string& studyUid,
+                       StudyRecord& record,
+                       std::vector<InstanceRecord>& instances);
+
+    // Record and instance list without a header, shared with the metadata cache
+    static void writeStudy(std::ostream& out,
+                           const StudyRecord& record,
+                           const std::vector<InstanceRecord>& instances);
+
+    static bool readStudy(std::istream& in,
+                          const std::string& studyUid,
+                          StudyRecord& record,
+                          std::vector<InstanceRecord>& instances);
+};
@@ -0,0 +1,214 @@
+#include "study_record.h"
+#include "binary_io.h"
+
+#include <algorithm>
+#include <sstream>
+#include <ctime>
+#include <iomanip>
+
+void sortInstances(std::vector<InstanceRecord>& instances) {
+    std::stable_sort(instances.begin(), instances.end(),
+        [](const InstanceRecord& a, const InstanceRecord& b) {
+            if (a.seriesUid != b.seriesUid) {
+                return a.seriesUid < b.seriesUid;
+            }
+            return a.instanceNumber < b.instanceNumber;
+        });
+}
+
+std::string instancesChecksum(const std::vector<InstanceRecord>& instances) {
+    std::vector<std::string> lines;
+    lines.reserve(instances.size());
+    for (const auto& instance : instances) {
+        lines.push_back(instance.instanceKey() + '\t' + instance.s3Key + '\t' +
+                        std::to_string(instance.size) + '\t' + instance.contentHash + '\n');
+    }
+    std::sort(lines.begin(), lines.end());
+
+    // FNV-1a over the sorted lines
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto& line : lines) {
+        for (unsigned char c : line) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+    }
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return out.str();
+}
+
+const std::vector<StudyRecord::Field>& StudyRecord::fields() {
+    static const std::vector<Field> fieldTable = {
+        {"PatientID", "0010,0020", &StudyRecord::patientId},
+        {"PatientName", "0010,0010", &StudyRecord::patientName},
+        {"StudyDate", "0008,0020", &StudyRecord::studyDate},
+        {"StudyTime", "0008,0030", &StudyRecord::studyTime},
+        {"AccessionNumber", "0008,0050", &StudyRecord::accessionNumber},
+        {"StudyID", "0020,0010", &StudyRecord::studyId},
+        {"StudyInstanceUID", "0020,000D", &StudyRecord::studyInstanceUid},
+        {"StudyDescription", "0008,1030", &StudyRecord::studyDescription},
+        {"Modality", "0008,0060", &StudyRecord::modality},
+        {"SeriesInstanceUID", "0020,000E", &StudyRecord::seriesInstanceUid},
+        {"SeriesNumber", "0020,0011", &StudyRecord::seriesNumber},
+        {"SeriesDescription", "0008,103E", &StudyRecord::seriesDescription},
+        {"SOPInstanceUID", "0008,0018", &StudyRecord::sopInstanceUid}
+    };
+    return fieldTable;
+}
+
+Json::Value StudyRecord::toJson() const {
+    Json::Value json(Json::objectValue);
+    for (const auto& field : fields()) {
+        const std::string& value = this->*field.member;
+        if (!value.empty()) {
+            json[field.name] = value;
+        }
+    }
+    for (const auto& [name, value] : extendedAttributes) {
+        if (!json.isMember(name)) {
+            json[name] = value;
+        }
+    }
+    return json;
+}
+
+StudyRecord StudyRecord::fromJson(const Json::Value& json) {
+    StudyRecord record;
+    for (const auto& field : fields()) {
+        const Json::Value& value = json[field.name];
+        if (value.isString()) {
+            record.*field.member = value.asString();
+        }
+    }
+    return record;
+}
+
+std::string StudyRecord::packAttributes() const {
+    std::vector<std::pair<std::string, const std::string*>> attributes;
+    for (const auto& field : fields()) {
+        if (!(this->*field.member).empty()) {
+            attributes.emplace_back(field.name, &(this->*field.member));
+        }
+    }
+    for (const auto& [name, value] : extendedAttributes) {
+        attributes.emplace_back(name, &value);
+    }
+
+    std::ostringstream out(std::ios::binary);
+    BinaryIO::writeValue<uint32_t>(out, static_cast<uint32_t>(attributes.size()));
+    for (const auto& [name, value] : attributes) {
+        BinaryIO::writeString(out, name);
+        BinaryIO::writeString(out, *value);
+    }
+    return out.str();
+}
+
+bool StudyRecord::unpackAttributes(const std::string& data) {
+    std::istringstream in(data, std::ios::binary);
+    uint32_t count = 0;
+    if (!BinaryIO::readValue(in, count) || count > BinaryIO::MAX_LENGTH) {
+        return false;
+    }
+
+    std::map<std::string, std::string> attributes;
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string name;
+        std::string value;
+        if (!BinaryIO::readString(in, name) || !BinaryIO::readString(in, value)) {
+            return false;
+        }
+        attributes[name] = value;
+    }
+
+    // Named fields go to their members, everything else stays extended
+    for (const auto& field : fields()) {
+        auto it = attributes.find(field.name);
+        if (it != attributes.end()) {
+            this->*field.member = it->second;
+            attributes.erase(it);
+        }
+    }
+    extendedAttributes = std::move(attributes);
+    return true;
+}
+
+namespace {
+
+// Parse a DICOM DA value into a normalized calendar date
+bool parseDate(const std::string& date, std::tm& tm) {
+    if (date.size() != 8 || date.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    tm = std::tm();
+    tm.tm_year = std::stoi(date.substr(0, 4)) - 1900;
+    tm.tm_mon = std::stoi(date.substr(4, 2)) - 1;
+    tm.tm_mday = std::stoi(date.substr(6, 2));
+    tm.tm_hour = 12;  // Clear of DST transitions when stepping by days
+
+    std::tm normalized = tm;
+    if (std::mktime(&normalized) == -1) {
+        return false;
+    }
+    // Reject dates mktime had to roll over, such as 20240230
+    return normalized.tm_mday == tm.tm_mday && normalized.tm_mon == tm.tm_mon;
+}
+
+} // namespace
+
+bool StudyQuery::empty() const {
+    return patientId.empty() && accessionNumber.empty() &&
+           studyDateFrom.empty() && studyDateTo.empty();
+}
+
+bool StudyQuery::matches(const StudyRecord& record) const {
+    if (!patientId.empty() && record.patientId != patientId) {
+        return false;
+    }
+    if (!accessionNumber.empty() && record.accessionNumber != accessionNumber) {
+        return false;
+    }
+    // DA values compare correctly as strings
+    if (!studyDateFrom.empty() && record.studyDate < studyDateFrom) {
+        return false;
+    }
+    if (!studyDateTo.empty() && (record.studyDate.empty() || record.studyDate > studyDateTo)) {
+        return false;
+    }
+    return true;
+}
+
+bool StudyQuery::setDateRange(const std::string& range) {
+    std::tm tm;
+    size_t dash = range.find('-');
+    std::string from = range.substr(0, dash);
+    std::string to = dash == std::string::npos ? from : range.substr(dash + 1);
+
+    if ((!from.empty() && !parseDate(from, tm)) || (!to.empty() && !parseDate(to, tm)) ||
+        (from.empty() && to.empty())) {
+        return false;
+    }
+    studyDateFrom = from;
+    studyDateTo = to;
+    return true;
+}
+
+std::vector<std::string> StudyQuery::expandDates(const std::string& from, const std::string& to) {
+    std::vector<std::string> dates;
+    std::tm current;
+    std::tm last;
+    if (!parseDate(from, current) || !parseDate(to.empty() ? from : to, last)) {
+        return dates;
+    }
+
+    std::time_t lastTime = std::mktime(&last);
+    for (std::time_t time = std::mktime(&current); time <= lastTime; ) {
+        char buffer[9];
+        std::strftime(buffer, sizeof(buffer), "%Y%m%d", &current);
+        dates.push_back(buffer);
+
+        current.tm_mday++;
+        time = std::mktime(&current);
+    }
+    return dates;
+}
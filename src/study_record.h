@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <json/json.h>
+
+// One uploaded DICOM instance, stored as its own item in the instance table
+struct InstanceRecord {
+    std::string studyUid;
+    std::string seriesUid;
+    std::string sopInstanceUid;
+    std::string s3Key;
+    int instanceNumber = 0;
+    uint64_t size = 0;
+    std::string contentHash;   // Hex MD5 of the object bytes
+
+    // Local source file; never stored
+    std::string sourcePath;
+
+    // Sort key within the study: series then SOP instance, or the S3 key when those are unknown
+    std::string instanceKey() const {
+        if (seriesUid.empty() || sopInstanceUid.empty()) {
+            return s3Key;
+        }
+        return seriesUid + "#" + sopInstanceUid;
+    }
+};
+
+// Download order: series, then instance number within each series
+void sortInstances(std::vector<InstanceRecord>& instances);
+
+// Order-independent checksum of a study's instance items (key, object, size
+// and content hash), stored on the study item when it is committed
+std::string instancesChecksum(const std::vector<InstanceRecord>& instances);
+
+// Study-level DICOM attributes, filled straight from the dataset and
+// converted to DynamoDB items without an intermediate JSON document
+struct StudyRecord {
+    std::string patientId;
+    std::string patientName;
+    std::string studyDate;
+    std::string studyTime;
+    std::string accessionNumber;
+    std::string studyId;
+    std::string studyInstanceUid;
+    std::string studyDescription;
+    std::string modality;
+    std::string seriesInstanceUid;
+    std::string seriesNumber;
+    std::string seriesDescription;
+    std::string sopInstanceUid;
+
+    // Every other non-bulk top-level attribute of the dataset, keyed by DICOM
+    // keyword. Stored only inside the compressed metadata blob.
+    std::map<std::string, std::string> extendedAttributes;
+
+    // Attribute name, DICOM tag ("gggg,eeee") and member for each field
+    struct Field {
+        const char* name;
+        const char* tag;
+        std::string StudyRecord::* member;
+    };
+    static const std::vector<Field>& fields();
+
+    // JSON view of the non-empty fields, built only when requested
+    Json::Value toJson() const;
+
+    // Fill from a JSON document, ignoring attributes that are not fields
+    static StudyRecord fromJson(const Json::Value& json);
+
+    // Fields and extended attributes as binary name/value pairs, and back
+    std::string packAttributes() const;
+    bool unpackAttributes(const std::string& data);
+};
+
+// Criteria for finding studies through the study table's secondary indexes.
+// Dates are DICOM DA values (YYYYMMDD); either end of the range may be open.
+struct StudyQuery {
+    std::string patientId;
+    std::string accessionNumber;
+    std::string studyDateFrom;
+    std::string studyDateTo;
+
+    bool empty() const;
+
+    // Whether a study satisfies every criterion that is set
+    bool matches(const StudyRecord& record) const;
+
+    // Parse "YYYYMMDD" or "YYYYMMDD-YYYYMMDD" into studyDateFrom/studyDateTo
+    bool setDateRange(const std::string& range);
+
+    // Every date from 'from' to 'to' inclusive ('to' defaults to 'from');
+    // empty if either date is invalid or the range is reversed
+    static std::vector<std::string> expandDates(const std::string& from, const std::string& to);
+};
@@ -0,0 +1,42 @@
+#include "study_shard.h"
+
+bool StudyShard::parse(const std::string& spec, StudyShard& shard) {
+    size_t slash = spec.find('/');
+    if (slash == std::string::npos) {
+        return false;
+    }
+    try {
+        size_t indexEnd = 0;
+        size_t countEnd = 0;
+        std::string indexText = spec.substr(0, slash);
+        std::string countText = spec.substr(slash + 1);
+        unsigned long long index = std::stoull(indexText, &indexEnd);
+        unsigned long long count = std::stoull(countText, &countEnd);
+        if (indexEnd != indexText.size() || countEnd != countText.size() ||
+            count == 0 || index >= count) {
+            return false;
+        }
+        shard.index = static_cast<size_t>(index);
+        shard.count = static_cast<size_t>(count);
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+uint64_t StudyShard::hashStudyUid(const std::string& studyUid) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : studyUid) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool StudyShard::owns(const std::string& studyUid) const {
+    return count <= 1 || hashStudyUid(studyUid) % count == index;
+}
+
+bool StudyShard::isSharded() const {
+    return count > 1;
+}
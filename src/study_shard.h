@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// Static split of studies across workers: worker i of N uploads the studies
+// whose UID hashes to i mod N. The hash is fixed (FNV-1a) so every build and
+// platform agrees on the assignment.
+struct StudyShard {
+    size_t index = 0;
+    size_t count = 1;
+
+    // Parse "i/N" with 0 <= i < N
+    static bool parse(const std::string& spec, StudyShard& shard);
+
+    static uint64_t hashStudyUid(const std::string& studyUid);
+
+    bool owns(const std::string& studyUid) const;
+
+    // Whether this is a real split rather than the single whole shard
+    bool isSharded() const;
+};
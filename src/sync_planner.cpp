@@ -0,0 +1,270 @@
+#include "sync_planner.h"
+#include "s3_manager.h"
+#include "dynamodb_manager.h"
+#include "dicom_processor.h"
+#include "bounded_queue.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Paths the walker may get ahead of the parsers
+const size_t PATH_QUEUE_CAPACITY = 1024;
+
+// Files each hashing thread keeps in flight
+const size_t HASH_QUEUE_DEPTH = 32;
+
+// The MD5 an ETag carries; empty for multipart ETags ("<md5>-<parts>"), which don't
+std::string etagMd5(const std::string& etag) {
+    return etag.find('-') == std::string::npos ? etag : std::string();
+}
+
+} // namespace
+
+SyncPlanner::SyncPlanner(S3Manager& s3Manager,
+                         DynamoDBManager& dbManager,
+                         const std::string& bucketName,
+                         const std::string& tableName,
+                         size_t threadCount,
+                         const FileReadOptions& readOptions)
+    : m_s3Manager(s3Manager),
+      m_dbManager(dbManager),
+      m_bucketName(bucketName),
+      m_tableName(tableName),
+      m_threadCount(std::max<size_t>(threadCount, 1)),
+      m_readOptions(readOptions) {
+}
+
+bool SyncPlanner::needsHash(const InstanceRecord& local, const S3ObjectInfo* object) {
+    return object && object->size == local.size;
+}
+
+SyncAction SyncPlanner::classify(const InstanceRecord& local,
+                                 const S3ObjectInfo* object,
+                                 const InstanceRecord* indexed) {
+    if (!object) {
+        return SyncAction::UPLOAD_NEW;
+    }
+    if (!needsHash(local, object)) {
+        return SyncAction::UPLOAD_CHANGED;
+    }
+
+    // The indexed hash is authoritative; an ETag only stands in when it is a plain MD5
+    std::string remoteHash = indexed && !indexed->contentHash.empty()
+                                 ? indexed->contentHash
+                                 : etagMd5(object->etag);
+    if (remoteHash.empty() || remoteHash != local.contentHash) {
+        return SyncAction::UPLOAD_CHANGED;
+    }
+    return indexed ? SyncAction::UP_TO_DATE : SyncAction::INDEX_ONLY;
+}
+
+bool SyncPlanner::plan(const std::string& sourcePath, SyncPlan& plan) {
+    std::map<std::string, std::vector<InstanceRecord>> studies;
+    if (!scan(sourcePath, studies)) {
+        return false;
+    }
+
+    std::vector<std::string> studyUids;
+    for (const auto& entry : studies) {
+        studyUids.push_back(entry.first);
+    }
+    std::map<std::string, S3ObjectInfo> objects;
+    std::map<std::string, InstanceRecord> indexed;
+    if (!fetchRemote(studyUids, objects, indexed)) {
+        return false;
+    }
+
+    auto findObject = [&](const InstanceRecord& instance) -> const S3ObjectInfo* {
+        auto it = objects.find(instance.s3Key);
+        return it == objects.end() ? nullptr : &it->second;
+    };
+
+    std::vector<InstanceRecord*> toHash;
+    for (auto& entry : studies) {
+        for (auto& instance : entry.second) {
+            if (needsHash(instance, findObject(instance))) {
+                toHash.push_back(&instance);
+            }
+        }
+    }
+    LOG_INFO("Verifying checksums of " + std::to_string(toHash.size()) + " files");
+    hashFiles(toHash);
+
+    plan = SyncPlan();
+    plan.studies = studies.size();
+    for (auto& entry : studies) {
+        for (auto& instance : entry.second) {
+            auto indexedIt = indexed.find(instance.s3Key);
+            SyncAction action = classify(instance, findObject(instance),
+                                         indexedIt == indexed.end() ? nullptr : &indexedIt->second);
+            switch (action) {
+                case SyncAction::UP_TO_DATE:
+                    plan.upToDate++;
+                    break;
+                case SyncAction::INDEX_ONLY:
+                    plan.indexOnly.push_back(std::move(instance));
+                    break;
+                case SyncAction::UPLOAD_NEW:
+                case SyncAction::UPLOAD_CHANGED:
+                    if (action == SyncAction::UPLOAD_NEW) {
+                        plan.newFiles++;
+                    } else {
+                        plan.changedFiles++;
+                    }
+                    plan.uploadBytes += instance.size;
+                    plan.uploads.push_back(std::move(instance));
+                    break;
+            }
+        }
+    }
+    return true;
+}
+
+bool SyncPlanner::scan(const std::string& sourcePath,
+                       std::map<std::string, std::vector<InstanceRecord>>& studies) {
+    DicomProcessor dicomProcessor;
+    BoundedQueue<std::string> paths(PATH_QUEUE_CAPACITY);
+    std::mutex studiesMutex;
+
+    auto parse = [&]() {
+        std::string path;
+        while (paths.pop(path)) {
+            InstanceRecord instance;
+            if (!dicomProcessor.isDicomFile(path) ||
+                !dicomProcessor.extractInstanceRecord(path, instance)) {
+                continue;
+            }
+            std::error_code ec;
+            instance.size = fs::file_size(path, ec);
+            if (ec) {
+                LOG_WARNING("Could not stat file: " + path);
+                continue;
+            }
+            instance.s3Key = Utils::generateS3Key(instance.studyUid, path);
+
+            std::lock_guard<std::mutex> lock(studiesMutex);
+            studies[instance.studyUid].push_back(std::move(instance));
+        }
+    };
+
+    std::vector<std::thread> parsers;
+    for (size_t i = 0; i < m_threadCount; ++i) {
+        parsers.emplace_back(parse);
+    }
+
+    bool success = true;
+    try {
+        fs::recursive_directory_iterator it(sourcePath, fs::directory_options::skip_permission_denied);
+        for (const auto& entry : it) {
+            if (entry.is_regular_file()) {
+                paths.push(entry.path().string());
+            }
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Error listing files in directory: " + sourcePath + " - " + e.what());
+        success = false;
+    }
+
+    paths.close();
+    for (auto& parser : parsers) {
+        parser.join();
+    }
+    return success;
+}
+
+bool SyncPlanner::fetchRemote(const std::vector<std::string>& studyUids,
+                              std::map<std::string, S3ObjectInfo>& objects,
+                              std::map<std::string, InstanceRecord>& indexed) {
+    std::mutex remoteMutex;
+
+    // Instance items arrive page by page from parallel queries
+    auto indexing = std::async(std::launch::async, [&]() {
+        return m_dbManager.streamInstancesForStudies(m_tableName, studyUids, m_threadCount,
+            [&](const std::vector<InstanceRecord>& page) {
+                std::lock_guard<std::mutex> lock(remoteMutex);
+                for (const auto& instance : page) {
+                    indexed[instance.s3Key] = instance;
+                }
+                return true;
+            });
+    });
+
+    // Meanwhile list each study's objects; an empty file name yields the study's key prefix
+    std::atomic<size_t> nextStudy(0);
+    auto listStudies = [&]() {
+        bool success = true;
+        size_t index;
+        while ((index = nextStudy++) < studyUids.size()) {
+            std::vector<S3ObjectInfo> listed;
+            if (!m_s3Manager.listObjectInfos(m_bucketName,
+                                             Utils::generateS3Key(studyUids[index], ""), listed)) {
+                success = false;
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(remoteMutex);
+            for (auto& object : listed) {
+                std::string key = object.key;
+                objects[key] = std::move(object);
+            }
+        }
+        return success;
+    };
+
+    std::vector<std::future<bool>> listings;
+    for (size_t i = 1; i < std::min(m_threadCount, studyUids.size()); ++i) {
+        listings.push_back(std::async(std::launch::async, listStudies));
+    }
+    bool success = listStudies();
+    for (auto& listing : listings) {
+        success &= listing.get();
+    }
+    if (!indexing.get()) {
+        LOG_ERROR("Failed to read instance items for sync");
+        success = false;
+    }
+    return success;
+}
+
+void SyncPlanner::hashFiles(std::vector<InstanceRecord*>& instances) {
+    std::atomic<size_t> nextBatch(0);
+    auto hashBatches = [&]() {
+        FileReader fileReader(HASH_QUEUE_DEPTH, m_readOptions);
+        size_t begin;
+        while ((begin = nextBatch.fetch_add(HASH_QUEUE_DEPTH)) < instances.size()) {
+            size_t end = std::min(begin + HASH_QUEUE_DEPTH, instances.size());
+            std::map<std::string, InstanceRecord*> byPath;
+            std::vector<std::string> paths;
+            for (size_t i = begin; i < end; ++i) {
+                byPath[instances[i]->sourcePath] = instances[i];
+                paths.push_back(instances[i]->sourcePath);
+            }
+            fileReader.readBatch(paths, [&](FileBuffer&& buffer) {
+                if (!buffer.ok) {
+                    // Left unhashed, so it is planned as changed and the upload reports the error
+                    LOG_WARNING("Failed to read file: " + buffer.path);
+                    return;
+                }
+                byPath[buffer.path]->contentHash =
+                    S3Manager::calculateMd5Hex(buffer.data.data(), buffer.data.size());
+            });
+        }
+    };
+
+    std::vector<std::thread> hashers;
+    for (size_t i = 1; i < m_threadCount; ++i) {
+        hashers.emplace_back(hashBatches);
+    }
+    hashBatches();
+    for (auto& hasher : hashers) {
+        hasher.join();
+    }
+}
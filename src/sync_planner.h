@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "file_reader.h"
+#include "study_record.h"
+
+class S3Manager;
+class DynamoDBManager;
+struct S3ObjectInfo;
+
+// What --sync does with one local instance
+enum class SyncAction {
+    UP_TO_DATE,      // Object and instance item both match the local file
+    UPLOAD_NEW,      // No object under its key
+    UPLOAD_CHANGED,  // An object with another size or checksum
+    INDEX_ONLY       // The object matches but its instance item is missing
+};
+
+// Result of comparing a local tree with S3 and DynamoDB
+struct SyncPlan {
+    std::vector<InstanceRecord> uploads;     // New and changed files
+    std::vector<InstanceRecord> indexOnly;   // Already in S3; only their items are written
+    size_t studies = 0;
+    size_t upToDate = 0;
+    size_t newFiles = 0;
+    size_t changedFiles = 0;
+    uint64_t uploadBytes = 0;
+};
+
+// Plans a sync: scans and parses the tree, then fetches each study's remote
+// state in bulk (one S3 listing and one instance-table query per study, not a
+// HEAD per file). Only files whose size matches their object are read and
+// hashed, so a changed file is usually caught by its size alone.
+class SyncPlanner {
+public:
+    SyncPlanner(S3Manager& s3Manager,
+                DynamoDBManager& dbManager,
+                const std::string& bucketName,
+                const std::string& tableName,
+                size_t threadCount,
+                const FileReadOptions& readOptions);
+
+    SyncPlanner(const SyncPlanner&) = delete;
+    SyncPlanner& operator=(const SyncPlanner&) = delete;
+
+    // Build the plan for sourcePath; false if the remote state could not be read
+    bool plan(const std::string& sourcePath, SyncPlan& plan);
+
+    // Whether classifying the file needs its checksum (its size matches the object)
+    static bool needsHash(const InstanceRecord& local, const S3ObjectInfo* object);
+
+    // Compare a local file with its object and instance item, either of which
+    // may be missing; local.contentHash must be set when needsHash is true
+    static SyncAction classify(const InstanceRecord& local,
+                               const S3ObjectInfo* object,
+                               const InstanceRecord* indexed);
+
+private:
+    // Walk and parse the tree into instances grouped by study
+    bool scan(const std::string& sourcePath,
+              std::map<std::string, std::vector<InstanceRecord>>& studies);
+
+    // List the objects and instance items of every study, keyed by S3 key
+    bool fetchRemote(const std::vector<std::string>& studyUids,
+                     std::map<std::string, S3ObjectInfo>& objects,
+                     std::map<std::string, InstanceRecord>& indexed);
+
+    // Fill contentHash for each instance, reading the files in parallel batches
+    void hashFiles(std::vector<InstanceRecord*>& instances);
+
+    S3Manager& m_s3Manager;
+    DynamoDBManager& m_dbManager;
+    std::string m_bucketName;
+    std::string m_tableName;
+    size_t m_threadCount;
+    FileReadOptions m_readOptions;
+};
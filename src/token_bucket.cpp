@@ -0,0 +1,64 @@
+#include "token_bucket.h"
+
+#include <algorithm>
+#include <thread>
+
+TokenBucket::TokenBucket(double unitsPerSecond, double burstSeconds)
+    : m_rate(std::max(unitsPerSecond, 0.0)),
+      m_burstSeconds(std::max(burstSeconds, 0.0)),
+      m_tokens(m_rate * m_burstSeconds),
+      m_lastRefill(std::chrono::steady_clock::now()) {
+}
+
+double TokenBucket::capacity() const {
+    return std::max(m_rate * m_burstSeconds, 1.0);
+}
+
+void TokenBucket::refill() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+    m_tokens = std::min(m_tokens + elapsed * m_rate, capacity());
+}
+
+void TokenBucket::acquire(double units) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_rate <= 0) {
+        return;
+    }
+
+    // A request larger than the burst only waits for the bucket to fill
+    double needed = std::min(units, capacity());
+    refill();
+    while (m_tokens < needed) {
+        auto wait = std::chrono::duration<double>((needed - m_tokens) / m_rate);
+        lock.unlock();
+        std::this_thread::sleep_for(wait);
+        lock.lock();
+        if (m_rate <= 0) {
+            return;
+        }
+        refill();
+    }
+    m_tokens -= units;
+}
+
+void TokenBucket::settle(double units) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_rate > 0) {
+        refill();
+        m_tokens -= units;
+    }
+}
+
+void TokenBucket::setRate(double unitsPerSecond) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    refill();
+    m_rate = std::max(unitsPerSecond, 0.0);
+    m_tokens = std::min(m_tokens, capacity());
+}
+
+double TokenBucket::getRate() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rate;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+
+// Token bucket that paces callers to a sustained rate of capacity units per
+// second. Callers acquire an estimate before a request and settle the
+// difference once the actual consumption is known, so the bucket can run
+// into debt that later callers wait out.
+class TokenBucket {
+public:
+    // A rate of zero leaves calls unpaced
+    explicit TokenBucket(double unitsPerSecond = 0, double burstSeconds = 1.0);
+
+    // Block until the estimated units are available, then take them
+    void acquire(double units);
+
+    // Adjust for the difference between actual and estimated consumption
+    void settle(double units);
+
+    void setRate(double unitsPerSecond);
+    double getRate() const;
+
+private:
+    // Most tokens the bucket holds (m_mutex held)
+    double capacity() const;
+
+    // Add tokens for the time since the last refill (m_mutex held)
+    void refill();
+
+    double m_rate;
+    double m_burstSeconds;
+    double m_tokens;
+    std::chrono::steady_clock::time_point m_lastRefill;
+    mutable std::mutex m_mutex;
+};
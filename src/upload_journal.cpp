@@ -0,0 +1,241 @@
+#include "upload_journal.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Journal line format (tab separated):
+//   P <studyUid> <s3Key> <seriesUid> <sopUid> <instanceNumber> <size> <md5>
+//                          instance uploaded, not yet in DynamoDB
+//   P <studyUid> <s3Key>   same, as written by older releases
+//   F <studyUid> <s3Key>   instance stored in DynamoDB
+
+namespace {
+const size_t PENDING_FIELDS = 8;
+const size_t LEGACY_FIELDS = 3;
+// Rewrite the journal once this many records have been appended, so a
+// long --watch run does not grow it without bound
+const size_t COMPACT_INTERVAL_LINES = 100000;
+}
+
+UploadJournal::UploadJournal(const std::string& path)
+    : m_path(path),
+      m_fd(-1),
+      m_appendedLines(0) {
+    if (!load()) {
+        LOG_WARNING("Could not replay upload journal: " + path);
+    }
+
+    m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        LOG_ERROR("Failed to open upload journal: " + m_path + " - " + strerror(errno));
+    }
+}
+
+UploadJournal::~UploadJournal() {
+    if (m_fd >= 0) {
+        fdatasync(m_fd);
+        close(m_fd);
+    }
+}
+
+bool UploadJournal::isOpen() const {
+    return m_fd >= 0;
+}
+
+bool UploadJournal::load() {
+    std::ifstream input(m_path);
+    if (!input.is_open()) {
+        // No journal yet
+        return true;
+    }
+
+    std::string line;
+    while (std::getline(input, line)) {
+        if (input.eof()) {
+            // Torn final write from a crash, cut off before its newline
+            break;
+        }
+        auto fields = Utils::split(line, '\t');
+        if (fields.size() == PENDING_FIELDS - 1) {
+            // Trailing empty content hash
+            fields.emplace_back();
+        }
+        if (fields.size() < LEGACY_FIELDS) {
+            continue;
+        }
+        if (fields[0] == "P") {
+            if (fields.size() != LEGACY_FIELDS && fields.size() != PENDING_FIELDS) {
+                continue;
+            }
+            InstanceRecord instance;
+            instance.studyUid = fields[1];
+            instance.s3Key = fields[2];
+            if (fields.size() == PENDING_FIELDS) {
+                instance.seriesUid = fields[3];
+                instance.sopInstanceUid = fields[4];
+                instance.contentHash = fields[7];
+                try {
+                    instance.instanceNumber = std::stoi(fields[5]);
+                    instance.size = std::stoull(fields[6]);
+                } catch (const std::exception&) {
+                    continue;
+                }
+            }
+            m_unflushed[instance.studyUid][instance.s3Key] = instance;
+        } else if (fields[0] == "F" && fields.size() == LEGACY_FIELDS) {
+            auto it = m_unflushed.find(fields[1]);
+            if (it != m_unflushed.end()) {
+                it->second.erase(fields[2]);
+                if (it->second.empty()) {
+                    m_unflushed.erase(it);
+                }
+            }
+        }
+    }
+    input.close();
+
+    if (!compact()) {
+        return false;
+    }
+
+    if (!m_unflushed.empty()) {
+        LOG_INFO("Upload journal has unflushed file locations for " +
+                 std::to_string(m_unflushed.size()) + " studies");
+    }
+    return true;
+}
+
+// Rewrite the journal with just the outstanding entries, replacing the old
+// file atomically. Callers other than load() must hold m_mutex
+bool UploadJournal::compact() {
+    std::string contents;
+    for (const auto& entry : m_unflushed) {
+        for (const auto& pending : entry.second) {
+            contents += formatPending(pending.second);
+        }
+    }
+
+    std::string tempPath = m_path + ".tmp";
+    int tempFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (tempFd < 0) {
+        return false;
+    }
+    size_t offset = 0;
+    while (offset < contents.size()) {
+        ssize_t written = write(tempFd, contents.data() + offset, contents.size() - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            close(tempFd);
+            return false;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    bool synced = fdatasync(tempFd) == 0;
+    close(tempFd);
+    if (!synced || rename(tempPath.c_str(), m_path.c_str()) != 0) {
+        return false;
+    }
+
+    // Appends must go to the new file, not the unlinked old one
+    if (m_fd >= 0) {
+        int fd = open(m_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd < 0) {
+            LOG_ERROR("Failed to reopen upload journal: " + m_path + " - " + strerror(errno));
+            return false;
+        }
+        close(m_fd);
+        m_fd = fd;
+    }
+    m_appendedLines = 0;
+    return true;
+}
+
+bool UploadJournal::appendLine(const std::string& line) {
+    if (m_fd < 0) {
+        return false;
+    }
+
+    // A single O_APPEND write keeps concurrent records from interleaving
+    ssize_t written;
+    do {
+        written = write(m_fd, line.data(), line.size());
+    } while (written < 0 && errno == EINTR);
+
+    if (written != static_cast<ssize_t>(line.size())) {
+        LOG_ERROR("Failed to write upload journal: " + m_path);
+        return false;
+    }
+    return true;
+}
+
+std::string UploadJournal::formatPending(const InstanceRecord& instance) {
+    return "P\t" + instance.studyUid + "\t" + instance.s3Key + "\t" +
+           instance.seriesUid + "\t" + instance.sopInstanceUid + "\t" +
+           std::to_string(instance.instanceNumber) + "\t" +
+           std::to_string(instance.size) + "\t" + instance.contentHash + "\n";
+}
+
+bool UploadJournal::recordPending(const InstanceRecord& instance) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!appendLine(formatPending(instance))) {
+        return false;
+    }
+    m_unflushed[instance.studyUid][instance.s3Key] = instance;
+    m_appendedLines++;
+    return true;
+}
+
+bool UploadJournal::recordFlushed(const std::string& studyUid, const std::vector<std::string>& s3Keys) {
+    std::string lines;
+    for (const auto& key : s3Keys) {
+        lines += "F\t" + studyUid + "\t" + key + "\n";
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_unflushed.find(studyUid);
+    if (it != m_unflushed.end()) {
+        for (const auto& key : s3Keys) {
+            it->second.erase(key);
+        }
+        if (it->second.empty()) {
+            m_unflushed.erase(it);
+        }
+    }
+    if (!appendLine(lines)) {
+        return false;
+    }
+    m_appendedLines += s3Keys.size();
+
+    // Once nothing is outstanding the journal can be truncated cheaply;
+    // otherwise rewrite it only every so often
+    if ((m_unflushed.empty() && m_appendedLines > 0) ||
+        m_appendedLines >= COMPACT_INTERVAL_LINES) {
+        if (!compact()) {
+            LOG_WARNING("Failed to compact upload journal: " + m_path);
+        }
+    }
+    return true;
+}
+
+std::map<std::string, std::vector<InstanceRecord>> UploadJournal::getUnflushed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, std::vector<InstanceRecord>> unflushed;
+    for (const auto& [studyUid, instances] : m_unflushed) {
+        for (const auto& entry : instances) {
+            unflushed[studyUid].push_back(entry.second);
+        }
+    }
+    return unflushed;
+}
+
+bool UploadJournal::sync() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_fd >= 0 && fdatasync(m_fd) == 0;
+}
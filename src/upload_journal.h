@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "study_record.h"
+
+// Append-only local journal of uploaded objects whose DynamoDB records
+// have not been written yet. Entries left unflushed by a crashed run are
+// replayed on the next start.
+class UploadJournal {
+public:
+    explicit UploadJournal(const std::string& path);
+    ~UploadJournal();
+
+    UploadJournal(const UploadJournal&) = delete;
+    UploadJournal& operator=(const UploadJournal&) = delete;
+
+    bool isOpen() const;
+
+    // Record an instance that is uploaded but not yet stored in DynamoDB
+    bool recordPending(const InstanceRecord& instance);
+
+    // Record that buffered file locations have been stored in DynamoDB
+    bool recordFlushed(const std::string& studyUid, const std::vector<std::string>& s3Keys);
+
+    // Instances recorded as pending but not yet flushed, by study. Right
+    // after construction this is what an earlier run left behind
+    std::map<std::string, std::vector<InstanceRecord>> getUnflushed() const;
+
+    // Force journal records to stable storage
+    bool sync();
+
+private:
+    bool load();
+    bool compact();
+    bool appendLine(const std::string& line);
+
+    std::string m_path;
+    int m_fd;
+    // Records appended since the journal was last compacted
+    size_t m_appendedLines;
+    static std::string formatPending(const InstanceRecord& instance);
+
+    // Outstanding instances per study, keyed by S3 key
+    std::map<std::string, std::map<std::string, InstanceRecord>> m_unflushed;
+    mutable std::mutex m_mutex;
+};
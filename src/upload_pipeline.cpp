@@ -0,0 +1,655 @@
+#include "upload_pipeline.h"
+#include "s3_manager.h"
+#include "metadata_sink.h"
+#include "logger.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Paths the walker may get ahead of the parsers
+const size_t PATH_QUEUE_CAPACITY = 1024;
+
+// Parsed instances waiting for an uploader; also the window the schedule policy reorders
+const size_t SCHEDULER_CAPACITY = 4096;
+
+// Threads reading files ahead of the uploaders; each keeps a batch in flight
+const size_t PREFETCHER_COUNT = 2;
+
+// File contents read ahead by default, and the most files queued between the stages
+const uint64_t DEFAULT_PREFETCH_BUDGET = 256ULL * 1024 * 1024;
+const size_t PREFETCH_QUEUE_CAPACITY = 4096;
+
+// Settled studies waiting for their metadata commit
+const size_t FINALIZE_QUEUE_CAPACITY = 64;
+
+// Fraction of the memory budget the instance lists kept for manifests may
+// take before they are released; file contents get the rest
+const uint64_t INSTANCE_LIST_SHARE = 4;
+
+// Approximate memory an instance takes while kept for its study's manifest
+uint64_t instanceFootprint(const InstanceRecord& instance) {
+    return sizeof(InstanceRecord) + instance.studyUid.size() + instance.seriesUid.size() +
+           instance.sopInstanceUid.size() + instance.s3Key.size() +
+           instance.contentHash.size() + instance.sourcePath.size();
+}
+
+} // namespace
+
+UploadPipeline::UploadPipeline(S3Manager& s3Manager,
+                               MetadataSink& metadataSink,
+                               const std::string& bucketName,
+                               size_t parserCount,
+                               size_t uploaderCount,
+                               size_t readQueueDepth,
+                               const FileReadOptions& readOptions,
+                               SchedulePolicy schedulePolicy)
+    : m_s3Manager(s3Manager),
+      m_metadataSink(metadataSink),
+      m_bucketName(bucketName),
+      m_parserCount(std::max<size_t>(parserCount, 1)),
+      m_uploaderCount(std::max<size_t>(uploaderCount, 1)),
+      m_readQueueDepth(std::max<size_t>(readQueueDepth, 1)),
+      m_readOptions(readOptions),
+      m_idleTimeout(0),
+      m_memoryBudget(nullptr),
+      m_sources(PATH_QUEUE_CAPACITY),
+      m_scheduler(schedulePolicy, SCHEDULER_CAPACITY),
+      m_prefetchBudget(DEFAULT_PREFETCH_BUDGET),
+      m_prefetched(PREFETCH_QUEUE_CAPACITY),
+      m_finalizeQueue(FINALIZE_QUEUE_CAPACITY),
+      m_discoveryDone(false),
+      m_filesFound(0),
+      m_dicomFiles(0),
+      m_filteredFiles(0),
+      m_success(true),
+      m_admittedBytes(0),
+      m_settledBytes(0) {
+}
+
+void UploadPipeline::setStudyCompleteCallback(StudyCompleteCallback callback) {
+    m_onStudyComplete = std::move(callback);
+}
+
+void UploadPipeline::setStudyFilter(StudyFilter filter) {
+    m_studyFilter = std::move(filter);
+}
+
+void UploadPipeline::setCommitGuard(CommitGuard guard) {
+    m_commitGuard = std::move(guard);
+}
+
+void UploadPipeline::setPrefetchBudget(uint64_t bytes) {
+    m_prefetchBudget.setLimit(bytes);
+}
+
+void UploadPipeline::setIdleTimeout(std::chrono::seconds idleTimeout) {
+    m_idleTimeout = idleTimeout;
+}
+
+void UploadPipeline::setDeadline(const RunDeadline& deadline) {
+    m_deadline = deadline;
+}
+
+void UploadPipeline::setMemoryBudget(MemoryBudget* memoryBudget) {
+    m_memoryBudget = memoryBudget;
+}
+
+size_t UploadPipeline::getDeferredStudyCount() const {
+    std::lock_guard<std::mutex> lock(m_studyMutex);
+    return m_deferredStudies.size();
+}
+
+bool UploadPipeline::run(const std::string& sourcePath) {
+    start();
+    m_walker = std::thread([this, sourcePath] { walk(sourcePath); });
+    return finish();
+}
+
+void UploadPipeline::start() {
+    m_startTime = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < m_parserCount; ++i) {
+        m_parsers.emplace_back(&UploadPipeline::parse, this);
+    }
+    for (size_t i = 0; i < PREFETCHER_COUNT; ++i) {
+        m_prefetchers.emplace_back(&UploadPipeline::prefetch, this);
+    }
+    for (size_t i = 0; i < m_uploaderCount; ++i) {
+        m_uploaders.emplace_back(&UploadPipeline::upload, this);
+    }
+    m_finalizer = std::thread(&UploadPipeline::finalize, this);
+}
+
+void UploadPipeline::submit(const std::string& path) {
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        walk(path);
+        return;
+    }
+    m_filesFound++;
+    InstanceRecord source;
+    source.sourcePath = path;
+    m_sources.push(std::move(source));
+}
+
+void UploadPipeline::submitInstance(const InstanceRecord& instance) {
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        m_studies[instance.studyUid].queued++;
+    }
+    m_filesFound++;
+    m_sources.push(instance);
+}
+
+void UploadPipeline::closeStudy(const std::string& studyUid) {
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        auto it = m_studies.find(studyUid);
+        if (it == m_studies.end()) {
+            return;
+        }
+        it->second.closed = true;
+        ready = claimFinalize(studyUid);
+    }
+    if (ready) {
+        m_finalizeQueue.push(studyUid);
+    }
+}
+
+void UploadPipeline::finalizeIdle() {
+    std::vector<std::string> idleStudies;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        std::vector<std::string> studyUids;
+        for (const auto& entry : m_studies) {
+            studyUids.push_back(entry.first);
+        }
+        for (const auto& studyUid : studyUids) {
+            if (claimFinalize(studyUid)) {
+                idleStudies.push_back(studyUid);
+            }
+        }
+    }
+    for (const auto& studyUid : idleStudies) {
+        m_finalizeQueue.push(studyUid);
+    }
+}
+
+bool UploadPipeline::finish() {
+    // Once every file is parsed no study can grow, so settled studies may commit
+    if (m_walker.joinable()) {
+        m_walker.join();
+    }
+    m_sources.close();
+    for (auto& parser : m_parsers) {
+        parser.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        m_discoveryDone = true;
+        LOG_INFO("Found " + std::to_string(m_filesFound.load()) + " files, " +
+                 std::to_string(m_dicomFiles.load()) + " DICOM files in " +
+                 std::to_string(m_studies.size() + m_finalizing.size()) + " studies");
+        if (m_filteredFiles > 0) {
+            LOG_INFO("Left " + std::to_string(m_filteredFiles.load()) +
+                     " DICOM files of other workers' studies");
+        }
+    }
+    finalizeIdle();
+
+    // The remaining studies are queued by whichever uploader settles their last file
+    m_scheduler.close();
+    for (auto& prefetcher : m_prefetchers) {
+        prefetcher.join();
+    }
+    m_prefetched.close();
+    for (auto& uploader : m_uploaders) {
+        uploader.join();
+    }
+    m_finalizeQueue.close();
+    m_finalizer.join();
+
+    return m_success;
+}
+
+void UploadPipeline::walk(const std::string& sourcePath) {
+    try {
+        fs::recursive_directory_iterator it(sourcePath, fs::directory_options::skip_permission_denied);
+        for (const auto& entry : it) {
+            if (m_deadline.passed()) {
+                LOG_WARNING("Deadline reached; stopped listing: " + sourcePath);
+                break;
+            }
+            if (entry.is_regular_file()) {
+                m_filesFound++;
+                InstanceRecord source;
+                source.sourcePath = entry.path().string();
+                m_sources.push(std::move(source));
+            }
+        }
+    } catch (const fs::filesystem_error& e) {
+        LOG_ERROR("Error listing files in directory: " + sourcePath + " - " + e.what());
+        m_success = false;
+    }
+}
+
+void UploadPipeline::parse() {
+    InstanceRecord instance;
+    while (m_sources.pop(instance)) {
+        const std::string path = instance.sourcePath;
+        bool listed = !instance.studyUid.empty();
+        if (!listed) {
+            if (!m_dicomProcessor.isDicomFile(path)) {
+                // Never read again, so don't let the scan keep it cached
+                Utils::dropFileCache(path);
+                continue;
+            }
+            if (!m_dicomProcessor.extractInstanceRecord(path, instance)) {
+                LOG_WARNING("Could not determine study UID for file: " + path);
+                Utils::dropFileCache(path);
+                continue;
+            }
+        }
+        if (!admitStudy(instance.studyUid)) {
+            // Left for the next run
+            Utils::dropFileCache(path);
+            if (listed) {
+                dropListed(instance.studyUid);
+            }
+            continue;
+        }
+        if (m_studyFilter && !m_studyFilter(instance)) {
+            // Another worker's study
+            m_filteredFiles++;
+            Utils::dropFileCache(path);
+            if (listed) {
+                dropListed(instance.studyUid);
+            }
+            continue;
+        }
+        m_dicomFiles++;
+        if (instance.size == 0) {
+            std::error_code ec;
+            instance.size = fs::file_size(path, ec);
+            if (ec) {
+                instance.size = 0;
+            }
+        }
+        m_admittedBytes += instance.size;
+        discoverInstance(instance, listed);
+        m_scheduler.push(std::move(instance));
+    }
+}
+
+void UploadPipeline::discoverInstance(const InstanceRecord& instance, bool listed) {
+    const std::string& studyUid = instance.studyUid;
+    {
+        std::unique_lock<std::mutex> lock(m_studyMutex);
+        // A study seen again after an idle finalize starts a new round once the old one commits
+        m_studyFinalized.wait(lock, [&] { return m_finalizing.count(studyUid) == 0; });
+        auto& state = m_studies[studyUid];
+        state.lastActivity = std::chrono::steady_clock::now();
+        if (listed) {
+            state.queued--;
+        }
+        if (state.discovered++ > 0) {
+            return;
+        }
+    }
+
+    // The study's first file supplies its record; later files upload meanwhile
+    LOG_INFO("Processing study: " + studyUid);
+    StudyRecord record;
+    bool extracted = m_dicomProcessor.extractStudyRecord(instance.sourcePath, record);
+    if (extracted) {
+        record.studyInstanceUid = studyUid;
+        m_metadataSink.putStudy(record);
+    } else {
+        LOG_ERROR("Failed to extract metadata for study: " + studyUid);
+    }
+
+    std::lock_guard<std::mutex> lock(m_studyMutex);
+    auto& state = m_studies[studyUid];
+    if (extracted) {
+        state.record = std::move(record);
+    } else {
+        state.failed = true;
+    }
+}
+
+void UploadPipeline::dropListed(const std::string& studyUid) {
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        auto it = m_studies.find(studyUid);
+        if (it == m_studies.end()) {
+            return;
+        }
+        it->second.queued--;
+        if (it->second.queued == 0 && it->second.discovered == 0) {
+            // Nothing of the study reached the uploaders
+            m_studies.erase(it);
+            return;
+        }
+        ready = claimFinalize(studyUid);
+    }
+    if (ready) {
+        m_finalizeQueue.push(studyUid);
+    }
+}
+
+bool UploadPipeline::admitStudy(const std::string& studyUid) {
+    if (!m_deadline.isSet()) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(m_studyMutex);
+    if (m_startedStudies.count(studyUid) > 0) {
+        return true;
+    }
+    if (m_deferredStudies.count(studyUid) > 0) {
+        return false;
+    }
+    if (!canFinishBacklog()) {
+        LOG_INFO("Not starting study before the deadline: " + studyUid);
+        m_deferredStudies.insert(studyUid);
+        return false;
+    }
+    m_startedStudies.insert(studyUid);
+    return true;
+}
+
+bool UploadPipeline::canFinishBacklog() const {
+    if (m_deadline.passed()) {
+        return false;
+    }
+    uint64_t settled = m_settledBytes;
+    auto elapsed = std::chrono::steady_clock::now() - m_startTime;
+    if (settled == 0 || elapsed.count() <= 0) {
+        // No throughput measured yet
+        return true;
+    }
+    uint64_t admitted = m_admittedBytes;
+    uint64_t backlog = admitted > settled ? admitted - settled : 0;
+    double drainSeconds = static_cast<double>(backlog) / settled *
+                          std::chrono::duration<double>(elapsed).count();
+    return drainSeconds < std::chrono::duration<double>(m_deadline.remaining()).count();
+}
+
+bool UploadPipeline::reserveContents(uint64_t bytes, bool wait) {
+    if (!m_prefetchBudget.tryAcquire(bytes)) {
+        if (!wait) {
+            return false;
+        }
+        m_prefetchBudget.acquire(bytes);
+    }
+    if (m_memoryBudget && !m_memoryBudget->tryAcquire(bytes)) {
+        if (!wait) {
+            m_prefetchBudget.release(bytes);
+            return false;
+        }
+        m_memoryBudget->acquire(bytes);
+    }
+    return true;
+}
+
+void UploadPipeline::releaseContents(uint64_t bytes) {
+    if (m_memoryBudget) {
+        m_memoryBudget->release(bytes);
+    }
+    m_prefetchBudget.release(bytes);
+}
+
+void UploadPipeline::prefetch() {
+    // Batches are read together so many files are in flight per submission
+    FileReader fileReader(m_readQueueDepth, m_readOptions);
+    std::vector<InstanceRecord> batch;
+    std::vector<InstanceRecord> reserved;
+    while (m_scheduler.popBatch(batch, fileReader.getQueueDepth())) {
+        for (auto& instance : batch) {
+            if (m_deadline.passed()) {
+                settleInstance(instance, false, true);
+                continue;
+            }
+            // Too large to hold in memory; skips the budgets and streams from disk
+            if (instance.size >= S3Manager::STREAM_UPLOAD_THRESHOLD) {
+                PrefetchedFile file;
+                file.instance = std::move(instance);
+                file.streamed = true;
+                m_prefetched.push(std::move(file));
+                continue;
+            }
+            // Read what is already reserved before waiting, so a waiting
+            // prefetcher never holds budget the uploaders can't free
+            if (!reserveContents(instance.size, false)) {
+                readAhead(fileReader, reserved);
+                reserveContents(instance.size, true);
+            }
+            reserved.push_back(std::move(instance));
+        }
+        readAhead(fileReader, reserved);
+    }
+}
+
+void UploadPipeline::readAhead(FileReader& fileReader, std::vector<InstanceRecord>& instances) {
+    if (instances.empty()) {
+        return;
+    }
+    // A path may repeat (e.g. a duplicated file list line); each read takes one of its instances
+    std::map<std::string, std::deque<InstanceRecord>> instancesByPath;
+    std::vector<std::string> paths;
+    for (auto& instance : instances) {
+        paths.push_back(instance.sourcePath);
+        instancesByPath[instance.sourcePath].push_back(std::move(instance));
+    }
+    instances.clear();
+
+    fileReader.readBatch(paths, [&](FileBuffer&& buffer) {
+        auto& pending = instancesByPath[buffer.path];
+        PrefetchedFile file;
+        file.instance = std::move(pending.front());
+        pending.pop_front();
+        file.reserved = file.instance.size;
+        file.buffer = std::move(buffer);
+        m_prefetched.push(std::move(file));
+    });
+}
+
+void UploadPipeline::upload() {
+    PrefetchedFile file;
+    while (m_prefetched.pop(file)) {
+        bool uploaded = file.streamed ? uploadStreamedInstance(file.instance)
+                                      : uploadInstance(file.buffer, file.instance);
+
+        // Free the contents before handing their bytes back to the prefetchers
+        file.buffer = FileBuffer();
+        releaseContents(file.reserved);
+        settleInstance(file.instance, uploaded);
+    }
+}
+
+bool UploadPipeline::uploadInstance(const FileBuffer& buffer, InstanceRecord& instance) {
+    if (!buffer.ok) {
+        LOG_ERROR("Failed to read file: " + buffer.path);
+        return false;
+    }
+    instance.s3Key = Utils::generateS3Key(instance.studyUid, buffer.path);
+    instance.size = buffer.data.size();
+    instance.contentHash = S3Manager::calculateMd5Hex(buffer.data.data(), buffer.data.size());
+    if (!m_s3Manager.uploadBuffer(m_bucketName, buffer.data.data(),
+                                  buffer.data.size(), instance.s3Key)) {
+        LOG_ERROR("Failed to upload file: " + buffer.path);
+        return false;
+    }
+    // Blocks only when the sink is at capacity
+    m_metadataSink.putInstance(instance);
+    LOG_DEBUG("Successfully uploaded: " + buffer.path);
+    return true;
+}
+
+bool UploadPipeline::uploadStreamedInstance(InstanceRecord& instance) {
+    const std::string& path = instance.sourcePath;
+    instance.s3Key = Utils::generateS3Key(instance.studyUid, path);
+    if (!S3Manager::calculateFileMd5Hex(path, instance.contentHash)) {
+        LOG_ERROR("Failed to read file: " + path);
+        return false;
+    }
+    if (!m_s3Manager.uploadFile(m_bucketName, path, instance.s3Key,
+                                [&instance](size_t bytes) { instance.size = bytes; })) {
+        LOG_ERROR("Failed to upload file: " + path);
+        return false;
+    }
+    m_metadataSink.putInstance(instance);
+    LOG_DEBUG("Successfully uploaded: " + path);
+    return true;
+}
+
+void UploadPipeline::settleInstance(const InstanceRecord& instance, bool success, bool deferred) {
+    m_scheduler.complete(instance.studyUid);
+    if (!deferred) {
+        m_settledBytes += instance.size;
+    }
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        auto& state = m_studies[instance.studyUid];
+        state.settled++;
+        state.lastActivity = std::chrono::steady_clock::now();
+        if (deferred) {
+            state.deferred = true;
+        } else if (!success) {
+            state.failed = true;
+        } else if (!state.released) {
+            state.uploaded.push_back(instance);
+            if (m_memoryBudget) {
+                uint64_t footprint = instanceFootprint(instance);
+                state.charged += footprint;
+                m_memoryBudget->charge(footprint);
+                if (m_memoryBudget->getCharged() > m_memoryBudget->getLimit() / INSTANCE_LIST_SHARE) {
+                    releaseInstanceLists();
+                }
+            }
+        }
+        ready = claimFinalize(instance.studyUid);
+    }
+    if (ready) {
+        m_finalizeQueue.push(instance.studyUid);
+    }
+}
+
+void UploadPipeline::releaseInstanceLists() {
+    size_t released = 0;
+    for (auto& entry : m_studies) {
+        StudyState& state = entry.second;
+        if (state.released) {
+            continue;
+        }
+        m_memoryBudget->discharge(state.charged);
+        state.charged = 0;
+        std::vector<InstanceRecord>().swap(state.uploaded);
+        state.released = true;
+        released++;
+    }
+    if (released > 0) {
+        LOG_WARNING("Memory budget reached; released the instance lists of " +
+                    std::to_string(released) + " open studies, whose manifests will be rebuilt from DynamoDB");
+    }
+}
+
+bool UploadPipeline::claimFinalize(const std::string& studyUid) {
+    auto it = m_studies.find(studyUid);
+    if (it == m_studies.end() || it->second.queued > 0 ||
+        it->second.settled < it->second.discovered) {
+        return false;
+    }
+    bool idle = m_idleTimeout.count() > 0 &&
+                std::chrono::steady_clock::now() - it->second.lastActivity >= m_idleTimeout;
+    if (!m_discoveryDone && !idle && !it->second.closed) {
+        return false;
+    }
+    m_finalizing[studyUid] = std::move(it->second);
+    m_studies.erase(it);
+    return true;
+}
+
+void UploadPipeline::finalize() {
+    std::string studyUid;
+    while (m_finalizeQueue.pop(studyUid)) {
+        finishStudy(studyUid);
+    }
+}
+
+void UploadPipeline::finishStudy(const std::string& studyUid) {
+    // No file of the study is still in flight once it is claimed for finalizing
+    bool uploadFailed = false;
+    bool deferred = false;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        uploadFailed = m_finalizing[studyUid].failed;
+        deferred = m_finalizing[studyUid].deferred;
+    }
+
+    // A study whose claim was lost belongs to another worker now; only that one
+    // publishes it. The guard runs after the study's writes are flushed, which
+    // can take longer than a lease, immediately before the commit.
+    bool claimed = true;
+    MetadataSink::CommitFence fence;
+    if (m_commitGuard) {
+        fence = [this, &studyUid, &claimed]() {
+            claimed = m_commitGuard(studyUid);
+            return claimed;
+        };
+    }
+
+    // Committed only once the study item and every instance item are written;
+    // a study with failed or deferred files stays pending, hidden from readers
+    bool committed = m_metadataSink.commitStudy(studyUid, !uploadFailed && !deferred, fence).get();
+    if (!claimed) {
+        LOG_WARNING("No longer own study; leaving it pending for its new owner: " + studyUid);
+    }
+
+    StudyState state;
+    {
+        std::lock_guard<std::mutex> lock(m_studyMutex);
+        auto it = m_finalizing.find(studyUid);
+        state = std::move(it->second);
+        m_finalizing.erase(it);
+        if (state.deferred) {
+            m_deferredStudies.insert(studyUid);
+        }
+    }
+    m_studyFinalized.notify_all();
+    state.record.studyInstanceUid = studyUid;
+
+    if (state.failed) {
+        LOG_ERROR("One or more files failed to upload in study: " + studyUid);
+    }
+    if (!committed && claimed) {
+        LOG_ERROR("Failed to store metadata in DynamoDB for study: " + studyUid);
+    }
+    bool complete = claimed && committed && !state.failed && !state.deferred;
+    if (!claimed) {
+        // Not a failure of this run: the new owner uploads the study again
+    } else if (!committed || state.failed) {
+        m_success = false;
+    } else if (state.deferred) {
+        // Its uploaded files are indexed, so a --sync run picks up the rest
+        LOG_WARNING("Deadline reached; left study pending for the next run: " + studyUid);
+    } else {
+        LOG_INFO("Uploaded study: " + studyUid + " with " +
+                 std::to_string(state.uploaded.size()) + " files");
+    }
+
+    if (m_onStudyComplete) {
+        m_onStudyComplete(state.record, state.uploaded, complete);
+    }
+    if (m_memoryBudget) {
+        m_memoryBudget->discharge(state.charged);
+    }
+}
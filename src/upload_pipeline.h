@@ -0,0 +1,244 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <condition_variable>
+
+#include "bounded_queue.h"
+#include "dicom_processor.h"
+#include "file_scheduler.h"
+#include "file_reader.h"
+#include "memory_budget.h"
+#include "run_deadline.h"
+#include "study_record.h"
+
+class S3Manager;
+class MetadataSink;
+
+// Upload as a set of concurrent stages joined by bounded queues:
+//   walker -> parsers -> scheduler -> prefetchers -> uploaders -> metadata sink -> finalizer
+// The directory walk, DICOM parsing, S3 uploads and DynamoDB writes all
+// overlap, so a study starts uploading as soon as its first file is found.
+// Every uploader takes files from one scheduler shared by all studies, so a
+// large study is spread across the whole pool rather than a slice of it.
+// Prefetchers read files in scheduling order ahead of the uploaders, up to a
+// memory budget, so the disk stays busy while uploads wait on the network.
+// A study can only be committed once the walk ends, since more of its
+// files may still turn up; studies are finalized as their last upload settles.
+// Fed incrementally (start/submit/finish), a study is instead finalized once
+// it has settled and seen no new file for the idle timeout, or once the
+// caller closes it.
+// Under a deadline, a study is only started while the backlog already taken
+// on is expected to finish in time; once the deadline passes, queued files
+// are left unread and their studies stay pending for the next run.
+class UploadPipeline {
+public:
+    // Runs on the finalizer once a study is committed (or failed), with every
+    // instance that was uploaded; complete is false if anything went wrong.
+    // instances is empty when the list was released under the memory budget;
+    // the study's instance items are then the only record of them.
+    using StudyCompleteCallback = std::function<void(const StudyRecord& record,
+                                                     const std::vector<InstanceRecord>& instances,
+                                                     bool complete)>;
+
+    // Decides whether this process uploads a parsed file's study; called
+    // concurrently from the parsers
+    using StudyFilter = std::function<bool(const InstanceRecord& instance)>;
+
+    // Whether this process may still publish a study (e.g. renewing its lease
+    // succeeds); called on the metadata sink right before the study is committed
+    using CommitGuard = std::function<bool(const std::string& studyUid)>;
+
+    UploadPipeline(S3Manager& s3Manager,
+                   MetadataSink& metadataSink,
+                   const std::string& bucketName,
+                   size_t parserCount,
+                   size_t uploaderCount,
+                   size_t readQueueDepth,
+                   const FileReadOptions& readOptions,
+                   SchedulePolicy schedulePolicy = SchedulePolicy::LARGEST_FIRST);
+
+    UploadPipeline(const UploadPipeline&) = delete;
+    UploadPipeline& operator=(const UploadPipeline&) = delete;
+
+    // Work to do once a study is committed, e.g. writing its manifest
+    void setStudyCompleteCallback(StudyCompleteCallback callback);
+
+    // Only upload files whose study the filter accepts (sharded workers)
+    void setStudyFilter(StudyFilter filter);
+
+    // Leave a study pending and report it incomplete once the guard rejects it
+    void setCommitGuard(CommitGuard guard);
+
+    // Bytes of file contents read ahead of the uploaders; set before start
+    void setPrefetchBudget(uint64_t bytes);
+
+    // Finalize settled studies that have been idle this long, before input ends
+    void setIdleTimeout(std::chrono::seconds idleTimeout);
+
+    // Start no study that won't finish by the deadline, and stop reading at it
+    void setDeadline(const RunDeadline& deadline);
+
+    // Run-wide memory accountant: file contents wait for room in it, and the
+    // instance lists kept for manifests are charged to it and released when it
+    // runs over. Not owned; set before start.
+    void setMemoryBudget(MemoryBudget* memoryBudget);
+
+    // Studies left for a later run because of the deadline
+    size_t getDeferredStudyCount() const;
+
+    // Walk sourcePath and upload every study found; true if all of them committed.
+    // A pipeline runs once.
+    bool run(const std::string& sourcePath);
+
+    // Incremental use: start the stages, submit files as they appear, then finish
+    void start();
+
+    // Queue one file (or, for a directory, every file under it); blocks while the parsers are behind
+    void submit(const std::string& path);
+
+    // Queue a file whose study is already known (e.g. from a file list); the
+    // DICOM parse is skipped, and so is the stat when its size is set
+    void submitInstance(const InstanceRecord& instance);
+
+    // No more files of this study are coming; it is finalized once its queued
+    // files have settled. A file submitted later starts a new round.
+    void closeStudy(const std::string& studyUid);
+
+    // Queue every study that has settled and been idle for the idle timeout
+    void finalizeIdle();
+
+    // End of input: finalize every remaining study and stop; true if all of them committed
+    bool finish();
+
+private:
+    // Progress of one study through the stages
+    struct StudyState {
+        StudyRecord record;
+        size_t queued = 0;       // Submitted with a known study, not yet parsed
+        size_t discovered = 0;
+        size_t settled = 0;
+        bool failed = false;
+        bool closed = false;
+        bool deferred = false;   // Files were left unread at the deadline
+        bool released = false;   // uploaded was given back to the memory budget
+        uint64_t charged = 0;    // Bytes of uploaded charged to the memory budget
+        std::chrono::steady_clock::time_point lastActivity;
+        std::vector<InstanceRecord> uploaded;
+    };
+
+    // A file read ahead of its upload, holding its share of the prefetch budget.
+    // A streamed file is not read ahead; the uploader sends it from disk.
+    struct PrefetchedFile {
+        InstanceRecord instance;
+        FileBuffer buffer;
+        uint64_t reserved = 0;
+        bool streamed = false;
+    };
+
+    void walk(const std::string& sourcePath);
+    void parse();
+    void prefetch();
+    void upload();
+    void finalize();
+
+    // Register a parsed instance, extracting the study record on first sight.
+    // Waits if an earlier round of the same study is still being finalized.
+    void discoverInstance(const InstanceRecord& instance, bool listed);
+
+    // Forget a submitted file of a known study that will not be uploaded
+    void dropListed(const std::string& studyUid);
+
+    // Whether a parsed file's study may be uploaded under the deadline; a
+    // study once started or refused stays that way
+    bool admitStudy(const std::string& studyUid);
+
+    // Whether the admitted backlog, at the throughput so far, ends before the deadline
+    bool canFinishBacklog() const;
+
+    // Reserve a file's contents against the prefetch and memory budgets; waits
+    // only if wait is set, otherwise false when either is full
+    bool reserveContents(uint64_t bytes, bool wait);
+    void releaseContents(uint64_t bytes);
+
+    // Give the instance lists of open studies back to the memory budget
+    // (m_studyMutex held)
+    void releaseInstanceLists();
+
+    // Read files whose budget is reserved and queue them for the uploaders
+    void readAhead(FileReader& fileReader, std::vector<InstanceRecord>& instances);
+
+    // Hash and upload one file, then hand its instance to the sink
+    bool uploadInstance(const FileBuffer& buffer, InstanceRecord& instance);
+
+    // Hash and upload one large file straight from disk, then hand its instance to the sink
+    bool uploadStreamedInstance(InstanceRecord& instance);
+
+    // Count an upload as done (or left for the next run, when deferred) and
+    // queue the study once nothing of it is left
+    void settleInstance(const InstanceRecord& instance, bool success, bool deferred = false);
+
+    // Hand a study to the finalizer once all its uploads have settled and either
+    // discovery is over, it was closed or it has been idle; true if claimed
+    // (m_studyMutex held)
+    bool claimFinalize(const std::string& studyUid);
+
+    // Commit a study's metadata and report it to the callback
+    void finishStudy(const std::string& studyUid);
+
+    S3Manager& m_s3Manager;
+    MetadataSink& m_metadataSink;
+    std::string m_bucketName;
+    size_t m_parserCount;
+    size_t m_uploaderCount;
+    size_t m_readQueueDepth;
+    FileReadOptions m_readOptions;
+    DicomProcessor m_dicomProcessor;
+    StudyCompleteCallback m_onStudyComplete;
+    StudyFilter m_studyFilter;
+    CommitGuard m_commitGuard;
+    std::chrono::seconds m_idleTimeout;
+    RunDeadline m_deadline;
+    MemoryBudget* m_memoryBudget;
+
+    // Files for the parsers; a set studyUid marks one whose parse is skipped
+    BoundedQueue<InstanceRecord> m_sources;
+    FileScheduler m_scheduler;
+    MemoryBudget m_prefetchBudget;
+    BoundedQueue<PrefetchedFile> m_prefetched;
+    BoundedQueue<std::string> m_finalizeQueue;
+
+    // Studies still taking files, and studies claimed by the finalizer
+    std::map<std::string, StudyState> m_studies;
+    std::map<std::string, StudyState> m_finalizing;
+    bool m_discoveryDone;
+
+    // Studies admitted or refused under the deadline
+    std::set<std::string> m_startedStudies;
+    std::set<std::string> m_deferredStudies;
+    mutable std::mutex m_studyMutex;
+    std::condition_variable m_studyFinalized;
+
+    std::thread m_walker;
+    std::vector<std::thread> m_parsers;
+    std::vector<std::thread> m_prefetchers;
+    std::vector<std::thread> m_uploaders;
+    std::thread m_finalizer;
+
+    std::atomic<size_t> m_filesFound;
+    std::atomic<size_t> m_dicomFiles;
+    std::atomic<size_t> m_filteredFiles;
+    std::atomic<bool> m_success;
+
+    // Throughput for deadline admission: bytes taken on and bytes settled since start
+    std::chrono::steady_clock::time_point m_startTime;
+    std::atomic<uint64_t> m_admittedBytes;
+    std::atomic<uint64_t> m_settledBytes;
+};
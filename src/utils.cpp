@@ -7,6 +7,8 @@
 #include <iomanip>
 #include <fstream>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // File system operations
 bool Utils::createDirectoryIfNotExists(const std::string& path) {
@@ -83,6 +85,17 @@ bool Utils::deleteFile(const std::string& filepath) {
     }
 }
 
+bool Utils::dropFileCache(const std::string& filepath) {
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    
+    bool dropped = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return dropped;
+}
+
 // String operations
 std::string Utils::trim(const std::string& str) {
     auto start = str.find_first_not_of(" \t\n\r\f\v");
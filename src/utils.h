@@ -17,6 +17,7 @@ namespace Utils {
     std::string getParentPath(const std::string& filepath);
     size_t getFileSize(const std::string& filepath);
     bool deleteFile(const std::string& filepath);
+    bool dropFileCache(const std::string& filepath);
     
     // String operations
     std::string trim(const std::string& str);
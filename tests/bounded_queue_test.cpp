@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "../src/bounded_queue.h"
+#include <atomic>
+#include <thread>
+
+// Test that a full queue holds the producer back until a consumer makes room
+TEST(BoundedQueueTest, PushBlocksWhileFull) {
+    BoundedQueue<int> queue(2);
+    queue.push(1);
+    queue.push(2);
+
+    std::atomic<bool> pushed(false);
+    std::thread producer([&] {
+        queue.push(3);
+        pushed = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(pushed);
+
+    int value = 0;
+    ASSERT_TRUE(queue.pop(value));
+    EXPECT_EQ(value, 1);
+    producer.join();
+    EXPECT_TRUE(pushed);
+    EXPECT_EQ(queue.size(), 2u);
+}
+
+// Test that consumers drain what is left after close and then see the end
+TEST(BoundedQueueTest, CloseDrainsThenEnds) {
+    BoundedQueue<int> queue(8);
+    for (int i = 0; i < 5; ++i) {
+        queue.push(i);
+    }
+    queue.close();
+    EXPECT_FALSE(queue.push(5));
+
+    std::vector<int> batch;
+    ASSERT_TRUE(queue.popBatch(batch, 3));
+    EXPECT_EQ(batch, (std::vector<int>{0, 1, 2}));
+    ASSERT_TRUE(queue.popBatch(batch, 3));
+    EXPECT_EQ(batch, (std::vector<int>{3, 4}));
+    EXPECT_FALSE(queue.popBatch(batch, 3));
+
+    int value = 0;
+    EXPECT_FALSE(queue.pop(value));
+}
@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include "../src/compression.h"
+
+#ifdef HAVE_ZSTD
+
+// Test that repetitive metadata shrinks and decompresses unchanged
+TEST(CompressionTest, RoundTrip) {
+    std::string input;
+    for (int i = 0; i < 200; ++i) {
+        input += "ImageType=ORIGINAL\\PRIMARY\\AXIAL;";
+    }
+
+    std::string compressed;
+    ASSERT_TRUE(Compression::compress(input, compressed));
+    EXPECT_LT(compressed.size(), input.size() / 4);
+
+    std::string restored;
+    ASSERT_TRUE(Compression::decompress(compressed, restored));
+    EXPECT_EQ(restored, input);
+
+    EXPECT_FALSE(Compression::decompress("not a zstd frame", restored));
+}
+
+#else
+
+// Test that a build without zstd refuses rather than storing garbage
+TEST(CompressionTest, UnavailableWithoutZstd) {
+    std::string output;
+    EXPECT_FALSE(Compression::isAvailable());
+    EXPECT_FALSE(Compression::compress("metadata", output));
+}
+
+#endif
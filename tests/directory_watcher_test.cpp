@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include "../src/directory_watcher.h"
+#include "../src/utils.h"
+#include <fstream>
+#include <thread>
+
+class DirectoryWatcherTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        fs::remove_all(LANDING_DIR);
+        fs::create_directories(LANDING_DIR);
+    }
+
+    void TearDown() override {
+        fs::remove_all(LANDING_DIR);
+    }
+
+    std::vector<std::string> pollOnce(DirectoryWatcher& watcher) {
+        std::vector<std::string> ready;
+        watcher.poll(std::chrono::milliseconds(100), [&](const std::string& path) {
+            ready.push_back(path);
+        });
+        return ready;
+    }
+
+    const std::string LANDING_DIR = "directory_watcher_test_landing";
+};
+
+// Test that a file is reported once its writer closes it, including in new subdirectories
+TEST_F(DirectoryWatcherTest, ReportsClosedFiles) {
+    DirectoryWatcher watcher(LANDING_DIR, std::chrono::seconds(60));
+    ASSERT_TRUE(watcher.isOpen());
+
+    std::string studyDir = Utils::joinPath(LANDING_DIR, "study");
+    fs::create_directories(studyDir);
+    pollOnce(watcher);
+    EXPECT_EQ(watcher.getWatchCount(), 2u);
+
+    std::string path = Utils::joinPath(studyDir, "image.dcm");
+    std::ofstream out(path);
+    out << "data";
+    out.flush();
+    EXPECT_TRUE(pollOnce(watcher).empty());
+    EXPECT_EQ(watcher.getPendingCount(), 1u);
+
+    out.close();
+    EXPECT_EQ(pollOnce(watcher), std::vector<std::string>{path});
+    EXPECT_EQ(watcher.getPendingCount(), 0u);
+}
+
+// Test that a file left open is taken once it has been quiet long enough
+TEST_F(DirectoryWatcherTest, ReportsQuietFiles) {
+    DirectoryWatcher watcher(LANDING_DIR, std::chrono::seconds(1));
+    ASSERT_TRUE(watcher.isOpen());
+
+    std::string path = Utils::joinPath(LANDING_DIR, "open.dcm");
+    std::ofstream out(path);
+    out << "data";
+    out.flush();
+    EXPECT_TRUE(pollOnce(watcher).empty());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    EXPECT_EQ(pollOnce(watcher), std::vector<std::string>{path});
+}
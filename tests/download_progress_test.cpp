@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "../src/download_progress.h"
+#include "../src/utils.h"
+#include <fstream>
+#include <sstream>
+
+class DownloadProgressTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        Utils::deleteFile(PROGRESS_PATH);
+    }
+
+    const std::string PROGRESS_PATH = "download_progress_test.progress";
+};
+
+// Test that finished studies are remembered across runs
+TEST_F(DownloadProgressTest, ResumesCompletedStudies) {
+    {
+        DownloadProgress progress(PROGRESS_PATH);
+        ASSERT_TRUE(progress.isOpen());
+        EXPECT_TRUE(progress.markComplete("study-1"));
+        EXPECT_TRUE(progress.markComplete("study-2"));
+    }
+
+    // A crash mid-write leaves a line without its newline
+    {
+        std::ofstream out(PROGRESS_PATH, std::ios::app);
+        out << "study-3";
+    }
+
+    DownloadProgress reopened(PROGRESS_PATH);
+    EXPECT_TRUE(reopened.isComplete("study-1"));
+    EXPECT_TRUE(reopened.isComplete("study-2"));
+    EXPECT_FALSE(reopened.isComplete("study-3"));
+    EXPECT_EQ(reopened.completedCount(), 2u);
+}
+
+// Test that study lists skip blanks, comments and repeats but keep their order
+TEST(StudyListTest, ReadsUidsInOrder) {
+    std::istringstream input("1.2.3\n\n# comment\n  1.2.4  \n1.2.3\n1.2.5");
+    EXPECT_EQ(readStudyList(input), (std::vector<std::string>{"1.2.3", "1.2.4", "1.2.5"}));
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+#include "../src/file_list.h"
+#include <sstream>
+
+// Test that entries carry whichever optional fields the list supplies
+TEST(FileListReaderTest, ReadsOptionalFields) {
+    std::istringstream input("# PACS export\n"
+                             "/data/a b/1.dcm\n"
+                             "\n"
+                             "/data/2.dcm\t1.2.3\n"
+                             "/data/3.dcm\t1.2.3\t4096\r\n");
+    FileListReader reader(input);
+    FileListEntry entry;
+
+    ASSERT_TRUE(reader.next(entry));
+    EXPECT_EQ(entry.path, "/data/a b/1.dcm");
+    EXPECT_TRUE(entry.studyUid.empty());
+    EXPECT_EQ(entry.size, 0u);
+
+    ASSERT_TRUE(reader.next(entry));
+    EXPECT_EQ(entry.path, "/data/2.dcm");
+    EXPECT_EQ(entry.studyUid, "1.2.3");
+    EXPECT_EQ(entry.size, 0u);
+
+    ASSERT_TRUE(reader.next(entry));
+    EXPECT_EQ(entry.studyUid, "1.2.3");
+    EXPECT_EQ(entry.size, 4096u);
+
+    EXPECT_FALSE(reader.next(entry));
+    EXPECT_EQ(reader.getSkippedLines(), 0u);
+}
+
+// Test that malformed lines are skipped and counted rather than ending the list
+TEST(FileListReaderTest, SkipsMalformedLines) {
+    std::istringstream input("/data/1.dcm\t1.2.3\tbig\n"
+                             "\t1.2.3\n"
+                             "/data/2.dcm\t1.2.3\t1\textra\n"
+                             "/data/3.dcm\n");
+    FileListReader reader(input);
+    FileListEntry entry;
+
+    ASSERT_TRUE(reader.next(entry));
+    EXPECT_EQ(entry.path, "/data/3.dcm");
+    EXPECT_FALSE(reader.next(entry));
+    EXPECT_EQ(reader.getSkippedLines(), 3u);
+}
@@ -0,0 +1,307 @@
+#include <gtest/gtest.h>
+#include "../src/file_reader.h"
+#include "../src/utils.h"
+#include <filesystem>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+class FileReaderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Utils::createDirectoryIfNotExists(TEST_DIR);
+    }
+
+    void TearDown() override {
+        fs::remove_all(TEST_DIR);
+    }
+
+    std::string createTestFile(const std::string& filename, size_t size, char fill) {
+        std::string filepath = TEST_DIR + "/" + filename;
+        std::ofstream file(filepath, std::ios::binary);
+        std::vector<char> buffer(size, fill);
+        file.write(buffer.data(), buffer.size());
+        return filepath;
+    }
+
+    // Flush a file we just wrote so its pages are clean and can be dropped
+    void flushTestFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    // Sample files to replicate: FILE_READER_SAMPLE_DIR if set, otherwise a
+    // small generated corpus inside the test directory
+    std::vector<std::string> sampleCorpus() {
+        if (const char* env = std::getenv("FILE_READER_SAMPLE_DIR")) {
+            return Utils::listFilesInDirectory(env);
+        }
+        std::string sampleDir = TEST_DIR + "/samples";
+        Utils::createDirectoryIfNotExists(sampleDir);
+        std::vector<std::string> samples;
+        for (int i = 0; i < 8; ++i) {
+            samples.push_back(createTestFile("samples/sample_" + std::to_string(i) + ".dat",
+                                             64 * 1024 * (i + 1), 's'));
+        }
+        return samples;
+    }
+
+    // Replicate the sample corpus with hard links so the read path sees
+    // many distinct directory entries without consuming disk space
+    std::vector<std::string> replicateSampleCorpus(size_t replicas) {
+        std::vector<std::string> samples = sampleCorpus();
+        std::vector<std::string> files;
+        for (size_t r = 0; r < replicas; ++r) {
+            std::string replicaDir = TEST_DIR + "/replica_" + std::to_string(r);
+            Utils::createDirectoryIfNotExists(replicaDir);
+            for (const auto& sample : samples) {
+                std::string target = Utils::joinPath(replicaDir, Utils::getFileName(sample));
+                fs::create_hard_link(sample, target);
+                files.push_back(target);
+            }
+        }
+        return files;
+    }
+
+    // Fraction of a file's pages currently resident in the page cache
+    double residentFraction(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        size_t size = Utils::getFileSize(path);
+        if (fd < 0 || size == 0) {
+            if (fd >= 0) close(fd);
+            return 0.0;
+        }
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return 0.0;
+        }
+        long pageSize = sysconf(_SC_PAGESIZE);
+        std::vector<unsigned char> pages((size + pageSize - 1) / pageSize);
+        mincore(mapping, size, pages.data());
+        munmap(mapping, size);
+
+        size_t resident = 0;
+        for (unsigned char page : pages) {
+            resident += page & 1;
+        }
+        return static_cast<double>(resident) / pages.size();
+    }
+
+    double averageResidency(const std::vector<std::string>& paths) {
+        double total = 0.0;
+        for (const auto& path : paths) {
+            total += residentFraction(path);
+        }
+        return paths.empty() ? 0.0 : total / paths.size();
+    }
+
+    const std::string TEST_DIR = "file_reader_test_files";
+};
+
+// Test that a batch returns every file with its full contents
+TEST_F(FileReaderTest, ReadBatchReturnsAllFiles) {
+    std::vector<std::string> paths;
+    for (int i = 0; i < 10; ++i) {
+        paths.push_back(createTestFile("file_" + std::to_string(i) + ".dat",
+                                       1000 * (i + 1), static_cast<char>('a' + i)));
+    }
+    paths.push_back(createTestFile("empty.dat", 0, 'x'));
+
+    FileReader reader(4);
+    std::map<std::string, FileBuffer> results;
+    reader.readBatch(paths, [&results](FileBuffer&& buffer) {
+        results[buffer.path] = std::move(buffer);
+    });
+
+    ASSERT_EQ(results.size(), paths.size());
+    for (int i = 0; i < 10; ++i) {
+        const auto& buffer = results[paths[i]];
+        EXPECT_TRUE(buffer.ok);
+        ASSERT_EQ(buffer.data.size(), static_cast<size_t>(1000 * (i + 1)));
+        EXPECT_EQ(buffer.data.front(), static_cast<unsigned char>('a' + i));
+        EXPECT_EQ(buffer.data.back(), static_cast<unsigned char>('a' + i));
+    }
+    EXPECT_TRUE(results[paths.back()].ok);
+    EXPECT_TRUE(results[paths.back()].data.empty());
+}
+
+// Test that missing files are reported without failing the rest of the batch
+TEST_F(FileReaderTest, MissingFileInBatch) {
+    std::vector<std::string> paths = {
+        createTestFile("present.dat", 4096, 'p'),
+        TEST_DIR + "/missing.dat"
+    };
+
+    FileReader reader;
+    std::map<std::string, FileBuffer> results;
+    reader.readBatch(paths, [&results](FileBuffer&& buffer) {
+        results[buffer.path] = std::move(buffer);
+    });
+
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_TRUE(results[paths[0]].ok);
+    EXPECT_FALSE(results[paths[1]].ok);
+}
+
+// Test that files above the threshold are read correctly with O_DIRECT,
+// including sizes that are not a multiple of the alignment
+TEST_F(FileReaderTest, DirectIoForLargeFiles) {
+    std::vector<std::string> paths = {
+        createTestFile("small.dat", 1000, 's'),
+        createTestFile("large_aligned.dat", 256 * 1024, 'L'),
+        createTestFile("large_unaligned.dat", 256 * 1024 + 123, 'U')
+    };
+
+    FileReadOptions options;
+    options.directIoThreshold = 64 * 1024;
+    FileReader reader(8, options);
+
+    std::map<std::string, FileBuffer> results;
+    reader.readBatch(paths, [&results](FileBuffer&& buffer) {
+        results[buffer.path] = std::move(buffer);
+    });
+
+    ASSERT_EQ(results.size(), paths.size());
+    for (const auto& path : paths) {
+        const auto& buffer = results[path];
+        EXPECT_TRUE(buffer.ok);
+        EXPECT_EQ(buffer.data.size(), Utils::getFileSize(path));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data.data()) % DIRECT_IO_ALIGNMENT, 0u);
+    }
+    EXPECT_EQ(results[paths[2]].data.back(), static_cast<unsigned char>('U'));
+}
+
+// Benchmarks are disabled by default; run them with
+// --gtest_also_run_disabled_tests --gtest_filter='*DISABLED_*'
+
+// Measure files per second on the sample corpus replicated many times.
+// Set FILE_READER_REPLICAS to change the replica count (default 100).
+TEST_F(FileReaderTest, DISABLED_ReplicatedCorpusThroughput) {
+    size_t replicas = 100;
+    if (const char* env = std::getenv("FILE_READER_REPLICAS")) {
+        replicas = std::stoul(env);
+    }
+
+    std::vector<std::string> files = replicateSampleCorpus(replicas);
+    ASSERT_FALSE(files.empty());
+
+    std::cout << "\nBatched Read Benchmark (" << files.size() << " files):" << std::endl;
+    std::cout << "Reader      | Queue Depth | Files/s      | MB/s" << std::endl;
+    std::cout << "------------------------------------------------" << std::endl;
+
+    for (size_t depth : {1, 8, 32, 128}) {
+        FileReader reader(depth);
+        size_t bytes = 0;
+        size_t failures = 0;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        reader.readBatch(files, [&](FileBuffer&& buffer) {
+            bytes += buffer.data.size();
+            failures += buffer.ok ? 0 : 1;
+        });
+        double seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        EXPECT_EQ(failures, 0u);
+        std::cout << (reader.usingIoUring() ? "io_uring    | " : "pread       | ")
+                  << std::setw(11) << depth << " | "
+                  << std::setw(12) << std::fixed << std::setprecision(0) << files.size() / seconds << " | "
+                  << std::setprecision(1) << bytes / (1024.0 * 1024.0) / seconds << std::endl;
+    }
+}
+
+// Stream a cold corpus while another thread keeps re-reading a hot working set,
+// and compare how much of each stays in the page cache with and without
+// DONTNEED. Set FILE_READER_CORPUS_MB to change the corpus size (default 16).
+TEST_F(FileReaderTest, DISABLED_PageCacheFootprintUnderConcurrentWorkload) {
+    size_t corpusMb = 16;
+    if (const char* env = std::getenv("FILE_READER_CORPUS_MB")) {
+        corpusMb = std::stoul(env);
+    }
+    const size_t fileSize = 1024 * 1024;
+
+    std::vector<std::string> corpus;
+    for (size_t i = 0; i < corpusMb; ++i) {
+        corpus.push_back(createTestFile("corpus_" + std::to_string(i) + ".dat", fileSize, 'c'));
+    }
+    std::vector<std::string> hotSet;
+    for (size_t i = 0; i < 32; ++i) {
+        hotSet.push_back(createTestFile("hot_" + std::to_string(i) + ".dat", fileSize, 'h'));
+    }
+    // Dirty pages cannot be dropped, so flush everything we just wrote
+    for (const auto& path : corpus) {
+        flushTestFile(path);
+    }
+    for (const auto& path : hotSet) {
+        flushTestFile(path);
+    }
+
+    std::cout << "\nPage Cache Footprint (" << corpusMb << " MB corpus, 32 MB hot set):" << std::endl;
+    std::cout << "DONTNEED | Corpus resident | Hot set resident | Hot reads/s" << std::endl;
+    std::cout << "------------------------------------------------------------" << std::endl;
+
+    double residentWithoutDrop = 0.0;
+    double residentWithDrop = 0.0;
+
+    for (bool dropCache : {false, true}) {
+        for (const auto& path : corpus) {
+            Utils::dropFileCache(path);
+        }
+
+        FileReadOptions hotOptions;
+        hotOptions.dropCache = false;
+        for (const auto& path : hotSet) {
+            FileBuffer buffer;
+            FileReader::readFile(path, buffer, hotOptions);
+        }
+
+        // Concurrent workload: keep cycling through the hot working set
+        std::atomic<bool> done(false);
+        std::atomic<size_t> hotReads(0);
+        std::thread hotReader([&]() {
+            while (!done) {
+                for (const auto& path : hotSet) {
+                    FileBuffer buffer;
+                    FileReader::readFile(path, buffer, hotOptions);
+                    hotReads++;
+                }
+            }
+        });
+
+        FileReadOptions options;
+        options.dropCache = dropCache;
+        FileReader reader(32, options);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        reader.readBatch(corpus, [](FileBuffer&&) {});
+        double seconds = std::chrono::duration<double>(
+            std::chrono::high_resolution_clock::now() - start).count();
+
+        done = true;
+        hotReader.join();
+
+        double corpusResident = averageResidency(corpus);
+        double hotResident = averageResidency(hotSet);
+        (dropCache ? residentWithDrop : residentWithoutDrop) = corpusResident;
+
+        std::cout << (dropCache ? "on       | " : "off      | ")
+                  << std::setw(14) << std::fixed << std::setprecision(1) << corpusResident * 100 << "% | "
+                  << std::setw(15) << hotResident * 100 << "% | "
+                  << std::setprecision(0) << hotReads / seconds << std::endl;
+    }
+
+    EXPECT_LE(residentWithDrop, residentWithoutDrop);
+}
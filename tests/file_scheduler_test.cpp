@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "../src/file_scheduler.h"
+
+namespace {
+
+InstanceRecord makeInstance(const std::string& studyUid, const std::string& path, uint64_t size) {
+    InstanceRecord instance;
+    instance.studyUid = studyUid;
+    instance.sourcePath = path;
+    instance.size = size;
+    return instance;
+}
+
+std::vector<std::string> drain(FileScheduler& scheduler) {
+    scheduler.close();
+    std::vector<std::string> order;
+    std::vector<InstanceRecord> batch;
+    while (scheduler.popBatch(batch, 1)) {
+        order.push_back(batch[0].sourcePath);
+    }
+    return order;
+}
+
+} // namespace
+
+// Test that largest-first hands out the biggest files first, FIFO among equals
+TEST(FileSchedulerTest, LargestFirst) {
+    FileScheduler scheduler(SchedulePolicy::LARGEST_FIRST, 16);
+    scheduler.push(makeInstance("1", "a", 10));
+    scheduler.push(makeInstance("2", "b", 300));
+    scheduler.push(makeInstance("1", "c", 20));
+    scheduler.push(makeInstance("2", "d", 300));
+
+    EXPECT_EQ(drain(scheduler), (std::vector<std::string>{"b", "d", "c", "a"}));
+}
+
+// Test that the study with the fewest files left goes first, counting files in flight
+TEST(FileSchedulerTest, StudyCompletionFirst) {
+    FileScheduler scheduler(SchedulePolicy::STUDY_COMPLETION, 16);
+    scheduler.push(makeInstance("big", "b1", 1));
+    scheduler.push(makeInstance("big", "b2", 1));
+    scheduler.push(makeInstance("big", "b3", 1));
+    scheduler.push(makeInstance("small", "s1", 1));
+    scheduler.push(makeInstance("small", "s2", 1));
+
+    std::vector<InstanceRecord> batch;
+    ASSERT_TRUE(scheduler.popBatch(batch, 1));
+    EXPECT_EQ(batch[0].sourcePath, "s1");
+    EXPECT_EQ(scheduler.remaining("small"), 2u);
+
+    scheduler.complete("small");
+    EXPECT_EQ(scheduler.remaining("small"), 1u);
+    EXPECT_EQ(drain(scheduler), (std::vector<std::string>{"s2", "b1", "b2", "b3"}));
+}
+
+TEST(FileSchedulerTest, ParsePolicy) {
+    SchedulePolicy policy = SchedulePolicy::FIFO;
+    EXPECT_TRUE(parseSchedulePolicy("study", policy));
+    EXPECT_EQ(policy, SchedulePolicy::STUDY_COMPLETION);
+    EXPECT_EQ(schedulePolicyName(policy), "study");
+    EXPECT_FALSE(parseSchedulePolicy("smallest", policy));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "../src/memory_budget.h"
+#include <atomic>
+#include <thread>
+
+// Test that reservations wait for released bytes once the budget is spent
+TEST(MemoryBudgetTest, AcquireWaitsForRelease) {
+    MemoryBudget budget(100);
+    ASSERT_TRUE(budget.acquire(60));
+    EXPECT_TRUE(budget.tryAcquire(40));
+    EXPECT_FALSE(budget.tryAcquire(1));
+
+    std::atomic<bool> acquired(false);
+    std::thread waiter([&] {
+        budget.acquire(50);
+        acquired = true;
+    });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(acquired);
+
+    budget.release(60);
+    waiter.join();
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(budget.getUsed(), 90u);
+}
+
+// Test that a request larger than the budget still proceeds once nothing is held
+TEST(MemoryBudgetTest, AdmitsOversizedRequestWhenIdle) {
+    MemoryBudget budget(100);
+    ASSERT_TRUE(budget.acquire(10));
+    EXPECT_FALSE(budget.tryAcquire(500));
+
+    budget.release(10);
+    EXPECT_TRUE(budget.tryAcquire(500));
+    EXPECT_EQ(budget.getUsed(), 500u);
+
+    budget.close();
+    EXPECT_FALSE(budget.acquire(1));
+}
+
+// Test that charged bytes count against the limit without blocking or holding back oversized requests
+TEST(MemoryBudgetTest, ChargesNeverBlock) {
+    MemoryBudget budget(100);
+    budget.charge(80);
+    EXPECT_TRUE(budget.tryAcquire(20));
+    EXPECT_FALSE(budget.tryAcquire(10));
+    budget.charge(30);
+    EXPECT_EQ(budget.getUsed(), 130u);
+    EXPECT_EQ(budget.getCharged(), 110u);
+
+    // Only charges are left once the acquired bytes return, so the next request proceeds
+    budget.release(20);
+    EXPECT_TRUE(budget.tryAcquire(50));
+    budget.release(50);
+
+    budget.discharge(110);
+    EXPECT_EQ(budget.getUsed(), 0u);
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "../src/metadata_cache.h"
+#include "../src/profiler.h"
+#include "../src/utils.h"
+#include <filesystem>
+#include <fstream>
+
+class MetadataCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        m_record.studyInstanceUid = "1.2.840.1";
+        m_record.patientId = "P-1";
+        m_record.modality = "MR";
+
+        for (int i = 0; i < 3; ++i) {
+            InstanceRecord instance;
+            instance.studyUid = m_record.studyInstanceUid;
+            instance.seriesUid = "1.2.840.1.1";
+            instance.sopInstanceUid = "1.2.840.1.1." + std::to_string(i);
+            instance.s3Key = "studies/1.2.840.1/" + std::to_string(i) + ".dcm";
+            instance.instanceNumber = i + 1;
+            instance.size = 1000 + i;
+            instance.contentHash = "d41d8cd98f00b204e9800998ecf8427e";
+            m_instances.push_back(instance);
+        }
+    }
+
+    void TearDown() override {
+        std::filesystem::remove_all(CACHE_DIR);
+    }
+
+    const std::string CACHE_DIR = "metadata_cache_test";
+    const std::string TABLE = "dicom-studies";
+    StudyRecord m_record;
+    std::vector<InstanceRecord> m_instances;
+};
+
+// Test that a stored study loads back unchanged
+TEST_F(MetadataCacheTest, RoundTrip) {
+    MetadataCache cache(CACHE_DIR, std::chrono::seconds(3600));
+    ASSERT_TRUE(cache.store(TABLE, m_record.studyInstanceUid, m_record, m_instances));
+
+    StudyRecord record;
+    std::vector<InstanceRecord> instances;
+    ASSERT_TRUE(cache.load(TABLE, m_record.studyInstanceUid, record, instances));
+    EXPECT_EQ(record.patientId, "P-1");
+    EXPECT_EQ(record.modality, "MR");
+    ASSERT_EQ(instances.size(), 3u);
+    EXPECT_EQ(instances[2].s3Key, m_instances[2].s3Key);
+    EXPECT_EQ(instances[2].instanceNumber, 3);
+    EXPECT_EQ(instances[2].size, 1002u);
+    EXPECT_EQ(instances[2].instanceKey(), m_instances[2].instanceKey());
+}
+
+// Test that entries for another table, invalidated entries and corrupt files miss
+TEST_F(MetadataCacheTest, MissesOnMismatch) {
+    MetadataCache cache(CACHE_DIR, std::chrono::seconds(3600));
+    ASSERT_TRUE(cache.store(TABLE, m_record.studyInstanceUid, m_record, m_instances));
+
+    StudyRecord record;
+    std::vector<InstanceRecord> instances;
+    EXPECT_FALSE(cache.load("other-table", m_record.studyInstanceUid, record, instances));
+    EXPECT_FALSE(cache.load(TABLE, m_record.studyInstanceUid, record, instances));
+
+    ASSERT_TRUE(cache.store(TABLE, m_record.studyInstanceUid, m_record, m_instances));
+    cache.invalidate(m_record.studyInstanceUid);
+    EXPECT_FALSE(cache.load(TABLE, m_record.studyInstanceUid, record, instances));
+
+    std::ofstream(Utils::joinPath(CACHE_DIR, m_record.studyInstanceUid + ".meta")) << "garbage";
+    EXPECT_FALSE(cache.load(TABLE, m_record.studyInstanceUid, record, instances));
+}
+
+// Test that a zero TTL disables the cache
+TEST_F(MetadataCacheTest, ZeroTtlDisables) {
+    MetadataCache cache(CACHE_DIR, std::chrono::seconds(0));
+    EXPECT_FALSE(cache.isEnabled());
+    EXPECT_FALSE(cache.store(TABLE, m_record.studyInstanceUid, m_record, m_instances));
+}
+
+// Test that the profiler reports cache hit rates
+TEST_F(MetadataCacheTest, ProfilerReportsHitRate) {
+    Profiler::getInstance().reset();
+    Profiler::getInstance().recordCacheLookup("Study Metadata", true);
+    Profiler::getInstance().recordCacheLookup("Study Metadata", true);
+    Profiler::getInstance().recordCacheLookup("Study Metadata", true);
+    Profiler::getInstance().recordCacheLookup("Study Metadata", false);
+
+    std::string report = Profiler::getInstance().generateReport();
+    EXPECT_NE(report.find("Cache: Study Metadata"), std::string::npos);
+    EXPECT_NE(report.find("Hit rate: 75.0%"), std::string::npos);
+    Profiler::getInstance().reset();
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include "../src/run_deadline.h"
+
+// Test that deadlines parse as durations or as the next occurrence of a clock time
+TEST(RunDeadlineTest, Parse) {
+    std::chrono::seconds fromNow(0);
+    ASSERT_TRUE(RunDeadline::parse("90m", 0, fromNow));
+    EXPECT_EQ(fromNow, std::chrono::minutes(90));
+    ASSERT_TRUE(RunDeadline::parse("2h", 0, fromNow));
+    EXPECT_EQ(fromNow, std::chrono::hours(2));
+
+    // One hour past the current local time, then the same time once it has gone by
+    std::time_t now = std::time(nullptr);
+    std::tm local{};
+    localtime_r(&now, &local);
+    char clock[8];
+    std::snprintf(clock, sizeof(clock), "%02d:%02d", (local.tm_hour + 1) % 24, local.tm_min);
+    ASSERT_TRUE(RunDeadline::parse(clock, now, fromNow));
+    EXPECT_GT(fromNow.count(), 0);
+    EXPECT_LE(fromNow, std::chrono::hours(1));
+    std::snprintf(clock, sizeof(clock), "%02d:%02d", local.tm_hour, local.tm_min);
+    ASSERT_TRUE(RunDeadline::parse(clock, now, fromNow));
+    EXPECT_GT(fromNow, std::chrono::hours(22));
+
+    EXPECT_FALSE(RunDeadline::parse("", 0, fromNow));
+    EXPECT_FALSE(RunDeadline::parse("0m", 0, fromNow));
+    EXPECT_FALSE(RunDeadline::parse("10d", 0, fromNow));
+    EXPECT_FALSE(RunDeadline::parse("24:00", 0, fromNow));
+    EXPECT_FALSE(RunDeadline::parse("6:5", 0, fromNow));
+
+    EXPECT_FALSE(RunDeadline().passed());
+    EXPECT_TRUE(RunDeadline::after(std::chrono::seconds(0)).passed());
+    EXPECT_FALSE(RunDeadline::after(std::chrono::seconds(60)).passed());
+}
+
+// Test that byte sizes accept binary suffixes and reject junk
+TEST(RunDeadlineTest, ParseByteSize) {
+    uint64_t bytes = 0;
+    ASSERT_TRUE(parseByteSize("4096", bytes));
+    EXPECT_EQ(bytes, 4096u);
+    ASSERT_TRUE(parseByteSize("512M", bytes));
+    EXPECT_EQ(bytes, 512ULL * 1024 * 1024);
+    ASSERT_TRUE(parseByteSize("2g", bytes));
+    EXPECT_EQ(bytes, 2ULL * 1024 * 1024 * 1024);
+
+    EXPECT_FALSE(parseByteSize("", bytes));
+    EXPECT_FALSE(parseByteSize("M", bytes));
+    EXPECT_FALSE(parseByteSize("1.5G", bytes));
+    EXPECT_FALSE(parseByteSize("-1", bytes));
+}
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+#include "../src/study_manifest.h"
+
+namespace {
+
+std::vector<InstanceRecord> makeInstances(const std::string& studyUid) {
+    std::vector<InstanceRecord> instances;
+    for (int i = 0; i < 4; ++i) {
+        InstanceRecord instance;
+        instance.studyUid = studyUid;
+        instance.seriesUid = i < 2 ? "1.2.840.1.2" : "1.2.840.1.1";
+        instance.sopInstanceUid = instance.seriesUid + "." + std::to_string(i);
+        instance.s3Key = "studies/" + studyUid + "/" + std::to_string(i) + ".dcm";
+        instance.instanceNumber = 4 - i;
+        instance.size = 2048 + i;
+        instance.contentHash = "0cc175b9c0f1b6a831c399e269772661";
+        instances.push_back(instance);
+    }
+    return instances;
+}
+
+} // namespace
+
+// Test that a manifest decodes to the same study, keeping download order
+TEST(StudyManifestTest, RoundTripKeepsOrder) {
+    StudyRecord record;
+    record.studyInstanceUid = "1.2.840.1";
+    record.accessionNumber = "ACC-7";
+    auto instances = makeInstances(record.studyInstanceUid);
+    sortInstances(instances);
+
+    std::string data = StudyManifest::encode(record, instances);
+
+    StudyRecord decodedRecord;
+    std::vector<InstanceRecord> decoded;
+    ASSERT_TRUE(StudyManifest::decode(data, "1.2.840.1", decodedRecord, decoded));
+    EXPECT_EQ(decodedRecord.accessionNumber, "ACC-7");
+    ASSERT_EQ(decoded.size(), 4u);
+    EXPECT_EQ(decoded[0].seriesUid, "1.2.840.1.1");
+    EXPECT_EQ(decoded[0].instanceNumber, 1);
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        EXPECT_EQ(decoded[i].s3Key, instances[i].s3Key);
+        EXPECT_EQ(decoded[i].size, instances[i].size);
+        EXPECT_EQ(decoded[i].contentHash, instances[i].contentHash);
+        EXPECT_EQ(decoded[i].studyUid, "1.2.840.1");
+    }
+}
+
+// Test that manifests for another study or cut short are rejected
+TEST(StudyManifestTest, RejectsMismatchedOrTruncated) {
+    StudyRecord record;
+    record.studyInstanceUid = "1.2.840.1";
+    std::string data = StudyManifest::encode(record, makeInstances(record.studyInstanceUid));
+
+    StudyRecord decodedRecord;
+    std::vector<InstanceRecord> decoded;
+    EXPECT_FALSE(StudyManifest::decode(data, "1.2.840.2", decodedRecord, decoded));
+    EXPECT_FALSE(StudyManifest::decode(data.substr(0, data.size() - 5), "1.2.840.1",
+                                       decodedRecord, decoded));
+    EXPECT_FALSE(StudyManifest::decode("", "1.2.840.1", decodedRecord, decoded));
+    EXPECT_TRUE(decoded.empty());
+}
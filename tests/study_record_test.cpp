@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include "../src/study_record.h"
+
+// Test that the JSON view carries only the populated fields
+TEST(StudyRecordTest, JsonOmitsEmptyFields) {
+    StudyRecord record;
+    record.studyInstanceUid = "1.2.3";
+    record.modality = "CT";
+
+    Json::Value json = record.toJson();
+    EXPECT_EQ(json.size(), 2u);
+    EXPECT_EQ(json["StudyInstanceUID"].asString(), "1.2.3");
+    EXPECT_EQ(json["Modality"].asString(), "CT");
+    EXPECT_FALSE(json.isMember("PatientID"));
+}
+
+// Test that a record survives a JSON round trip and unknown attributes are dropped
+TEST(StudyRecordTest, JsonRoundTrip) {
+    Json::Value json;
+    json["PatientID"] = "P-1";
+    json["StudyDate"] = "20240101";
+    json["SOPInstanceUID"] = "1.2.3.4";
+    json["FileLocations"] = Json::Value(Json::arrayValue);
+
+    StudyRecord record = StudyRecord::fromJson(json);
+    EXPECT_EQ(record.patientId, "P-1");
+    EXPECT_EQ(record.studyDate, "20240101");
+    EXPECT_EQ(record.sopInstanceUid, "1.2.3.4");
+
+    Json::Value roundTrip = record.toJson();
+    EXPECT_EQ(roundTrip.size(), 3u);
+    EXPECT_FALSE(roundTrip.isMember("FileLocations"));
+}
+
+// Test that packed attributes restore fields and extended attributes
+TEST(StudyRecordTest, PackedAttributesRoundTrip) {
+    StudyRecord record;
+    record.studyInstanceUid = "1.2.840.9";
+    record.patientName = "DOE^JANE";
+    record.extendedAttributes["Rows"] = "512";
+    record.extendedAttributes["ImageType"] = "ORIGINAL\\PRIMARY\\AXIAL";
+
+    StudyRecord restored;
+    ASSERT_TRUE(restored.unpackAttributes(record.packAttributes()));
+    EXPECT_EQ(restored.studyInstanceUid, "1.2.840.9");
+    EXPECT_EQ(restored.patientName, "DOE^JANE");
+    EXPECT_EQ(restored.extendedAttributes, record.extendedAttributes);
+    EXPECT_EQ(restored.toJson()["Rows"].asString(), "512");
+
+    std::string packed = record.packAttributes();
+    EXPECT_FALSE(restored.unpackAttributes(packed.substr(0, packed.size() - 1)));
+}
+
+// Test that the instance checksum ignores order but not content
+TEST(StudyRecordTest, InstancesChecksum) {
+    InstanceRecord first;
+    first.seriesUid = "1.2";
+    first.sopInstanceUid = "1.2.1";
+    first.s3Key = "study/a.dcm";
+    first.size = 100;
+    first.contentHash = "abc";
+    InstanceRecord second = first;
+    second.sopInstanceUid = "1.2.2";
+    second.s3Key = "study/b.dcm";
+
+    std::string checksum = instancesChecksum({first, second});
+    EXPECT_EQ(checksum.size(), 16u);
+    EXPECT_EQ(instancesChecksum({second, first}), checksum);
+
+    second.size = 101;
+    EXPECT_NE(instancesChecksum({first, second}), checksum);
+}
+
+// Test that date ranges expand day by day across month and leap-year boundaries
+TEST(StudyQueryTest, ExpandDates) {
+    auto dates = StudyQuery::expandDates("20240227", "20240302");
+    ASSERT_EQ(dates.size(), 5u);
+    EXPECT_EQ(dates[2], "20240229");
+    EXPECT_EQ(dates[4], "20240302");
+
+    EXPECT_EQ(StudyQuery::expandDates("20240101", "").size(), 1u);
+    EXPECT_TRUE(StudyQuery::expandDates("20240302", "20240227").empty());
+    EXPECT_TRUE(StudyQuery::expandDates("20230229", "").empty());
+}
+
+// Test that every set criterion must match
+TEST(StudyQueryTest, Matches) {
+    StudyQuery query;
+    query.patientId = "P-1";
+    ASSERT_TRUE(query.setDateRange("20240101-20240131"));
+
+    StudyRecord record;
+    record.patientId = "P-1";
+    record.studyDate = "20240115";
+    EXPECT_TRUE(query.matches(record));
+
+    record.studyDate = "20240201";
+    EXPECT_FALSE(query.matches(record));
+
+    record.studyDate = "20240115";
+    record.patientId = "P-2";
+    EXPECT_FALSE(query.matches(record));
+
+    EXPECT_FALSE(query.setDateRange("2024-01-01"));
+}
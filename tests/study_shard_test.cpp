@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include "../src/study_shard.h"
+#include <vector>
+
+// Test that shard specs must name an index inside the worker count
+TEST(StudyShardTest, ParsesSpecs) {
+    StudyShard shard;
+    ASSERT_TRUE(StudyShard::parse("2/4", shard));
+    EXPECT_EQ(shard.index, 2u);
+    EXPECT_EQ(shard.count, 4u);
+    EXPECT_TRUE(shard.isSharded());
+
+    EXPECT_FALSE(StudyShard::parse("4/4", shard));
+    EXPECT_FALSE(StudyShard::parse("1/0", shard));
+    EXPECT_FALSE(StudyShard::parse("-1/4", shard));
+    EXPECT_FALSE(StudyShard::parse("1/4x", shard));
+    EXPECT_FALSE(StudyShard::parse("14", shard));
+}
+
+// Test that every study belongs to exactly one shard and the split is roughly even
+TEST(StudyShardTest, SplitsStudiesAcrossWorkers) {
+    const size_t WORKERS = 4;
+    const size_t STUDIES = 4000;
+    std::vector<size_t> owned(WORKERS, 0);
+
+    for (size_t i = 0; i < STUDIES; i++) {
+        std::string studyUid = "1.2.840.113619.2." + std::to_string(i);
+        size_t owners = 0;
+        for (size_t w = 0; w < WORKERS; w++) {
+            StudyShard shard{w, WORKERS};
+            if (shard.owns(studyUid)) {
+                owners++;
+                owned[w]++;
+            }
+        }
+        EXPECT_EQ(owners, 1u);
+    }
+
+    for (size_t count : owned) {
+        EXPECT_GT(count, STUDIES / WORKERS * 8 / 10);
+    }
+
+    // The assignment must not change between builds
+    EXPECT_EQ(StudyShard::hashStudyUid(""), 0xcbf29ce484222325ull);
+}
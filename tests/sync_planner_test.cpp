@@ -0,0 +1,47 @@
+#include <gtest/gtest.h>
+#include "../src/sync_planner.h"
+#include "../src/s3_manager.h"
+
+class SyncPlannerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        local.studyUid = "1.2.3";
+        local.s3Key = "studies/1.2.3/image.dcm";
+        local.size = 1024;
+        local.contentHash = "0cc175b9c0f1b6a831c399e269772661";
+
+        object.key = local.s3Key;
+        object.size = local.size;
+        object.etag = local.contentHash;
+
+        indexed = local;
+    }
+
+    InstanceRecord local;
+    S3ObjectInfo object;
+    InstanceRecord indexed;
+};
+
+// Test that only missing or differing files are planned for transfer
+TEST_F(SyncPlannerTest, ClassifiesAgainstRemoteState) {
+    EXPECT_EQ(SyncPlanner::classify(local, &object, &indexed), SyncAction::UP_TO_DATE);
+    EXPECT_EQ(SyncPlanner::classify(local, nullptr, &indexed), SyncAction::UPLOAD_NEW);
+    EXPECT_EQ(SyncPlanner::classify(local, &object, nullptr), SyncAction::INDEX_ONLY);
+
+    S3ObjectInfo resized = object;
+    resized.size = 2048;
+    EXPECT_FALSE(SyncPlanner::needsHash(local, &resized));
+    EXPECT_EQ(SyncPlanner::classify(local, &resized, &indexed), SyncAction::UPLOAD_CHANGED);
+
+    InstanceRecord edited = local;
+    edited.contentHash = "92eb5ffee6ae2fec3ad71c777531578f";
+    EXPECT_TRUE(SyncPlanner::needsHash(edited, &object));
+    EXPECT_EQ(SyncPlanner::classify(edited, &object, &indexed), SyncAction::UPLOAD_CHANGED);
+}
+
+// Test that a multipart ETag is never mistaken for a checksum
+TEST_F(SyncPlannerTest, IgnoresMultipartEtags) {
+    object.etag = "9b2cf535f27731c974343645a3985328-3";
+    EXPECT_EQ(SyncPlanner::classify(local, &object, &indexed), SyncAction::UP_TO_DATE);
+    EXPECT_EQ(SyncPlanner::classify(local, &object, nullptr), SyncAction::UPLOAD_CHANGED);
+}
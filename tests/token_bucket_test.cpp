@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include "../src/token_bucket.h"
+#include <chrono>
+
+// Test that callers are paced to the configured rate once the burst is spent
+TEST(TokenBucketTest, PacesToRate) {
+    TokenBucket bucket(2000, 1.0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 30; ++i) {
+        bucket.acquire(100);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 3000 units against a 2000-unit burst leaves 1000 units at 2000/s
+    EXPECT_GE(elapsed, 0.4);
+    EXPECT_LT(elapsed, 2.0);
+}
+
+// Test that under-estimated consumption is repaid by later callers
+TEST(TokenBucketTest, SettleCreatesDebt) {
+    TokenBucket bucket(1000, 1.0);
+    bucket.acquire(1000);
+    bucket.settle(500);
+
+    auto start = std::chrono::steady_clock::now();
+    bucket.acquire(1);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_GE(elapsed, 0.4);
+}
+
+// Test that a zero rate never blocks
+TEST(TokenBucketTest, ZeroRateIsUnlimited) {
+    TokenBucket bucket(0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        bucket.acquire(1000);
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_LT(elapsed, 0.1);
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "../src/upload_journal.h"
+#include "../src/utils.h"
+#include <fstream>
+
+class UploadJournalTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        Utils::deleteFile(JOURNAL_PATH);
+    }
+
+    InstanceRecord makeInstance(const std::string& studyUid, const std::string& s3Key) {
+        InstanceRecord instance;
+        instance.studyUid = studyUid;
+        instance.s3Key = s3Key;
+        return instance;
+    }
+
+    const std::string JOURNAL_PATH = "upload_journal_test.journal";
+};
+
+// Test that pending locations survive a restart until they are flushed
+TEST_F(UploadJournalTest, ReplaysUnflushedLocations) {
+    {
+        UploadJournal journal(JOURNAL_PATH);
+        ASSERT_TRUE(journal.isOpen());
+        EXPECT_TRUE(journal.recordPending(makeInstance("study-1", "studies/study-1/a.dcm")));
+        EXPECT_TRUE(journal.recordPending(makeInstance("study-1", "studies/study-1/b.dcm")));
+        EXPECT_TRUE(journal.recordPending(makeInstance("study-2", "studies/study-2/c.dcm")));
+        EXPECT_TRUE(journal.recordFlushed("study-1", {"studies/study-1/a.dcm"}));
+        EXPECT_TRUE(journal.recordFlushed("study-2", {"studies/study-2/c.dcm"}));
+    }
+
+    UploadJournal reopened(JOURNAL_PATH);
+    auto unflushed = reopened.getUnflushed();
+    ASSERT_EQ(unflushed.size(), 1u);
+    ASSERT_EQ(unflushed["study-1"].size(), 1u);
+    EXPECT_EQ(unflushed["study-1"][0].s3Key, "studies/study-1/b.dcm");
+}
+
+// Test that instance details are replayed along with the key
+TEST_F(UploadJournalTest, ReplaysInstanceDetails) {
+    {
+        InstanceRecord instance = makeInstance("study-1", "studies/study-1/a.dcm");
+        instance.seriesUid = "series-1";
+        instance.sopInstanceUid = "sop-1";
+        instance.instanceNumber = 7;
+        instance.size = 1234;
+        instance.contentHash = "0123456789abcdef0123456789abcdef";
+
+        UploadJournal journal(JOURNAL_PATH);
+        EXPECT_TRUE(journal.recordPending(instance));
+    }
+
+    UploadJournal reopened(JOURNAL_PATH);
+    auto unflushed = reopened.getUnflushed();
+    ASSERT_EQ(unflushed["study-1"].size(), 1u);
+    const auto& instance = unflushed["study-1"][0];
+    EXPECT_EQ(instance.seriesUid, "series-1");
+    EXPECT_EQ(instance.sopInstanceUid, "sop-1");
+    EXPECT_EQ(instance.instanceNumber, 7);
+    EXPECT_EQ(instance.size, 1234u);
+    EXPECT_EQ(instance.contentHash, "0123456789abcdef0123456789abcdef");
+    EXPECT_EQ(instance.instanceKey(), "series-1#sop-1");
+}
+
+// Test that a torn final record from a crash is ignored
+TEST_F(UploadJournalTest, IgnoresTornRecord) {
+    {
+        std::ofstream file(JOURNAL_PATH);
+        file << "P\tstudy-1\tstudies/study-1/a.dcm\n";
+        file << "P\tstudy-1\tstudies/study-1/b.dcm\tseries-1";
+    }
+
+    UploadJournal journal(JOURNAL_PATH);
+    auto unflushed = journal.getUnflushed();
+    ASSERT_EQ(unflushed["study-1"].size(), 1u);
+    EXPECT_EQ(unflushed["study-1"][0].s3Key, "studies/study-1/a.dcm");
+}
+
+// Test that a running journal is compacted once everything is flushed
+TEST_F(UploadJournalTest, CompactsWhenFullyFlushed) {
+    UploadJournal journal(JOURNAL_PATH);
+    EXPECT_TRUE(journal.recordPending(makeInstance("study-1", "studies/study-1/a.dcm")));
+    EXPECT_TRUE(journal.recordPending(makeInstance("study-2", "studies/study-2/b.dcm")));
+    EXPECT_TRUE(journal.recordFlushed("study-1", {"studies/study-1/a.dcm"}));
+    EXPECT_GT(Utils::getFileSize(JOURNAL_PATH), 0u);
+
+    EXPECT_TRUE(journal.recordFlushed("study-2", {"studies/study-2/b.dcm"}));
+    EXPECT_EQ(Utils::getFileSize(JOURNAL_PATH), 0u);
+
+    // Appends still reach the rewritten file
+    EXPECT_TRUE(journal.recordPending(makeInstance("study-3", "studies/study-3/c.dcm")));
+    EXPECT_TRUE(journal.sync());
+    UploadJournal reopened(JOURNAL_PATH);
+    auto unflushed = reopened.getUnflushed();
+    ASSERT_EQ(unflushed.size(), 1u);
+    EXPECT_EQ(unflushed["study-3"][0].s3Key, "studies/study-3/c.dcm");
+}